@@ -450,7 +450,8 @@ ASPath ASPathCreate(const ASPathNodeSource *source, void *context, void *startNo
             const float cost = GetNodeCost(current) + NeighborListGetEdgeCost(neighborList, n);
             Node neighbor = GetNode(visitedNodes, NeighborListGetNodeKey(neighborList, n));
             
-            if (!NodeHasEstimatedCost(neighbor)) {
+            const int seen = NodeHasEstimatedCost(neighbor);
+            if (!seen) {
                 SetNodeEstimatedCost(neighbor, GetPathCostHeuristic(neighbor, goalNode));
             }
             
@@ -463,6 +464,12 @@ ASPath ASPathCreate(const ASPathNodeSource *source, void *context, void *startNo
             }
             
             if (!NodeIsInOpenSet(neighbor) && !NodeIsInClosedSet(neighbor)) {
+                // the comparator may identify nodes by part of their key only; keep the rest of the key
+                // (and the estimate derived from it) in sync with the cheapest path found so far
+                if (seen && !NodeIsGoal(neighbor)) {
+                    memcpy(GetNodeKey(neighbor), NeighborListGetNodeKey(neighborList, n), source->nodeSize);
+                    SetNodeEstimatedCost(neighbor, GetPathCostHeuristic(neighbor, goalNode));
+                }
                 AddNodeToOpenSet(neighbor, cost, current);
             }
         }
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include "parallel.hpp"
+
 template<typename NameType = std::string>
 class MaxMatch
 {
@@ -77,7 +79,13 @@ public:
     // Helper for hopcroftKarp - uses DFS guided by layer number to find augmenting paths.  Returns true if an
     // augmenting path from uIdx was found.
     bool findPath(const VertexIndex& uIdx);
-    
+    // Same result as hopcroftKarp(), but splits the graph into connected components first and matches the components
+    // concurrently on threadCount threads (0 for hardware concurrency). Components with at least
+    // parallelLayerThreshold U vertexes are matched one at a time with a level-synchronous parallel BFS layering.
+    // Matched edges and us_to_vs()/vs_to_us() are filled exactly like hopcroftKarp() so findMinimumVertexCover() can
+    // be used unchanged.
+    int hopcroftKarpParallel(size_t threadCount = 0, size_t parallelLayerThreshold = 100000);
+
     void flagMatchedOnMatchingEdges();
     void findMinimumVertexCover(VertexIndexSet& uMinCover, VertexIndexSet& vMinCover) const;
     void insertAlternatingEdgesRecursively(VertexIndexSet& ZUSet, VertexIndexSet& ZVSet, VertexIndex uvIdx, bool vIfTrue) const;
@@ -86,6 +94,27 @@ public:
         return m_edges.size();
     }
 protected:
+    // Compact (CSR) copy of one connected component used by hopcroftKarpParallel().  Vertexes are renumbered
+    // 0..n-1 inside the component; -1 stands for the NILL vertex.
+    struct Component
+    {
+        VertexIndexes us;
+        VertexIndexes vs;
+        std::vector<int> adjStart;
+        std::vector<int> adj;
+        std::vector<int> uToV;
+        std::vector<int> vToU;
+        std::vector<int> layers;
+        std::vector<size_t> edgeCursor;
+        int nillLayer;
+
+        bool makeLayers(size_t threadCount);
+        bool findPath(int u);
+        int hopcroftKarp(size_t threadCount);
+    };
+
+    void buildComponent(Component& component, std::vector<int>& vLocalIdxs) const;
+
     typedef std::map<NameType, VertexIndex> VertexNamesToIndexes;
 
     static const Layer InfLayer;
@@ -260,6 +289,213 @@ bool MaxMatch<NameType>::findPath(const VertexIndex& uIdx) {
     }
 }
 
+template<typename NameType>
+int MaxMatch<NameType>::hopcroftKarpParallel(size_t threadCount, size_t parallelLayerThreshold) {
+    if (threadCount == 0) {
+        threadCount = parallel::default_thread_count();
+    }
+    const VertexIndex uCount(m_u_vertexes.size());
+    const VertexIndex vCount(m_v_vertexes.size());
+
+    m_layers.resize(m_u_vertexes.size());
+
+    m_us_to_vs.resize(m_u_vertexes.size());
+    std::fill(m_us_to_vs.begin(), m_us_to_vs.end(), NillVertIdx);
+
+    m_vs_to_us.resize(m_v_vertexes.size());
+    std::fill(m_vs_to_us.begin(), m_vs_to_us.end(), NillVertIdx);
+
+    // Union-find over U vertexes [0, uCount) and V vertexes [uCount, uCount + vCount)
+    std::vector<VertexIndex> parents(uCount + vCount);
+    for (VertexIndex i = 0; i < uCount + vCount; ++i) {
+        parents[i] = i;
+    }
+    auto findRoot = [&parents](VertexIndex i) {
+        while (parents[i] != i) {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+        return i;
+    };
+    for (const auto& e : m_edges) {
+        VertexIndex a(findRoot(e.u_vertex)), b(findRoot(uCount + e.v_vertex));
+        if (a != b) {
+            parents[a] = b;
+        }
+    }
+
+    std::vector<Component> components;
+    std::vector<std::ptrdiff_t> rootToComponent(uCount + vCount, -1);
+    for (VertexIndex uIdx = 1; uIdx < uCount; ++uIdx) {
+        if (m_u_vertexes[uIdx].edges.empty()) {
+            continue;
+        }
+        VertexIndex root(findRoot(uIdx));
+        if (rootToComponent[root] < 0) {
+            rootToComponent[root] = components.size();
+            components.push_back(Component());
+        }
+        components[rootToComponent[root]].us.push_back(uIdx);
+    }
+    for (VertexIndex vIdx = 1; vIdx < vCount; ++vIdx) {
+        if (m_v_vertexes[vIdx].edges.empty()) {
+            continue;
+        }
+        components[rootToComponent[findRoot(uCount + vIdx)]].vs.push_back(vIdx);
+    }
+    // Largest components first so the pool does not end up waiting on one big straggler
+    std::sort(components.begin(), components.end(), [](const Component& a, const Component& b) {
+        return a.us.size() > b.us.size();
+    });
+    size_t largeCount(0);
+    while (largeCount < components.size() && components[largeCount].us.size() >= parallelLayerThreshold) {
+        largeCount++;
+    }
+
+    std::vector<int> vLocalIdxs(vCount, -1);
+    std::vector<int> componentMatches(components.size(), 0);
+    for (size_t c = 0; c < largeCount; c++) {
+        buildComponent(components[c], vLocalIdxs);
+        componentMatches[c] = components[c].hopcroftKarp(threadCount);
+    }
+    parallel::parallel_for(components.size() - largeCount, [&](size_t i) {
+        Component& component(components[largeCount + i]);
+        buildComponent(component, vLocalIdxs);
+        componentMatches[largeCount + i] = component.hopcroftKarp(1);
+    }, threadCount);
+
+    int matches(0);
+    for (size_t c = 0; c < components.size(); c++) {
+        const Component& component(components[c]);
+        for (size_t u = 0; u < component.us.size(); u++) {
+            if (component.uToV[u] < 0) {
+                continue;
+            }
+            VertexIndex uIdx(component.us[u]);
+            VertexIndex vIdx(component.vs[component.uToV[u]]);
+            m_us_to_vs[uIdx] = vIdx;
+            m_vs_to_us[vIdx] = uIdx;
+            EdgeIndex eIdx = u_vertexes()[uIdx].edgeMap.find(vIdx)->second;
+            m_edges[eIdx].matched = true;
+        }
+        matches += componentMatches[c];
+    }
+    return matches;
+}
+
+template<typename NameType>
+void MaxMatch<NameType>::buildComponent(Component& component, std::vector<int>& vLocalIdxs) const {
+    // Components own disjoint V vertexes, so concurrent writes to vLocalIdxs never touch the same element.
+    for (size_t v = 0; v < component.vs.size(); v++) {
+        vLocalIdxs[component.vs[v]] = static_cast<int>(v);
+    }
+    component.adjStart.resize(component.us.size() + 1);
+    component.adj.clear();
+    for (size_t u = 0; u < component.us.size(); u++) {
+        component.adjStart[u] = static_cast<int>(component.adj.size());
+        for (const auto& e : m_u_vertexes[component.us[u]].edges) {
+            component.adj.push_back(vLocalIdxs[m_edges[e].v_vertex]);
+        }
+    }
+    component.adjStart[component.us.size()] = static_cast<int>(component.adj.size());
+}
+
+template<typename NameType>
+int MaxMatch<NameType>::Component::hopcroftKarp(size_t threadCount) {
+    uToV.assign(us.size(), -1);
+    vToU.assign(vs.size(), -1);
+    layers.resize(us.size());
+    edgeCursor.resize(us.size());
+    int matches(0);
+    const int uEnd(static_cast<int>(us.size()));
+    while (makeLayers(threadCount)) {
+        for (int u = 0; u < uEnd; ++u) {
+            edgeCursor[u] = adjStart[u];
+        }
+        for (int u = 0; u < uEnd; ++u) {
+            if (uToV[u] < 0 && findPath(u)) {
+                ++matches;
+            }
+        }
+    }
+    return matches;
+}
+
+template<typename NameType>
+bool MaxMatch<NameType>::Component::makeLayers(size_t threadCount) {
+    const int inf(std::numeric_limits<int>::max());
+    std::vector<int> frontier, next;
+    for (size_t u = 0; u < us.size(); ++u) {
+        if (uToV[u] < 0) {
+            layers[u] = 0;
+            frontier.push_back(static_cast<int>(u));
+        } else {
+            layers[u] = inf;
+        }
+    }
+    nillLayer = inf;
+    // Level-synchronous BFS: every frontier vertex only reads layers, newly reached U vertexes are collected per
+    // chunk and assigned to the next layer afterwards, so large frontiers can be scanned by several threads.
+    // parallel_for starts new threads on every call, so small layers are scanned inline (one chunk).
+    const size_t maxChunkCount(threadCount > 1 ? threadCount * 4 : 1);
+    std::vector<std::vector<int> > candidates(maxChunkCount);
+    std::vector<char> reachedNill(maxChunkCount);
+    for (int layer = 0; !frontier.empty() && nillLayer == inf; ++layer) {
+        const size_t chunkCount(frontier.size() >= 4096 ? maxChunkCount : 1);
+        const size_t chunk((frontier.size() + chunkCount - 1) / chunkCount);
+        parallel::parallel_for(chunkCount, [&](size_t c) {
+            candidates[c].clear();
+            reachedNill[c] = 0;
+            for (size_t i = c * chunk; i < std::min(frontier.size(), (c + 1) * chunk); ++i) {
+                const int u(frontier[i]);
+                for (int a = adjStart[u]; a < adjStart[u + 1]; ++a) {
+                    const int w(vToU[adj[a]]);
+                    if (w < 0) {
+                        reachedNill[c] = 1;
+                    } else if (layers[w] == inf) {
+                        candidates[c].push_back(w);
+                    }
+                }
+            }
+        }, threadCount);
+        next.clear();
+        for (size_t c = 0; c < chunkCount; ++c) {
+            if (reachedNill[c]) {
+                nillLayer = layer + 1;
+            }
+            for (const auto& w : candidates[c]) {
+                if (layers[w] == inf) {
+                    layers[w] = layer + 1;
+                    next.push_back(w);
+                }
+            }
+        }
+        frontier.swap(next);
+    }
+    return nillLayer != inf;
+}
+
+template<typename NameType>
+bool MaxMatch<NameType>::Component::findPath(int u) {
+    const int inf(std::numeric_limits<int>::max());
+    if (layers[u] == inf) {
+        return false;
+    }
+    const int nextLayer(layers[u] + 1);
+    for (size_t& a = edgeCursor[u]; static_cast<int>(a) < adjStart[u + 1]; ++a) {
+        const int v(adj[a]);
+        const int w(vToU[v]);
+        if (w < 0 ? nextLayer == nillLayer : (layers[w] == nextLayer && findPath(w))) {
+            uToV[u] = v;
+            vToU[v] = u;
+            ++a;
+            return true;
+        }
+    }
+    layers[u] = inf;
+    return false;
+}
+
 template<typename NameType>
 const MaxMatch<>::VertexIndexes& MaxMatch<NameType>::vs_to_us() const {
     return m_vs_to_us;
@@ -0,0 +1,142 @@
+#include "precompiled.hpp"
+#include "alternatives.hpp"
+
+using namespace astarrtree;
+
+static const float inf = std::numeric_limits<float>::infinity();
+
+alternative_router::alternative_router(const rect_graph& graph, rtree_t* rtree_ptr, const search_options& options)
+    : graph(graph)
+    , rtree_ptr(rtree_ptr)
+    , options(options)
+    , g(graph.size())
+    , base(graph.size())
+    , entry(graph.size())
+    , parent(graph.size())
+    , stamp(graph.size(), 0)
+    , penalty(graph.size())
+    , taken(graph.size()) {
+    if (options.costs == CM_GEODESIC) {
+        metric.reset(new geodesic_metric(graph.get_width()));
+    }
+}
+
+float alternative_router::heuristic(xy32 p, xy32 to) const {
+    if (options.costs == CM_UNIT) {
+        return 0;
+    }
+    if (options.costs == CM_EUCLIDEAN) {
+        const float dx = static_cast<float>(wrapped_dx(p.x, to.x, graph.get_wrap() ? graph.get_width() : 0));
+        const float dy = static_cast<float>(p.y - to.y);
+        return sqrtf(dx * dx + dy * dy);
+    }
+    return step_cost(options.costs, metric.get(), p, to);
+}
+
+float alternative_router::search(xy32 from, uint32_t from_id, xy32 to, uint32_t to_id, std::vector<uint32_t>& path) {
+    path.clear();
+    if (++current_stamp == 0) {
+        std::fill(stamp.begin(), stamp.end(), 0);
+        current_stamp = 1;
+    }
+    searches++;
+    open.clear();
+    stamp[from_id] = current_stamp;
+    g[from_id] = 0;
+    base[from_id] = 0;
+    entry[from_id] = from;
+    parent[from_id] = from_id;
+    open.push_back(queue_item(heuristic(from, to), from_id));
+    while (!open.empty()) {
+        std::pop_heap(open.begin(), open.end(), std::greater<queue_item>());
+        const queue_item top = open.back();
+        open.pop_back();
+        const uint32_t u = top.second;
+        // stale: queued again since with a lower cost
+        if (top.first > g[u] + heuristic(entry[u], to)) {
+            continue;
+        }
+        if (u == to_id) {
+            for (uint32_t c = u; ; c = parent[c]) {
+                path.push_back(c);
+                if (c == from_id) {
+                    break;
+                }
+            }
+            std::reverse(path.begin(), path.end());
+            return base[u] + step_cost(options.costs, metric.get(), entry[u], to);
+        }
+        expanded++;
+        const xy32xy32& cu = graph.cell(u);
+        for (uint32_t e = graph.edges_begin(u); e < graph.edges_end(u); e++) {
+            const uint32_t v = graph.edge_target(e);
+            const int shift = graph.edge_shift(e);
+            const xy32xy32& cv = graph.cell(v);
+            const xy32xy32 shifted = { { cv.xy0.x + shift, cv.xy0.y }, { cv.xy1.x + shift, cv.xy1.y } };
+            xy32 p = nearest_entry_pixel(cu, shifted, entry[u]);
+            const float step = step_cost(options.costs, metric.get(), entry[u], p);
+            const float d = g[u] + step * penalty[v];
+            if (stamp[v] != current_stamp || d < g[v]) {
+                p.x -= shift;
+                stamp[v] = current_stamp;
+                g[v] = d;
+                base[v] = base[u] + step;
+                entry[v] = p;
+                parent[v] = u;
+                open.push_back(queue_item(d + heuristic(p, to), v));
+                std::push_heap(open.begin(), open.end(), std::greater<queue_item>());
+            }
+        }
+    }
+    return inf;
+}
+
+std::vector<alternative_route> alternative_router::find(xy32 from, xy32 to, const alternative_options& alternatives) {
+    std::vector<alternative_route> routes;
+    searches = 0;
+    expanded = 0;
+    const int from_id = graph.find_containing(from);
+    const int to_id = graph.find_containing(to);
+    if (from_id < 0 || to_id < 0) {
+        std::cerr << "alternative_router: from or to is not inside exactly one cell" << std::endl;
+        return routes;
+    }
+    std::fill(penalty.begin(), penalty.end(), 1.0f);
+    std::fill(taken.begin(), taken.end(), 0);
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<uint32_t> path;
+    // a route repeats once the penalties cannot push the search off it, so the attempts are bounded too
+    for (int attempt = 0; static_cast<int>(routes.size()) < alternatives.count && attempt < alternatives.count * 4; attempt++) {
+        if (attempt > 0 && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() > alternatives.budget_ms) {
+            break;
+        }
+        const float cost = search(from, static_cast<uint32_t>(from_id), to, static_cast<uint32_t>(to_id), path);
+        if (cost == inf || (!routes.empty() && cost > routes.front().cost * alternatives.max_stretch)) {
+            break;
+        }
+        // the cost entering each cell, as the search paid it without penalties
+        float shared = 0;
+        for (uint32_t c : path) {
+            if (taken[c]) {
+                shared += c == path.front() ? 0 : base[c] - base[parent[c]];
+            }
+        }
+        const float overlap = cost > 0 ? shared / cost : 1.0f;
+        for (uint32_t c : path) {
+            penalty[c] *= alternatives.penalty;
+        }
+        if (!routes.empty() && overlap > alternatives.max_overlap) {
+            continue;
+        }
+        alternative_route route;
+        route.cost = cost;
+        route.overlap = overlap;
+        for (uint32_t c : path) {
+            route.cells.push_back(graph.cell(c));
+            taken[c] = 1;
+        }
+        route.waypoints = cell_path_waypoints(rtree_ptr, from, to, route.cells, options);
+        routes.push_back(route);
+    }
+    return routes;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "rectgraph.hpp"
+
+namespace astarrtree {
+    struct alternative_options {
+        // routes wanted, the shortest included
+        int count = 3;
+        // each search multiplies the cost of entering the cells of its route by this
+        float penalty = 1.5f;
+        // a route sharing more than this fraction of its cost with the routes already taken is skipped
+        float max_overlap = 0.6f;
+        // a route longer than this many times the shortest ends the search
+        float max_stretch = 2.0f;
+        // no new search starts once this much time has passed (the first one always runs)
+        double budget_ms = 500;
+    };
+
+    struct alternative_route {
+        std::vector<xy32xy32> cells;
+        std::vector<xy32> waypoints;
+        // cell path cost under the search's cost model, without penalties
+        float cost;
+        // fraction of 'cost' spent in cells of the routes before this one
+        float overlap;
+    };
+
+    // Materially different routes between two pixels by iterative penalties: the cell search is repeated over
+    // the rect_graph with the cells of every route found so far made more expensive, and a route is kept when
+    // it overlaps the kept ones little enough (Suez against the Cape, say). Costs are entry-point costs as in
+    // rect_graph::one_to_all. The search workspace is allocated once per router and reused by every search,
+    // so keep one router per thread for repeated queries.
+    class alternative_router {
+    public:
+        alternative_router(const rect_graph& graph, rtree_t* rtree_ptr, const search_options& options);
+
+        // Shortest first; empty when either endpoint is not inside a cell or there is no route.
+        std::vector<alternative_route> find(xy32 from, xy32 to, const alternative_options& alternatives);
+        // Searches run and cells expanded by the last find().
+        size_t get_searches() const { return searches; }
+        size_t get_expanded() const { return expanded; }
+    private:
+        typedef std::pair<float, uint32_t> queue_item;
+
+        float heuristic(xy32 p, xy32 to) const;
+        // Penalized A* from 'from' in cell 'from_id' to cell 'to_id'; fills 'path' (cell ids) and returns its
+        // unpenalized cost, or infinity.
+        float search(xy32 from, uint32_t from_id, xy32 to, uint32_t to_id, std::vector<uint32_t>& path);
+
+        const rect_graph& graph;
+        rtree_t* rtree_ptr;
+        search_options options;
+        std::unique_ptr<geodesic_metric> metric;
+        // workspace: entries are valid where stamp == current_stamp
+        std::vector<float> g;
+        std::vector<float> base;
+        std::vector<xy32> entry;
+        std::vector<uint32_t> parent;
+        std::vector<uint32_t> stamp;
+        uint32_t current_stamp = 0;
+        std::vector<queue_item> open;
+        std::vector<float> penalty;
+        std::vector<uint8_t> taken;
+        size_t searches = 0;
+        size_t expanded = 0;
+    };
+}
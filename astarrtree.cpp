@@ -1,5 +1,9 @@
 #include "precompiled.hpp"
 #include "astarrtree.hpp"
+#include "cellwidth.hpp"
+#include "corridor.hpp"
+#include "landmark.hpp"
+#include "routecache.hpp"
 #include "AStar.h"
 
 using namespace astarrtree;
@@ -22,34 +26,271 @@ box_t box_t_from_xyxy(const xy32xy32& v) {
     return r;
 }
 
-void RTreePathNodeNeighbors(ASNeighborList neighbors, void *node, void *context) {
-    xy32xy32* n = reinterpret_cast<xy32xy32*>(node);
-    rtree_t* rtree_ptr = reinterpret_cast<rtree_t*>(context);
-    box_t query_box = box_t_from_xyxy(*n);
+// Cell search node: a rectangle plus the pixel the path enters it at. Nodes are identified by their
+// rectangle only (RTreePathNodeComparator), so the entry pixel follows the cheapest path found so far.
+struct cell_node {
+    xy32xy32 rect;
+    xy32 entry;
+};
+
+// Context of the cell (rectangle) search. When 'corridor_ptr' is set, only cells overlapping it are expanded.
+struct cell_search_context {
+    rtree_t* rtree_ptr;
+    const corridor* corridor_ptr;
+    cost_model costs;
+    xy32 goal;
+    // raster width when the left and right edges are adjacent (anti-meridian), 0 otherwise
+    int wrap_width;
+    // set for CM_GEODESIC
+    const geodesic_metric* metric;
+    // ALT lower bounds: landmark distances of the goal cell and its slack (see cell_slack)
+    const landmark_table* landmarks;
+    const float* goal_distances;
+    float goal_slack;
+    size_t expanded;
+    // cells narrower than 'min_width_nm' are skipped when 'widths' is set, unless they are within
+    // 'approach' pixels of 'start' or 'goal'
+    const cell_width_table* widths;
+    float min_width_nm;
+    xy32 start;
+    int approach;
+};
+
+const xy32xy32* cell_path_rect(ASPath path, size_t index) {
+    return &reinterpret_cast<cell_node*>(ASPathGetNode(path, index))->rect;
+}
+
+enum RECT_RELATION {
+    RR_DOWN_RIGHT,
+    RR_UP_RIGHT,
+    RR_UP_LEFT,
+    RR_DOWN_LEFT,
+    RR_DOWN,
+    RR_UP,
+    RR_RIGHT,
+    RR_LEFT,
+    RR_UNKNOWN,
+};
+
+RECT_RELATION rect_neighbor_relation(const xy32xy32* n1c, const xy32xy32* n2c);
+
+xy32 astarrtree::cell_center(const xy32xy32& c) {
+    return xy32{ (c.xy0.x + c.xy1.x - 1) / 2, (c.xy0.y + c.xy1.y - 1) / 2 };
+}
+
+xy32 astarrtree::nearest_entry_pixel(const xy32xy32& from, const xy32xy32& to, xy32 p) {
+    int x0 = to.xy0.x, x1 = to.xy1.x - 1, y0 = to.xy0.y, y1 = to.xy1.y - 1;
+    switch (rect_neighbor_relation(&from, &to)) {
+    case RR_DOWN_RIGHT: x1 = x0; y1 = y0; break;
+    case RR_UP_RIGHT: x1 = x0; y0 = y1; break;
+    case RR_UP_LEFT: x0 = x1; y0 = y1; break;
+    case RR_DOWN_LEFT: x0 = x1; y1 = y0; break;
+    case RR_DOWN: x0 = std::max(x0, from.xy0.x); x1 = std::min(x1, from.xy1.x - 1); y1 = y0; break;
+    case RR_UP: x0 = std::max(x0, from.xy0.x); x1 = std::min(x1, from.xy1.x - 1); y0 = y1; break;
+    case RR_RIGHT: y0 = std::max(y0, from.xy0.y); y1 = std::min(y1, from.xy1.y - 1); x1 = x0; break;
+    case RR_LEFT: y0 = std::max(y0, from.xy0.y); y1 = std::min(y1, from.xy1.y - 1); x0 = x1; break;
+    default: break;
+    }
+    return xy32{ std::min(std::max(p.x, x0), x1), std::min(std::max(p.y, y0), y1) };
+}
+
+float pixel_distance(xy32 a, xy32 b) {
+    const float dx = static_cast<float>(a.x - b.x);
+    const float dy = static_cast<float>(a.y - b.y);
+    return sqrtf(dx * dx + dy * dy);
+}
+
+int floor_div(int x, int d) {
+    return x >= 0 ? x / d : -((-x + d - 1) / d);
+}
+
+int wrap_x(int x, int wrap_width) {
+    return x - floor_div(x, wrap_width) * wrap_width;
+}
+
+void astarrtree::pixel_to_lat_lng(float x, float y, int width, float& lat, float& lng) {
+    lng = x / width * 360.0f - 180.0f;
+    if (lng >= 180.0f) {
+        lng -= 360.0f;
+    } else if (lng < -180.0f) {
+        lng += 360.0f;
+    }
+    lat = 90.0f - y / (width / 2) * 180.0f;
+}
+
+xy32 astarrtree::lat_lng_to_pixel(float lat, float lng, int width) {
+    const int height = width / 2;
+    const int x = static_cast<int>(floor((lng + 180.0) / 360.0 * width));
+    const int y = static_cast<int>(floor((90.0 - lat) / 180.0 * height));
+    return xy32{ std::min(std::max(x, 0), width - 1), std::min(std::max(y, 0), height - 1) };
+}
+
+astarrtree::geodesic_metric::geodesic_metric(int width)
+    : radians_per_pixel(2 * pi / width)
+    , cos_by_row(std::max(width / 2, 1)) {
+    for (size_t y = 0; y < cos_by_row.size(); y++) {
+        cos_by_row[y] = cos(pi / 2 - (y + 0.5) * radians_per_pixel);
+    }
+}
+
+double astarrtree::geodesic_metric::row_cos(int y) const {
+    return cos_by_row[std::min(std::max(y, 0), static_cast<int>(cos_by_row.size()) - 1)];
+}
+
+// Haversine; the longitude term is periodic, so points given across the wrap seam need no special case.
+float astarrtree::geodesic_metric::distance_nm(xy32 a, xy32 b) const {
+    const double sin_dlat = sin((b.y - a.y) * radians_per_pixel / 2);
+    const double sin_dlon = sin((b.x - a.x) * radians_per_pixel / 2);
+    const double h = sin_dlat * sin_dlat + row_cos(a.y) * row_cos(b.y) * sin_dlon * sin_dlon;
+    return static_cast<float>(2 * earth_radius_nm * asin(std::min(1.0, sqrt(h))));
+}
+
+double astarrtree::geodesic_metric::route_length_nm(const std::vector<xy32>& waypoints) const {
+    double length = 0;
+    for (size_t i = 1; i < waypoints.size(); i++) {
+        length += distance_nm(waypoints[i - 1], waypoints[i]);
+    }
+    return length;
+}
+
+float astarrtree::step_cost(cost_model costs, const geodesic_metric* metric, xy32 a, xy32 b) {
+    switch (costs) {
+    case CM_UNIT: return 1;
+    case CM_GEODESIC: return metric->distance_nm(a, b);
+    default: return pixel_distance(a, b);
+    }
+}
+
+// Distance between two pixels under the Euclidean or geodesic cost model.
+float cell_step_cost(const cell_search_context* csc, xy32 a, xy32 b) {
+    return csc->metric ? csc->metric->distance_nm(a, b) : pixel_distance(a, b);
+}
+
+int astarrtree::wrapped_dx(int x0, int x1, int wrap_width) {
+    const int dx = abs(x0 - x1);
+    return wrap_width > 0 ? std::min(dx, wrap_width - dx) : dx;
+}
+
+xy32xy32 shift_rect_x(const xy32xy32& r, int dx) {
+    return xy32xy32{ { r.xy0.x + dx, r.xy0.y }, { r.xy1.x + dx, r.xy1.y } };
+}
+
+bool rect_contains(const xy32xy32& r, xy32 p) {
+    return r.xy0.x <= p.x && p.x < r.xy1.x && r.xy0.y <= p.y && p.y < r.xy1.y;
+}
+
+// Whether some pixel of 'r' is within 'distance' pixels of 'p'.
+bool rect_near(const xy32xy32& r, xy32 p, int distance) {
+    const int64_t dx = std::max(std::max(r.xy0.x - p.x, p.x - (r.xy1.x - 1)), 0);
+    const int64_t dy = std::max(std::max(r.xy0.y - p.y, p.y - (r.xy1.y - 1)), 0);
+    return dx * dx + dy * dy <= static_cast<int64_t>(distance) * distance;
+}
+
+// Adds the cells touching 'n' found by 'query_box'. 'shift' moves them next to 'n' when they were found
+// across the wrap seam; costs are measured there, and the entry pixel is stored back in raster coordinates.
+void add_cell_neighbors(ASNeighborList neighbors, const cell_node* n, cell_search_context* csc, const box_t& query_box, int shift) {
     std::vector<value_t> result_s;
-    rtree_ptr->query(bgi::intersects(query_box), std::back_inserter(result_s));
+    csc->rtree_ptr->query(bgi::intersects(query_box), std::back_inserter(result_s));
     for (const auto& v : result_s) {
-        auto n2 = xyxy_from_box_t(v.first);
-        ASNeighborListAdd(neighbors, &n2, 1);
+        cell_node n2 = { xyxy_from_box_t(v.first), n->entry };
+        if (n2.rect.xy0.x == n->rect.xy0.x && n2.rect.xy0.y == n->rect.xy0.y) {
+            continue;
+        }
+        if (csc->corridor_ptr && !csc->corridor_ptr->intersects(n2.rect)) {
+            continue;
+        }
+        if (csc->widths && csc->widths->width_nm(n2.rect.xy0) < csc->min_width_nm
+            && !rect_near(n2.rect, csc->goal, csc->approach) && !rect_near(n2.rect, csc->start, csc->approach)) {
+            continue;
+        }
+        if (csc->costs != CM_UNIT) {
+            n2.entry = nearest_entry_pixel(n->rect, shift_rect_x(n2.rect, shift), n->entry);
+            float cost = cell_step_cost(csc, n->entry, n2.entry);
+            n2.entry.x -= shift;
+            if (rect_contains(n2.rect, csc->goal)) {
+                // the goal cell is not expanded, so its last leg is paid on entering it
+                cost += cell_step_cost(csc, n2.entry, csc->goal);
+            }
+            ASNeighborListAdd(neighbors, &n2, cost);
+        } else {
+            ASNeighborListAdd(neighbors, &n2, 1);
+        }
     }
 }
 
+void RTreePathNodeNeighbors(ASNeighborList neighbors, void *node, void *context) {
+    cell_node* n = reinterpret_cast<cell_node*>(node);
+    cell_search_context* csc = reinterpret_cast<cell_search_context*>(context);
+    csc->expanded++;
+    add_cell_neighbors(neighbors, n, csc, box_t_from_xyxy(n->rect), 0);
+    if (csc->wrap_width > 0) {
+        // cells on the opposite map edge (corners included) are neighbors across the wrap seam
+        if (n->rect.xy0.x == 0) {
+            add_cell_neighbors(neighbors, n, csc, box_t(point_t(csc->wrap_width, n->rect.xy0.y), point_t(csc->wrap_width, n->rect.xy1.y)), -csc->wrap_width);
+        }
+        if (n->rect.xy1.x == csc->wrap_width) {
+            add_cell_neighbors(neighbors, n, csc, box_t(point_t(0, n->rect.xy0.y), point_t(0, n->rect.xy1.y)), csc->wrap_width);
+        }
+    }
+}
+
+// Upper bound on the cost between any two pixels of 'r': a vertical leg plus a horizontal one along the row
+// nearest to the equator, which is the widest row under the geodesic model.
+float cell_slack(const cell_search_context* csc, const xy32xy32& r) {
+    const int y = csc->metric ? std::min(std::max(csc->metric->equator_row(), r.xy0.y), r.xy1.y - 1) : r.xy0.y;
+    return cell_step_cost(csc, xy32{ r.xy0.x, y }, xy32{ r.xy1.x - 1, y })
+        + cell_step_cost(csc, r.xy0, xy32{ r.xy0.x, r.xy1.y - 1 });
+}
+
+// A landmark distance D_L(c) is the cost of reaching one pixel of cell c, so every pixel x of c has
+// |d(L, x) - D_L(c)| <= slack(c). For the entry pixel p of cell v and the goal g in cell t the triangle
+// inequality then gives, for every landmark L,
+//   d(p, g) >= |D_L(t) - D_L(v)| - slack(v) - slack(t).
+// Entry pixels are picked greedily, so D_L is the cost of one path rather than the shortest one, and the
+// bound is approximate: it can exceed the true remaining cost when D_L(t) is overestimated. It is combined
+// with the straight-line bound; searches using it may return a different route (a few percent either way)
+// than the plain search, which is why landmark_table use is opt-in.
+float landmark_lower_bound(const cell_search_context* csc, const xy32xy32& rect) {
+    const int id = csc->landmarks->find(rect.xy0);
+    if (id < 0 || !csc->goal_distances) {
+        return 0;
+    }
+    const float* dv = csc->landmarks->distances(id);
+    const float* dt = csc->goal_distances;
+    const float slack = cell_slack(csc, rect) + csc->goal_slack;
+    const float inf = std::numeric_limits<float>::infinity();
+    float bound = 0;
+    for (size_t l = 0; l < csc->landmarks->get_landmark_count(); l++) {
+        if (dv[l] != inf && dt[l] != inf) {
+            bound = std::max(bound, fabsf(dt[l] - dv[l]) - slack);
+        }
+    }
+    return bound;
+}
+
 float RTreePathNodeHeuristic(void *fromNode, void *toNode, void *context) {
-    xy32xy32* from = reinterpret_cast<xy32xy32*>(fromNode);
-    xy32xy32* to = reinterpret_cast<xy32xy32*>(toNode);
-    /*float fromMedX = (from->xy1.x - from->xy0.x) / 2.0f;
-    float fromMedY = (from->xy1.y - from->xy0.y) / 2.0f;
-    float toMedX = (to->xy1.x - to->xy0.x) / 2.0f;
-    float toMedY = (to->xy1.y - to->xy0.y) / 2.0f;
-    return fabsf(fromMedX - toMedX) + fabsf(fromMedY - toMedY);*/
-    return static_cast<float>(abs(from->xy0.x - to->xy0.x) + abs(from->xy0.y - to->xy0.y));
+    cell_node* from = reinterpret_cast<cell_node*>(fromNode);
+    cell_node* to = reinterpret_cast<cell_node*>(toNode);
+    cell_search_context* csc = reinterpret_cast<cell_search_context*>(context);
+    if (csc->costs == CM_GEODESIC) {
+        // great circle to the goal pixel: the edge costs are great-circle legs, so this is consistent too
+        const float h = csc->metric->distance_nm(from->entry, csc->goal);
+        return csc->landmarks ? std::max(h, landmark_lower_bound(csc, from->rect)) : h;
+    } else if (csc->costs == CM_EUCLIDEAN) {
+        // straight line to the goal pixel: admissible and consistent with Euclidean edge costs
+        const float dx = static_cast<float>(wrapped_dx(from->entry.x, csc->goal.x, csc->wrap_width));
+        const float dy = static_cast<float>(from->entry.y - csc->goal.y);
+        const float h = sqrtf(dx * dx + dy * dy);
+        return csc->landmarks ? std::max(h, landmark_lower_bound(csc, from->rect)) : h;
+    }
+    return static_cast<float>(wrapped_dx(from->rect.xy0.x, to->rect.xy0.x, csc->wrap_width) + abs(from->rect.xy0.y - to->rect.xy0.y));
 }
 
 int RTreePathNodeComparator(void *node1, void *node2, void *context) {
-    xy32xy32* n1 = reinterpret_cast<xy32xy32*>(node1);
-    int64_t n1v = static_cast<int64_t>(n1->xy0.y) << 32 | n1->xy0.x;
-    xy32xy32* n2 = reinterpret_cast<xy32xy32*>(node2);
-    int64_t n2v = static_cast<int64_t>(n2->xy0.y) << 32 | n2->xy0.x;
+    cell_node* n1 = reinterpret_cast<cell_node*>(node1);
+    int64_t n1v = static_cast<int64_t>(n1->rect.xy0.y) << 32 | n1->rect.xy0.x;
+    cell_node* n2 = reinterpret_cast<cell_node*>(node2);
+    int64_t n2v = static_cast<int64_t>(n2->rect.xy0.y) << 32 | n2->rect.xy0.x;
     int64_t d = n1v - n2v;
     if (d == 0) {
         return 0;
@@ -69,7 +310,7 @@ float xyib_distance(const xy32ib& a, const xy32ib& b) {
 struct pixel_waypoint_search {
     xy32 from;
     xy32 to;
-    ASPath cell_path;
+    const std::vector<xy32xy32>* cells;
 };
 
 void RTreePixelPathNodeNeighbors(ASNeighborList neighbors, void *node, void *context);
@@ -93,71 +334,6 @@ void AddNeighborWithLog(ASNeighborList neighbors, xy32ib* n, pixel_waypoint_sear
     }
 }
 
-enum RECT_RELATION {
-    RR_DOWN_RIGHT,
-    RR_UP_RIGHT,
-    RR_UP_LEFT,
-    RR_DOWN_LEFT,
-    RR_DOWN,
-    RR_UP,
-    RR_RIGHT,
-    RR_LEFT,
-    RR_UNKNOWN,
-};
-
-
-RECT_RELATION rect_relation(const xy32xy32* n1c, const xy32xy32* n2c) {
-    bool d = false, u = false, r = false, l = false;
-    if (n1c->xy1.y <= n2c->xy0.y) {
-        // [D]OWN
-        //  n1c
-        // -----
-        //  n2c
-        d = true;
-    }
-    if (n2c->xy1.y <= n1c->xy0.y) {
-        // [U]P
-        //  n2c
-        // -----
-        //  n1c
-        u = true;
-    }
-    if (n1c->xy1.x <= n2c->xy0.x) {
-        // [R]IGHT
-        //      |
-        //  n1c | n2c
-        //      |
-        r = true;
-    }
-    if (n2c->xy1.x <= n1c->xy0.x) {
-        // [L]EFT
-        //      |
-        //  n2c | n1c
-        //      |
-        l = true;
-    }
-    if (d && !u && r && !l) {
-        return RR_DOWN_RIGHT;
-    } else if (!d && u && r && !l) {
-        return RR_UP_RIGHT;
-    } else if (!d && u && !r && l) {
-        return RR_UP_LEFT;
-    } else if (d && !u && !r && l) {
-        return RR_DOWN_LEFT;
-    } else if (d && !u && !r && !l) {
-        return RR_DOWN;
-    } else if (!d && u && !r && !l) {
-        return RR_UP;
-    } else if (!d && !u && r && !l) {
-        return RR_RIGHT;
-    } else if (!d && !u && !r && l) {
-        return RR_LEFT;
-    } else {
-        std::cerr << "Unknown rect relation..." << std::endl;
-        return RR_UNKNOWN;
-    }
-}
-
 RECT_RELATION rect_neighbor_relation(const xy32xy32* n1c, const xy32xy32* n2c) {
     bool d = false, u = false, r = false, l = false;
     if (n1c->xy1.y == n2c->xy0.y) {
@@ -213,8 +389,8 @@ RECT_RELATION rect_neighbor_relation(const xy32xy32* n1c, const xy32xy32* n2c) {
 void RTreePixelPathNodeNeighbors(ASNeighborList neighbors, void *node, void *context) {
     xy32ib* n = reinterpret_cast<xy32ib*>(node);
     pixel_waypoint_search* pws = reinterpret_cast<pixel_waypoint_search*>(context);
-    ASPath cell_path = pws->cell_path;
-    size_t cell_path_count = ASPathGetCount(cell_path);
+    const std::vector<xy32xy32>& cells = *pws->cells;
+    size_t cell_path_count = cells.size();
     if (n->p.x == pws->to.x && n->p.y == pws->to.y) {
         // 'n' equals to 'to': reached endpoint (to-pixel)
         // no neighbors on endpoint
@@ -224,20 +400,20 @@ void RTreePixelPathNodeNeighbors(ASNeighborList neighbors, void *node, void *con
         AddNeighborWithLog(neighbors, n, pws, pws->to.x, pws->to.y, cell_path_count - 1, XEE_EXIT);
         return;
     }
-    xy32xy32* n1c;
-    xy32xy32* n2c;
+    const xy32xy32* n1c;
+    const xy32xy32* n2c;
     XYIB_ENTER_EXIT next_ee = XEE_ENTER;
     size_t next_i = 0;
     if (n->ee == XEE_ENTER) {
         // Get exit nodes at the same cell node
-        n1c = reinterpret_cast<xy32xy32*>(ASPathGetNode(cell_path, n->i + 1)); // Next Cell node
-        n2c = reinterpret_cast<xy32xy32*>(ASPathGetNode(cell_path, n->i + 0)); // Cell node containing 'n'
+        n1c = &cells[n->i + 1]; // Next Cell node
+        n2c = &cells[n->i + 0]; // Cell node containing 'n'
         next_ee = XEE_EXIT;
         next_i = n->i; // the same cell node
     } else if (n->ee == XEE_EXIT) {
         // Get enter nodes at the next cell node
-        n1c = reinterpret_cast<xy32xy32*>(ASPathGetNode(cell_path, n->i + 0)); // Cell node containing 'n'
-        n2c = reinterpret_cast<xy32xy32*>(ASPathGetNode(cell_path, n->i + 1)); // Next Cell node
+        n1c = &cells[n->i + 0]; // Cell node containing 'n'
+        n2c = &cells[n->i + 1]; // Next Cell node
         next_ee = XEE_ENTER;
         next_i = n->i + 1; // the next cell node
     } else {
@@ -293,10 +469,11 @@ float RTreePixelPathNodeHeuristic(void *fromNode, void *toNode, void *context) {
 }
 
 int RTreePixelPathNodeComparator(void *node1, void *node2, void *context) {
+    // x can be negative on a cell path unwrapped across the wrap seam
     xy32ib* n1 = reinterpret_cast<xy32ib*>(node1);
-    int64_t n1v = static_cast<int64_t>(n1->p.y) << 32 | n1->p.x;
+    int64_t n1v = static_cast<int64_t>(n1->p.y) << 32 | static_cast<uint32_t>(n1->p.x);
     xy32ib* n2 = reinterpret_cast<xy32ib*>(node2);
-    int64_t n2v = static_cast<int64_t>(n2->p.y) << 32 | n2->p.x;
+    int64_t n2v = static_cast<int64_t>(n2->p.y) << 32 | static_cast<uint32_t>(n2->p.x);
     int64_t d = n1v - n2v;
     if (d == 0) {
         return 0;
@@ -311,11 +488,7 @@ box_t box_t_from_xy(xy32 v) {
     return box_t(point_t(v.x, v.y), point_t(v.x + 1, v.y + 1));
 }
 
-xy32xy32 xyxy_from_xy(xy32 v) {
-    return xy32xy32{ { v.x, v.y },{ v.x + 1, v.y + 1 } };
-}
-
-std::vector<xy32> calculate_pixel_waypoints(xy32 from, xy32 to, ASPath cell_path) {
+std::vector<xy32> calculate_pixel_waypoints(xy32 from, xy32 to, const std::vector<xy32xy32>& cells, bool verbose, int wrap_width) {
     std::vector<xy32> waypoints;
     ASPathNodeSource PathNodeSource =
     {
@@ -325,31 +498,32 @@ std::vector<xy32> calculate_pixel_waypoints(xy32 from, xy32 to, ASPath cell_path
         NULL,
         RTreePixelPathNodeComparator
     };
-    size_t cell_path_count = ASPathGetCount(cell_path);
+    size_t cell_path_count = cells.size();
     if (cell_path_count == 0) {
         std::cerr << "calculate_pixel_waypoints: cell_path_count is 0." << std::endl;
         abort();
     }
     xy32ib from_rect = { from, 0, XEE_ENTER };
     xy32ib to_rect = { to, cell_path_count - 1, XEE_EXIT };
-    pixel_waypoint_search pws = { from, to, cell_path };
+    pixel_waypoint_search pws = { from, to, &cells };
     ASPath pixel_path = ASPathCreate(&PathNodeSource, &pws, &from_rect, &to_rect);
     size_t pixel_path_count = ASPathGetCount(pixel_path);
     if (pixel_path_count > 0) {
         printf("Path Count: %zu\n", pixel_path_count);
         float pixel_path_cost = ASPathGetCost(pixel_path);
         printf("Path Cost: %f\n", pixel_path_cost);
-        /*if (pixel_path_cost < 6000)*/
-        {
-            for (size_t i = 0; i < pixel_path_count; i++) {
-                xy32ib* pixel_node = reinterpret_cast<xy32ib*>(ASPathGetNode(pixel_path, i));
+        for (size_t i = 0; i < pixel_path_count; i++) {
+            xy32ib* pixel_node = reinterpret_cast<xy32ib*>(ASPathGetNode(pixel_path, i));
+            // consecutive pixels crossing the wrap seam are adjacent, so wrapping each one is enough
+            xy32 p = { wrap_width > 0 ? wrap_x(pixel_node->p.x, wrap_width) : pixel_node->p.x, pixel_node->p.y };
+            if (verbose) {
                 printf("Pixel Path %zu: (%d, %d) [Cell index=%zu]\n",
                        i,
-                       pixel_node->p.x,
-                       pixel_node->p.y,
+                       p.x,
+                       p.y,
                        pixel_node->i);
-                waypoints.push_back(pixel_node->p);
             }
+            waypoints.push_back(p);
         }
     } else {
         std::cerr << "No pixel waypoints found." << std::endl;
@@ -358,6 +532,307 @@ std::vector<xy32> calculate_pixel_waypoints(xy32 from, xy32 to, ASPath cell_path
     return waypoints;
 }
 
+// Any-angle waypoints: the shortest polyline between pixel centers that stays inside the cell path,
+// found with the funnel (string pulling) algorithm. Coordinates are doubled so pixel centers are odd
+// integers and all orientation tests are exact.
+struct funnel_point {
+    int64_t x;
+    int64_t y;
+};
+
+struct funnel_portal {
+    funnel_point left;
+    funnel_point right;
+};
+
+static funnel_point funnel_point_from_pixel(int x, int y) {
+    return funnel_point{ 2 * static_cast<int64_t>(x) + 1, 2 * static_cast<int64_t>(y) + 1 };
+}
+
+static bool funnel_point_equal(const funnel_point& a, const funnel_point& b) {
+    return a.x == b.x && a.y == b.y;
+}
+
+// twice the signed area of (a, b, c); positive when c is right of a->b (x right, y up)
+static int64_t funnel_triarea2(const funnel_point& a, const funnel_point& b, const funnel_point& c) {
+    return (c.x - a.x) * (b.y - a.y) - (b.x - a.x) * (c.y - a.y);
+}
+
+// Portal over the pixels (x0, y0)..(x1, y1) of one cell, crossed in direction (dx, dy).
+static funnel_portal make_portal(int x0, int y0, int x1, int y1, int dx, int dy) {
+    funnel_point p = funnel_point_from_pixel(x0, y0);
+    funnel_point q = funnel_point_from_pixel(x1, y1);
+    // q is left of p when it lies counterclockwise of the travel direction
+    if (static_cast<int64_t>(dx) * (q.y - p.y) - static_cast<int64_t>(dy) * (q.x - p.x) > 0) {
+        return funnel_portal{ q, p };
+    }
+    return funnel_portal{ p, q };
+}
+
+// Two portals per cell transition: the pixels of each cell along the shared edge (or the two corner
+// pixels of diagonally touching cells). The space between consecutive portals is always convex.
+static void add_transition_portals(const xy32xy32* n1c, const xy32xy32* n2c, std::vector<funnel_portal>& portals) {
+    const int ox0 = std::max(n1c->xy0.x, n2c->xy0.x);
+    const int ox1 = std::min(n1c->xy1.x, n2c->xy1.x) - 1;
+    const int oy0 = std::max(n1c->xy0.y, n2c->xy0.y);
+    const int oy1 = std::min(n1c->xy1.y, n2c->xy1.y) - 1;
+    switch (rect_neighbor_relation(n1c, n2c)) {
+    case RR_DOWN_RIGHT:
+        portals.push_back(make_portal(n1c->xy1.x - 1, n1c->xy1.y - 1, n1c->xy1.x - 1, n1c->xy1.y - 1, 1, 1));
+        portals.push_back(make_portal(n2c->xy0.x, n2c->xy0.y, n2c->xy0.x, n2c->xy0.y, 1, 1));
+        break;
+    case RR_UP_RIGHT:
+        portals.push_back(make_portal(n1c->xy1.x - 1, n1c->xy0.y, n1c->xy1.x - 1, n1c->xy0.y, 1, -1));
+        portals.push_back(make_portal(n2c->xy0.x, n2c->xy1.y - 1, n2c->xy0.x, n2c->xy1.y - 1, 1, -1));
+        break;
+    case RR_UP_LEFT:
+        portals.push_back(make_portal(n1c->xy0.x, n1c->xy0.y, n1c->xy0.x, n1c->xy0.y, -1, -1));
+        portals.push_back(make_portal(n2c->xy1.x - 1, n2c->xy1.y - 1, n2c->xy1.x - 1, n2c->xy1.y - 1, -1, -1));
+        break;
+    case RR_DOWN_LEFT:
+        portals.push_back(make_portal(n1c->xy0.x, n1c->xy1.y - 1, n1c->xy0.x, n1c->xy1.y - 1, -1, 1));
+        portals.push_back(make_portal(n2c->xy1.x - 1, n2c->xy0.y, n2c->xy1.x - 1, n2c->xy0.y, -1, 1));
+        break;
+    case RR_DOWN:
+        portals.push_back(make_portal(ox0, n1c->xy1.y - 1, ox1, n1c->xy1.y - 1, 0, 1));
+        portals.push_back(make_portal(ox0, n2c->xy0.y, ox1, n2c->xy0.y, 0, 1));
+        break;
+    case RR_UP:
+        portals.push_back(make_portal(ox0, n1c->xy0.y, ox1, n1c->xy0.y, 0, -1));
+        portals.push_back(make_portal(ox0, n2c->xy1.y - 1, ox1, n2c->xy1.y - 1, 0, -1));
+        break;
+    case RR_RIGHT:
+        portals.push_back(make_portal(n1c->xy1.x - 1, oy0, n1c->xy1.x - 1, oy1, 1, 0));
+        portals.push_back(make_portal(n2c->xy0.x, oy0, n2c->xy0.x, oy1, 1, 0));
+        break;
+    case RR_LEFT:
+        portals.push_back(make_portal(n1c->xy0.x, oy0, n1c->xy0.x, oy1, -1, 0));
+        portals.push_back(make_portal(n2c->xy1.x - 1, oy0, n2c->xy1.x - 1, oy1, -1, 0));
+        break;
+    case RR_UNKNOWN:
+    default:
+        std::cerr << "Logic error for finding cell portals..." << std::endl;
+        abort();
+        break;
+    }
+}
+
+// Simple stupid funnel algorithm (Mononen) over the portal list.
+static std::vector<funnel_point> string_pull(const std::vector<funnel_portal>& portals) {
+    std::vector<funnel_point> points;
+    funnel_point apex = portals[0].left;
+    funnel_point portal_left = portals[0].left;
+    funnel_point portal_right = portals[0].right;
+    size_t apex_index = 0, left_index = 0, right_index = 0;
+    points.push_back(apex);
+    for (size_t i = 1; i < portals.size(); i++) {
+        const funnel_point& left = portals[i].left;
+        const funnel_point& right = portals[i].right;
+        // update right vertex
+        if (funnel_triarea2(apex, portal_right, right) <= 0) {
+            if (funnel_point_equal(apex, portal_right) || funnel_triarea2(apex, portal_left, right) > 0) {
+                // tighten the funnel
+                portal_right = right;
+                right_index = i;
+            } else {
+                // right over left: left becomes the new apex, restart from there
+                points.push_back(portal_left);
+                apex = portal_left;
+                apex_index = left_index;
+                portal_left = portal_right = apex;
+                left_index = right_index = apex_index;
+                i = apex_index;
+                continue;
+            }
+        }
+        // update left vertex
+        if (funnel_triarea2(apex, portal_left, left) >= 0) {
+            if (funnel_point_equal(apex, portal_left) || funnel_triarea2(apex, portal_right, left) < 0) {
+                portal_left = left;
+                left_index = i;
+            } else {
+                points.push_back(portal_right);
+                apex = portal_right;
+                apex_index = right_index;
+                portal_left = portal_right = apex;
+                left_index = right_index = apex_index;
+                i = apex_index;
+                continue;
+            }
+        }
+    }
+    const funnel_point& end = portals.back().left;
+    if (!funnel_point_equal(points.back(), end)) {
+        points.push_back(end);
+    }
+    return points;
+}
+
+std::vector<xy32> calculate_any_angle_waypoints(xy32 from, xy32 to, const std::vector<xy32xy32>& cells) {
+    size_t cell_path_count = cells.size();
+    if (cell_path_count == 0) {
+        std::cerr << "calculate_any_angle_waypoints: cell_path_count is 0." << std::endl;
+        abort();
+    }
+    std::vector<funnel_portal> portals;
+    portals.reserve(cell_path_count * 2);
+    const funnel_point start = funnel_point_from_pixel(from.x, from.y);
+    const funnel_point end = funnel_point_from_pixel(to.x, to.y);
+    portals.push_back(funnel_portal{ start, start });
+    for (size_t i = 0; i + 1 < cell_path_count; i++) {
+        add_transition_portals(&cells[i], &cells[i + 1], portals);
+    }
+    portals.push_back(funnel_portal{ end, end });
+
+    std::vector<xy32> waypoints;
+    double length = 0;
+    for (const auto& p : string_pull(portals)) {
+        xy32 w = { static_cast<int>((p.x - 1) / 2), static_cast<int>((p.y - 1) / 2) };
+        if (!waypoints.empty()) {
+            length += sqrt(pow(w.x - waypoints.back().x, 2.0) + pow(w.y - waypoints.back().y, 2.0));
+        }
+        waypoints.push_back(w);
+    }
+    printf("Path Count: %zu\n", waypoints.size());
+    printf("Path Length: %f\n", length);
+    return waypoints;
+}
+
+// Rectangles of the cells along 'cell_path', in path order.
+std::vector<xy32xy32> cell_path_cells(ASPath cell_path) {
+    const size_t cell_path_count = ASPathGetCount(cell_path);
+    std::vector<xy32xy32> cells(cell_path_count);
+    for (size_t i = 0; i < cell_path_count; i++) {
+        cells[i] = *cell_path_rect(cell_path, i);
+    }
+    return cells;
+}
+
+// Cell path rectangles, shifted by multiples of 'wrap_width' where the path crosses the wrap seam
+// so consecutive cells always touch. '*last_shift' receives the shift of the last cell.
+std::vector<xy32xy32> unwrapped_cells(const std::vector<xy32xy32>& path_cells, int wrap_width, int* last_shift) {
+    std::vector<xy32xy32> cells;
+    cells.reserve(path_cells.size());
+    int shift = 0;
+    for (const auto& r : path_cells) {
+        if (!cells.empty() && wrap_width > 0) {
+            const xy32xy32& prev = cells.back();
+            const int candidates[] = { shift, shift - wrap_width, shift + wrap_width };
+            for (int c : candidates) {
+                if (r.xy0.x + c <= prev.xy1.x && prev.xy0.x <= r.xy1.x + c) {
+                    shift = c;
+                    break;
+                }
+            }
+        }
+        cells.push_back(shift_rect_x(r, shift));
+    }
+    *last_shift = shift;
+    return cells;
+}
+
+// Maps unwrapped waypoints back into [0, wrap_width). A segment crossing the seam is split there,
+// ending on one map edge and resuming on the other, so every segment can be drawn as is.
+std::vector<xy32> wrap_waypoints(const std::vector<xy32>& unwrapped, int wrap_width) {
+    std::vector<xy32> waypoints;
+    waypoints.reserve(unwrapped.size());
+    for (size_t i = 0; i < unwrapped.size(); i++) {
+        const xy32& b = unwrapped[i];
+        if (i > 0) {
+            const xy32& a = unwrapped[i - 1];
+            // seams crossed between 'a' and 'b'; pixel columns seam - 1 and seam lie on either side of one
+            const int k0 = floor_div(a.x, wrap_width);
+            const int k1 = floor_div(b.x, wrap_width);
+            const int step = k1 > k0 ? 1 : -1;
+            for (int k = k0; k != k1; k += step) {
+                const int seam = (step > 0 ? k + 1 : k) * wrap_width;
+                const int before = step > 0 ? seam - 1 : seam;
+                const int after = step > 0 ? seam : seam - 1;
+                const int y = a.y + static_cast<int>(static_cast<int64_t>(b.y - a.y) * (seam - a.x) / (b.x - a.x));
+                if (before != a.x) {
+                    waypoints.push_back(xy32{ wrap_x(before, wrap_width), y });
+                }
+                if (after != b.x) {
+                    waypoints.push_back(xy32{ wrap_x(after, wrap_width), y });
+                }
+            }
+        }
+        waypoints.push_back(xy32{ wrap_x(b.x, wrap_width), b.y });
+    }
+    return waypoints;
+}
+
+std::vector<xy32> calculate_waypoints(xy32 from, xy32 to, const std::vector<xy32xy32>& path_cells, bool verbose, waypoint_mode mode, int wrap_width, const geodesic_metric* metric) {
+    int last_shift = 0;
+    const std::vector<xy32xy32> cells = unwrapped_cells(path_cells, wrap_width, &last_shift);
+    const xy32 unwrapped_to = { to.x + last_shift, to.y };
+    std::vector<xy32> waypoints;
+    if (mode == WM_ANY_ANGLE) {
+        waypoints = calculate_any_angle_waypoints(from, unwrapped_to, cells);
+        if (metric) {
+            printf("Route Length: %.1f nm\n", metric->route_length_nm(waypoints));
+        }
+        // a path may cross the seam and come back, ending unshifted
+        if (wrap_width > 0) {
+            waypoints = wrap_waypoints(waypoints, wrap_width);
+        }
+        if (verbose) {
+            for (size_t i = 0; i < waypoints.size(); i++) {
+                printf("Any-angle Path %zu: (%d, %d)\n", i, waypoints[i].x, waypoints[i].y);
+            }
+        }
+    } else {
+        waypoints = calculate_pixel_waypoints(from, unwrapped_to, cells, verbose, wrap_width);
+        if (metric) {
+            printf("Route Length: %.1f nm\n", metric->route_length_nm(waypoints));
+        }
+    }
+    return waypoints;
+}
+
+int astarrtree::raster_width(rtree_t* rtree_ptr, const search_options& options) {
+    if (options.raster_width > 0 || rtree_ptr->size() == 0) {
+        return options.raster_width;
+    }
+    return rtree_ptr->bounds().max_corner().get<0>();
+}
+
+// Landmark table for a search over 'rtree_ptr', or nullptr. A table built for other cells, another cost model or
+// wrap setting would give wrong bounds, so that is treated as a usage error.
+const landmark_table* search_landmarks(rtree_t* rtree_ptr, const search_options& options) {
+    const landmark_table* landmarks = options.landmarks;
+    if (!landmarks) {
+        return nullptr;
+    }
+    if (landmarks->get_cost_model() != options.costs || landmarks->get_wrap() != options.wrap || !landmarks->matches(rtree_ptr)) {
+        std::cerr << "Landmark table does not match the R-tree, cost model or wrap setting of the search" << std::endl;
+        abort();
+    }
+    return landmarks;
+}
+
+const cell_width_table* search_widths(rtree_t* rtree_ptr, const search_options& options) {
+    if (!options.widths || options.min_cell_width_nm <= 0) {
+        return nullptr;
+    }
+    if (options.widths->get_cell_count() != rtree_ptr->size()) {
+        std::cerr << "Cell width table does not match the R-tree of the search" << std::endl;
+        abort();
+    }
+    return options.widths;
+}
+
+// options.approach_nm in pixels of a whole-globe raster 'width' pixels wide (pixel height).
+int approach_pixels(int width, const search_options& options) {
+    const double pixel_nm = 2 * pi / width * earth_radius_nm;
+    return static_cast<int>(ceil(options.approach_nm / pixel_nm));
+}
+
+// The raster width 'width' when its left and right edges are to be treated as adjacent.
+int search_wrap_width(int width, const search_options& options) {
+    return options.wrap ? width : 0;
+}
+
 void astarrtree::astar_rtree(const char* rtree_filename, size_t output_max_size, xy32 from, xy32 to) {
     bi::managed_mapped_file file(bi::open_or_create, rtree_filename, output_max_size);
     allocator_t alloc(file.get_segment_manager());
@@ -365,83 +840,65 @@ void astarrtree::astar_rtree(const char* rtree_filename, size_t output_max_size,
     astar_rtree_memory(rtree_ptr, from, to);
 }
 
+// Clamps 'p' into the cell, which is the cell's nearest pixel to 'p' (cells are [xy0, xy1) in pixels).
+static xy32 clamp_to_cell(const box_t& b, xy32 p) {
+    return xy32{ std::min(std::max(p.x, b.min_corner().get<0>()), b.max_corner().get<0>() - 1),
+                 std::min(std::max(p.y, b.min_corner().get<1>()), b.max_corner().get<1>() - 1) };
+}
+
+bool astarrtree::nearest_cell_pixel(rtree_t* rtree_ptr, xy32 p, xy32& pixel, value_t* cell) {
+    // Windows of growing radius first: intersects queries are far cheaper than bgi::nearest on this tree,
+    // and a cell within 'radius' of 'p' always intersects the window, so the best one found is exact.
+    std::vector<value_t> result_s;
+    for (int radius = 8; radius <= 1024; radius *= 4) {
+        result_s.clear();
+        rtree_ptr->query(bgi::intersects(box_t(point_t(p.x - radius, p.y - radius), point_t(p.x + radius + 1, p.y + radius + 1))),
+                         std::back_inserter(result_s));
+        int64_t best_d2 = std::numeric_limits<int64_t>::max();
+        for (const auto& v : result_s) {
+            const xy32 q = clamp_to_cell(v.first, p);
+            const int64_t d2 = static_cast<int64_t>(q.x - p.x) * (q.x - p.x) + static_cast<int64_t>(q.y - p.y) * (q.y - p.y);
+            if (d2 < best_d2) {
+                best_d2 = d2;
+                pixel = q;
+                if (cell) {
+                    *cell = v;
+                }
+            }
+        }
+        if (best_d2 <= static_cast<int64_t>(radius) * radius) {
+            return true;
+        }
+    }
+    auto nearest_it = rtree_ptr->qbegin(bgi::nearest(box_t_from_xy(p), 1));
+    if (nearest_it == rtree_ptr->qend()) {
+        return false;
+    }
+    pixel = clamp_to_cell(nearest_it->first, p);
+    if (cell) {
+        *cell = *nearest_it;
+    }
+    return true;
+}
+
 bool find_nearest_point_if_empty(rtree_t* rtree_ptr, xy32& from, box_t& from_box, std::vector<value_t>& from_result_s) {
     if (from_result_s.size() == 0) {
-        auto nearest_it = rtree_ptr->qbegin(bgi::nearest(from_box, 1));
-        if (nearest_it == rtree_ptr->qend()) {
+        value_t nearest;
+        if (!nearest_cell_pixel(rtree_ptr, from, from, &nearest)) {
             std::cerr << "Empty result from nearest query..." << std::endl;
             abort();
         }
-        auto nearest_xyxy = xyxy_from_box_t(nearest_it->first);
-        auto from_xyxy = xyxy_from_xy(from);
-        switch (rect_relation(&nearest_xyxy, &from_xyxy)) {
-        case RR_DOWN_RIGHT:
-            from = { nearest_xyxy.xy1.x - 1, nearest_xyxy.xy1.y - 1 };
-            from_box = box_t_from_xy(from);
-            from_result_s.push_back(*nearest_it);
-            break;
-        case RR_UP_RIGHT:
-            from = { nearest_xyxy.xy1.x - 1, nearest_xyxy.xy0.y };
-            from_box = box_t_from_xy(from);
-            from_result_s.push_back(*nearest_it);
-            break;
-        case RR_UP_LEFT:
-            from = { nearest_xyxy.xy0.x, nearest_xyxy.xy0.y };
-            from_box = box_t_from_xy(from);
-            from_result_s.push_back(*nearest_it);
-            break;
-        case RR_DOWN_LEFT:
-            from = { nearest_xyxy.xy0.x, nearest_xyxy.xy1.y - 1 };
-            from_box = box_t_from_xy(from);
-            from_result_s.push_back(*nearest_it);
-            break;
-        case RR_DOWN:
-            from = { from.x, nearest_xyxy.xy1.y - 1 };
-            from_box = box_t_from_xy(from);
-            from_result_s.push_back(*nearest_it);
-            break;
-        case RR_UP:
-            from = { from.x, nearest_xyxy.xy0.y };
-            from_box = box_t_from_xy(from);
-            from_result_s.push_back(*nearest_it);
-            break;
-        case RR_RIGHT:
-            from = { nearest_xyxy.xy1.x - 1, from.y };
-            from_box = box_t_from_xy(from);
-            from_result_s.push_back(*nearest_it);
-            break;
-        case RR_LEFT:
-            from = { nearest_xyxy.xy0.x, from.y };
-            from_box = box_t_from_xy(from);
-            from_result_s.push_back(*nearest_it);
-            break;
-        case RR_UNKNOWN:
-        default:
-            std::cerr << "rect relation unknown..." << std::endl;
-            abort();
-            break;
-        }
+        from_box = box_t_from_xy(from);
+        from_result_s.push_back(nearest);
         return true;
     } else {
         return false;
     }
 }
 
-std::vector<xy32> astarrtree::astar_rtree_memory(rtree_t* rtree_ptr, xy32 from, xy32 to) {
-    float distance = static_cast<float>(abs(from.x - to.x) + abs(from.y - to.y));
-    std::cout << boost::format("Pathfinding from (%1%,%2%) -> (%3%,%4%) [Manhattan distance = %5%]\n")
-        % from.x
-        % from.y
-        % to.x
-        % to.y
-        % distance;
-
-    std::vector<xy32> waypoints;
-    printf("R Tree size: %zu\n", rtree_ptr->size());
-    if (rtree_ptr->size() == 0) {
-        return waypoints;
-    }
-
+// Resolves the cells containing 'from' and 'to', moving a point onto the nearest cell when it is
+// not inside any. Returns false when a point is not covered by exactly one cell.
+bool find_endpoint_cells(rtree_t* rtree_ptr, xy32& from, xy32& to, xy32xy32& from_rect, xy32xy32& to_rect) {
     auto from_box = box_t_from_xy(from);
     std::vector<value_t> from_result_s;
     rtree_ptr->query(bgi::contains(from_box), std::back_inserter(from_result_s));
@@ -461,46 +918,222 @@ std::vector<xy32> astarrtree::astar_rtree_memory(rtree_t* rtree_ptr, xy32 from,
     }
 
     if (from_result_s.size() == 1 && to_result_s.size() == 1) {
-        // Phase 1 - R Tree rectangular node searching
-        ASPathNodeSource PathNodeSource =
-        {
-            sizeof(xy32xy32),
-            RTreePathNodeNeighbors,
-            RTreePathNodeHeuristic,
-            NULL,
-            RTreePathNodeComparator
-        };
-        xy32xy32 from_rect = xyxy_from_box_t(from_result_s[0].first);
-        xy32xy32 to_rect = xyxy_from_box_t(to_result_s[0].first);
-        ASPath path = ASPathCreate(&PathNodeSource, rtree_ptr, &from_rect, &to_rect);
-        size_t pathCount = ASPathGetCount(path);
-        if (pathCount > 0) {
-            printf("Cell Path Count: %zu\n", pathCount);
-            float pathCost = ASPathGetCost(path);
-            printf("Cell Path Cost: %f\n", pathCost);
-            /*if (pathCost < 6000)*/
-            {
-                for (size_t i = 0; i < pathCount; i++) {
-                    xy32xy32* node = reinterpret_cast<xy32xy32*>(ASPathGetNode(path, i));
-                    printf("Cell Path %zu: (%d, %d)-(%d, %d) [%d x %d = %d]\n",
-                           i,
-                           node->xy0.x,
-                           node->xy0.y,
-                           node->xy1.x,
-                           node->xy1.y,
-                           node->xy1.x - node->xy0.x,
-                           node->xy1.y - node->xy0.y,
-                           (node->xy1.x - node->xy0.x) * (node->xy1.y - node->xy0.y));
+        from_rect = xyxy_from_box_t(from_result_s[0].first);
+        to_rect = xyxy_from_box_t(to_result_s[0].first);
+        return true;
+    }
+    return false;
+}
+
+// Phase 1 - R Tree rectangular node searching
+ASPath find_cell_path(cell_search_context& csc, const xy32xy32& from_rect, xy32 from, const xy32xy32& to_rect, xy32 to) {
+    ASPathNodeSource PathNodeSource =
+    {
+        sizeof(cell_node),
+        RTreePathNodeNeighbors,
+        RTreePathNodeHeuristic,
+        NULL,
+        RTreePathNodeComparator
+    };
+    cell_node from_node = { from_rect, from };
+    cell_node to_node = { to_rect, to };
+    csc.goal = to;
+    if (csc.landmarks) {
+        const int goal_id = csc.landmarks->find(to_rect.xy0);
+        csc.goal_distances = goal_id >= 0 ? csc.landmarks->distances(goal_id) : nullptr;
+        csc.goal_slack = cell_slack(&csc, to_rect);
+    }
+    return ASPathCreate(&PathNodeSource, &csc, &from_node, &to_node);
+}
+
+void print_cell_path(const std::vector<xy32xy32>& path_cells) {
+    for (size_t i = 0; i < path_cells.size(); i++) {
+        const xy32xy32* node = &path_cells[i];
+        printf("Cell Path %zu: (%d, %d)-(%d, %d) [%d x %d = %d]\n",
+               i,
+               node->xy0.x,
+               node->xy0.y,
+               node->xy1.x,
+               node->xy1.y,
+               node->xy1.x - node->xy0.x,
+               node->xy1.y - node->xy0.y,
+               (node->xy1.x - node->xy0.x) * (node->xy1.y - node->xy0.y));
+    }
+}
+
+std::vector<xy32> astarrtree::astar_rtree_memory(rtree_t* rtree_ptr, xy32 from, xy32 to, const search_options& options) {
+    float distance = static_cast<float>(abs(from.x - to.x) + abs(from.y - to.y));
+    std::cout << boost::format("Pathfinding from (%1%,%2%) -> (%3%,%4%) [Manhattan distance = %5%]\n")
+        % from.x
+        % from.y
+        % to.x
+        % to.y
+        % distance;
+
+    std::vector<xy32> waypoints;
+    printf("R Tree size: %zu\n", rtree_ptr->size());
+    if (rtree_ptr->size() == 0) {
+        return waypoints;
+    }
+
+    xy32xy32 from_rect, to_rect;
+    if (find_endpoint_cells(rtree_ptr, from, to, from_rect, to_rect)) {
+        const int width = raster_width(rtree_ptr, options);
+        std::unique_ptr<geodesic_metric> metric;
+        if (options.costs == CM_GEODESIC) {
+            metric.reset(new geodesic_metric(width));
+        }
+        const int wrap_width = search_wrap_width(width, options);
+        // a corridor changes the path between the same cells, and a width filter lets narrow cells through near
+        // the endpoint pixels themselves, so both bypass the cache
+        route_cache* cache = options.corridor_ptr || search_widths(rtree_ptr, options) ? nullptr : options.cache;
+        const bool by_pixel = options.costs != CM_UNIT;
+        const route_cache::key cache_key = { from_rect.xy0, to_rect.xy0, by_pixel ? from : xy32{ 0, 0 }, by_pixel ? to : xy32{ 0, 0 },
+                                             options.costs, options.wrap, search_landmarks(rtree_ptr, options) };
+        std::vector<xy32xy32> path_cells;
+        if (cache && cache->find(cache_key, path_cells)) {
+            printf("Cell path cache hit: %zu cells\n", path_cells.size());
+            if (options.expanded) {
+                *options.expanded = 0;
+            }
+        } else {
+            cell_search_context csc = { rtree_ptr, options.corridor_ptr, options.costs, to, wrap_width, metric.get(),
+                                        search_landmarks(rtree_ptr, options), nullptr, 0, 0,
+                                        search_widths(rtree_ptr, options), options.min_cell_width_nm, from, approach_pixels(width, options) };
+            ASPath path = find_cell_path(csc, from_rect, from, to_rect, to);
+            printf("Cells expanded: %zu\n", csc.expanded);
+            if (options.expanded) {
+                *options.expanded = csc.expanded;
+            }
+            if (ASPathGetCount(path) > 0) {
+                printf("Cell Path Cost: %f\n", ASPathGetCost(path));
+                path_cells = cell_path_cells(path);
+                if (cache) {
+                    cache->insert(cache_key, path_cells);
                 }
             }
+            ASPathDestroy(path);
+        }
+        if (!path_cells.empty()) {
+            printf("Cell Path Count: %zu\n", path_cells.size());
+            if (options.verbose) {
+                print_cell_path(path_cells);
+            }
             // Phase 2 - per-pixel node searching
-            waypoints = calculate_pixel_waypoints(from, to, path);
+            waypoints = calculate_waypoints(from, to, path_cells, options.verbose, options.waypoints, wrap_width, metric.get());
         } else {
             std::cerr << "No path found." << std::endl;
         }
-        ASPathDestroy(path);
     } else {
         std::cerr << "From-node and/or to-node error." << std::endl;
     }
     return waypoints;
 }
+
+std::vector<xy32> astarrtree::cell_path_waypoints(rtree_t* rtree_ptr, xy32 from, xy32 to, const std::vector<xy32xy32>& cells, const search_options& options) {
+    if (cells.empty()) {
+        return std::vector<xy32>();
+    }
+    const int width = raster_width(rtree_ptr, options);
+    std::unique_ptr<geodesic_metric> metric;
+    if (options.costs == CM_GEODESIC) {
+        metric.reset(new geodesic_metric(width));
+    }
+    return calculate_waypoints(from, to, cells, options.verbose, options.waypoints, search_wrap_width(width, options), metric.get());
+}
+
+xy32 scale_down(xy32 v, float scale) {
+    return xy32{ static_cast<int>(v.x / scale), static_cast<int>(v.y / scale) };
+}
+
+// Coarse cells mapped onto the next finer level and grown by 'buffer' (in coarse pixels) on every side.
+// With 'wrap_width' set, the part of a box hanging over a map edge is repeated on the opposite edge.
+corridor build_corridor(const std::vector<xy32xy32>& coarse_cells, float ratio, int buffer, int wrap_width) {
+    const int margin = static_cast<int>(ceilf(buffer * ratio));
+    std::vector<xy32xy32> boxes;
+    boxes.reserve(coarse_cells.size());
+    for (const auto& c : coarse_cells) {
+        boxes.push_back(xy32xy32{ { static_cast<int>(floorf(c.xy0.x * ratio)) - margin, static_cast<int>(floorf(c.xy0.y * ratio)) - margin },
+                                  { static_cast<int>(ceilf(c.xy1.x * ratio)) + margin, static_cast<int>(ceilf(c.xy1.y * ratio)) + margin } });
+        if (wrap_width > 0 && boxes.back().xy0.x < 0) {
+            boxes.push_back(shift_rect_x(boxes.back(), wrap_width));
+        } else if (wrap_width > 0 && boxes.back().xy1.x > wrap_width) {
+            boxes.push_back(shift_rect_x(boxes.back(), -wrap_width));
+        }
+    }
+    return corridor::from_boxes(boxes);
+}
+
+std::vector<xy32> astarrtree::astar_rtree_pyramid(const std::vector<pyramid_level>& levels, xy32 from, xy32 to, int corridor_buffer, const search_options& options) {
+    std::vector<xy32> waypoints;
+    std::vector<xy32xy32> coarse_cells;
+    size_t total_expanded = 0;
+    for (size_t l = levels.size(); l-- > 0; ) {
+        const pyramid_level& level = levels[l];
+        if (level.rtree_ptr->size() == 0) {
+            std::cerr << "Empty R-tree at pyramid level " << l << std::endl;
+            break;
+        }
+        xy32 level_from = scale_down(from, level.scale);
+        xy32 level_to = scale_down(to, level.scale);
+        xy32xy32 from_rect, to_rect;
+        if (!find_endpoint_cells(level.rtree_ptr, level_from, level_to, from_rect, to_rect)) {
+            std::cerr << "From-node and/or to-node error at pyramid level " << l << std::endl;
+            if (l == 0) {
+                break;
+            }
+            coarse_cells.clear();
+            continue;
+        }
+        const bool restricted = !coarse_cells.empty();
+        const int width = level.raster_width > 0 ? level.raster_width : level.rtree_ptr->bounds().max_corner().get<0>();
+        const int wrap_width = search_wrap_width(width, options);
+        corridor level_corridor;
+        if (restricted) {
+            level_corridor = build_corridor(coarse_cells, levels[l + 1].scale / level.scale, corridor_buffer, wrap_width);
+        }
+        std::unique_ptr<geodesic_metric> metric;
+        if (options.costs == CM_GEODESIC) {
+            metric.reset(new geodesic_metric(width));
+        }
+        cell_search_context csc = { level.rtree_ptr, restricted ? &level_corridor : nullptr, options.costs, level_to, wrap_width, metric.get(),
+                                    l == 0 ? search_landmarks(level.rtree_ptr, options) : nullptr, nullptr, 0, 0,
+                                    l == 0 ? search_widths(level.rtree_ptr, options) : nullptr, options.min_cell_width_nm,
+                                    level_from, approach_pixels(width, options) };
+        ASPath path = find_cell_path(csc, from_rect, level_from, to_rect, level_to);
+        if (ASPathGetCount(path) == 0 && restricted) {
+            // the coarse raster can close or open narrow straits; fall back to the whole level
+            printf("Pyramid level %zu: no path inside the corridor, searching the whole level\n", l);
+            ASPathDestroy(path);
+            csc.corridor_ptr = nullptr;
+            path = find_cell_path(csc, from_rect, level_from, to_rect, level_to);
+        }
+        total_expanded += csc.expanded;
+        size_t pathCount = ASPathGetCount(path);
+        printf("Pyramid level %zu (scale %.3f): %zu cells expanded, cell path count %zu\n", l, level.scale, csc.expanded, pathCount);
+        if (pathCount == 0) {
+            ASPathDestroy(path);
+            if (l == 0) {
+                std::cerr << "No path found." << std::endl;
+                break;
+            }
+            // a strait closed at this resolution: search the next level without a corridor
+            coarse_cells.clear();
+            continue;
+        }
+        if (l == 0) {
+            const std::vector<xy32xy32> path_cells = cell_path_cells(path);
+            if (options.verbose) {
+                print_cell_path(path_cells);
+            }
+            waypoints = calculate_waypoints(level_from, level_to, path_cells, options.verbose, options.waypoints, wrap_width, metric.get());
+        } else {
+            coarse_cells = cell_path_cells(path);
+        }
+        ASPathDestroy(path);
+    }
+    if (options.expanded) {
+        *options.expanded = total_expanded;
+    }
+    return waypoints;
+}
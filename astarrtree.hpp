@@ -17,6 +17,113 @@ namespace astarrtree {
     typedef bi::allocator<value_t, bi::managed_mapped_file::segment_manager> allocator_t;
     typedef bgi::rtree<value_t, params_t, indexable_t, equal_to_t, allocator_t> rtree_t;
 
+    // One level of a raster pyramid: the max-rect R-tree of a raster, its pixel size in full-resolution pixels
+    // (1 for the finest level, 172824 / 16384 for the 16k water map on the merged grid) and the raster's width
+    // (0: the right edge of the R-tree bounds, see search_options::raster_width).
+    struct pyramid_level {
+        rtree_t* rtree_ptr;
+        float scale;
+        int raster_width;
+    };
+
+    class cell_width_table;
+    class corridor;
+    class landmark_table;
+    class route_cache;
+
+    enum waypoint_mode {
+        WM_PIXEL,       // pixel A* over the cell enter/exit pixels (Manhattan, staircase output)
+        WM_ANY_ANGLE,   // funnel (string pulling) through the cell portals: straight segments only
+    };
+
+    enum cost_model {
+        CM_UNIT,        // every cell step costs 1; Manhattan distance between cell corners as heuristic
+        CM_EUCLIDEAN,   // distance between entry pixels on shared edges; straight line to the goal as heuristic
+        CM_GEODESIC,    // great-circle distance (nautical miles) between entry pixels; great circle to the goal as heuristic
+    };
+
+    const double pi = 3.14159265358979323846;
+    const double earth_radius_nm = 3440.065;
+
+    // Latitude and longitude of raster position (x, y) on a whole-globe 2:1 equirectangular raster of 'width'
+    // pixels; pixel (i, j) covers [i, i + 1) x [j, j + 1), so its center is (i + 0.5, j + 0.5).
+    void pixel_to_lat_lng(float x, float y, int width, float& lat, float& lng);
+    // Pixel of that raster containing (lat, lng), clamped to the raster.
+    xy32 lat_lng_to_pixel(float lat, float lng, int width);
+
+    // Great-circle distances on a whole-globe equirectangular raster: 'width' pixels span 360 degrees of
+    // longitude from the anti-meridian and width / 2 rows span 180 degrees of latitude from the north pole.
+    // cos(latitude) of every row is tabulated once.
+    class geodesic_metric {
+    public:
+        explicit geodesic_metric(int width);
+        // between pixel centers, in nautical miles
+        float distance_nm(xy32 a, xy32 b) const;
+        double route_length_nm(const std::vector<xy32>& waypoints) const;
+        int equator_row() const { return static_cast<int>(cos_by_row.size() / 2); }
+    private:
+        double row_cos(int y) const;
+        double radians_per_pixel;
+        std::vector<double> cos_by_row;
+    };
+
+    // Pixel of 'to' nearest to 'p' among the pixels of 'to' touching 'from' (the shared edge, or the corner pixel
+    // of a diagonal neighbor): where a path standing at 'p' in 'from' enters 'to'.
+    xy32 nearest_entry_pixel(const xy32xy32& from, const xy32xy32& to, xy32 p);
+    // Center pixel of a cell (the upper left of the four middle pixels of an even-sized cell).
+    xy32 cell_center(const xy32xy32& c);
+    // Pixel of the cell nearest to 'p' that is closest to 'p' ('p' itself when a cell contains it); 'cell'
+    // receives that cell when set. Returns false on an empty R-tree.
+    bool nearest_cell_pixel(rtree_t* rtree_ptr, xy32 p, xy32& pixel, value_t* cell = nullptr);
+    // Cost of a straight step between two pixels under 'costs' ('metric' is required for CM_GEODESIC).
+    float step_cost(cost_model costs, const geodesic_metric* metric, xy32 a, xy32 b);
+    // Horizontal distance between columns x0 and x1, the shorter way around when the raster wraps
+    // ('wrap_width' > 0). Straight-line heuristics use it so they stay admissible across the seam.
+    int wrapped_dx(int x0, int x1, int wrap_width);
+
+    struct search_options {
+        search_options() : verbose(true), corridor_ptr(nullptr), waypoints(WM_PIXEL), costs(CM_EUCLIDEAN), wrap(true), landmarks(nullptr), expanded(nullptr),
+                           widths(nullptr), min_cell_width_nm(0), approach_nm(20), cache(nullptr), raster_width(0) {}
+        bool verbose;
+        // cells outside the corridor are never expanded (see corridor.hpp); both endpoints should lie inside it
+        const corridor* corridor_ptr;
+        waypoint_mode waypoints;
+        cost_model costs;
+        // left and right raster edges are adjacent (the world raster wraps at the anti-meridian);
+        // waypoints crossing the seam are split into one point on each edge
+        bool wrap;
+        // approximate ALT bounds (see landmark.hpp), built from the same R-tree cells with the same costs and wrap;
+        // much faster on long routes, but the route may differ from the plain search by a few percent;
+        // used for the full-resolution level only
+        const landmark_table* landmarks;
+        // receives the number of cells expanded when set
+        size_t* expanded;
+        // with a width table (see cellwidth.hpp), cells whose widest passage is narrower than 'min_cell_width_nm'
+        // are not entered, except within 'approach_nm' of either endpoint (ports sit in narrow water);
+        // used for the full-resolution level only
+        const cell_width_table* widths;
+        float min_cell_width_nm;
+        float approach_nm;
+        // cell paths are reused between repeated searches: the same endpoint pixels, or the same endpoint cells
+        // under CM_UNIT (see routecache.hpp); astar_rtree_memory only, and not with a corridor or a width filter
+        route_cache* cache;
+        // width in pixels of the whole-globe raster the cells were cut from: the wrap seam, the geodesic scale and
+        // the approach distance depend on it; 0 takes the right edge of the R-tree bounds, which is only right
+        // when some cell reaches the right raster edge
+        int raster_width;
+    };
+
+    // options.raster_width, or the right edge of the bounds of 'rtree_ptr' when that is 0.
+    int raster_width(rtree_t* rtree_ptr, const search_options& options);
+
     void astar_rtree(const char* output, size_t output_max_size, xy32 from, xy32 to);
-    std::vector<xy32> astar_rtree_memory(rtree_t* rtree_ptr, xy32 from, xy32 to);
+    std::vector<xy32> astar_rtree_memory(rtree_t* rtree_ptr, xy32 from, xy32 to, const search_options& options = search_options());
+    // Waypoints from 'from' (in the first cell) to 'to' (in the last) through a cell path found elsewhere, such as
+    // by dstar_lite; consecutive cells touch, possibly across the wrap seam when 'options.wrap' is set.
+    std::vector<xy32> cell_path_waypoints(rtree_t* rtree_ptr, xy32 from, xy32 to, const std::vector<xy32xy32>& cells, const search_options& options);
+    // Coarse-to-fine search over 'levels' (finest first): each level is solved only inside the cells of the
+    // coarser level's path, grown by 'corridor_buffer' coarse pixels. Returns full-resolution waypoints.
+    // options.corridor_ptr and options.raster_width are not used; the levels build their own corridors and carry
+    // their own raster widths.
+    std::vector<xy32> astar_rtree_pyramid(const std::vector<pyramid_level>& levels, xy32 from, xy32 to, int corridor_buffer, const search_options& options = search_options());
 }
@@ -0,0 +1,161 @@
+#include "precompiled.h"
+#include "bitrow.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BITROW_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BITROW_SSE2 1
+#endif
+
+#if defined(_MSC_VER)
+#define BITROW_BSWAP64(v) _byteswap_uint64(v)
+#else
+#define BITROW_BSWAP64(v) __builtin_bswap64(v)
+#endif
+
+static unsigned long long load_be64(const unsigned char* p) {
+    unsigned long long v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return v;
+#else
+    return BITROW_BSWAP64(v);
+#endif
+}
+
+static void store_be64(unsigned char* p, unsigned long long v) {
+#if !(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    v = BITROW_BSWAP64(v);
+#endif
+    memcpy(p, &v, sizeof(v));
+}
+
+// Writes dst[j] = src[j - 1] << (8 - shift) | src[j] >> shift for j in [begin, end), where every
+// src[j] with j < src_bytes is read and later bytes count as zero. begin is at least 1.
+static void funnel_shift(unsigned char* dst, const unsigned char* src, size_t src_bytes, size_t begin, size_t end, int shift) {
+    size_t j = begin;
+#if defined(BITROW_AVX2)
+    {
+        const __m128i count_right = _mm_cvtsi32_si128(shift);
+        const __m128i count_left = _mm_cvtsi32_si128(8 - shift);
+        const __m256i mask_right = _mm256_set1_epi8((char)(0xff >> shift));
+        const __m256i mask_left = _mm256_set1_epi8((char)((0xff << (8 - shift)) & 0xff));
+        for (; j + 32 <= end && j + 32 <= src_bytes; j += 32) {
+            const __m256i prev = _mm256_loadu_si256((const __m256i*)(src + j - 1));
+            const __m256i cur = _mm256_loadu_si256((const __m256i*)(src + j));
+            // no 8-bit shifts: shift 16-bit lanes and mask off the bits that crossed a byte
+            const __m256i hi = _mm256_and_si256(_mm256_sll_epi16(prev, count_left), mask_left);
+            const __m256i lo = _mm256_and_si256(_mm256_srl_epi16(cur, count_right), mask_right);
+            _mm256_storeu_si256((__m256i*)(dst + j), _mm256_or_si256(hi, lo));
+        }
+    }
+#endif
+#if defined(BITROW_SSE2)
+    {
+        const __m128i count_right = _mm_cvtsi32_si128(shift);
+        const __m128i count_left = _mm_cvtsi32_si128(8 - shift);
+        const __m128i mask_right = _mm_set1_epi8((char)(0xff >> shift));
+        const __m128i mask_left = _mm_set1_epi8((char)((0xff << (8 - shift)) & 0xff));
+        for (; j + 16 <= end && j + 16 <= src_bytes; j += 16) {
+            const __m128i prev = _mm_loadu_si128((const __m128i*)(src + j - 1));
+            const __m128i cur = _mm_loadu_si128((const __m128i*)(src + j));
+            const __m128i hi = _mm_and_si128(_mm_sll_epi16(prev, count_left), mask_left);
+            const __m128i lo = _mm_and_si128(_mm_srl_epi16(cur, count_right), mask_right);
+            _mm_storeu_si128((__m128i*)(dst + j), _mm_or_si128(hi, lo));
+        }
+    }
+#endif
+    // 64-bit words: 8 output bytes from the big-endian words starting at src[j - 1] and src[j]
+    for (; j + 8 <= end && j + 8 <= src_bytes; j += 8) {
+        store_be64(dst + j, load_be64(src + j - 1) << (8 - shift) | load_be64(src + j) >> shift);
+    }
+    for (; j < end; j++) {
+        const unsigned int cur = j < src_bytes ? src[j] : 0;
+        dst[j] = (unsigned char)(src[j - 1] << (8 - shift) | cur >> shift);
+    }
+}
+
+void bitrow_append(unsigned char* dst, size_t dst_x, const unsigned char* src, size_t bit_count) {
+    if (bit_count == 0) {
+        return;
+    }
+    const size_t src_bytes = (bit_count + 7) / 8;
+    const size_t end_x = dst_x + bit_count;
+    const size_t last = (end_x - 1) / 8;
+    const unsigned char last_old = dst[last];
+    const int shift = (int)(dst_x % 8);
+    unsigned char* d = dst + dst_x / 8;
+    if (shift == 0) {
+        memcpy(d, src, src_bytes);
+    } else {
+        d[0] = (unsigned char)((d[0] & (0xff << (8 - shift))) | src[0] >> shift);
+        funnel_shift(d, src, src_bytes, 1, last - dst_x / 8 + 1, shift);
+    }
+    if (end_x % 8) {
+        // restore the pixels after the copied range
+        const unsigned char keep_new = (unsigned char)(0xff << (8 - end_x % 8));
+        dst[last] = (unsigned char)((dst[last] & keep_new) | (last_old & ~keep_new));
+    }
+}
+
+#if defined(BITROW_SSE2) || defined(BITROW_AVX2)
+// movemask puts byte i in bit i; PNG rows want pixel i in bit (7 - i)
+#define BITROW_R2(n) n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#define BITROW_R4(n) BITROW_R2(n), BITROW_R2(n + 2 * 16), BITROW_R2(n + 1 * 16), BITROW_R2(n + 3 * 16)
+#define BITROW_R6(n) BITROW_R4(n), BITROW_R4(n + 2 * 4), BITROW_R4(n + 1 * 4), BITROW_R4(n + 3 * 4)
+static const unsigned char reverse_table[256] = { BITROW_R6(0), BITROW_R6(2), BITROW_R6(1), BITROW_R6(3) };
+#endif
+
+// 0x80 in every zero byte of v, 0 elsewhere (exact, no carries across bytes)
+static unsigned long long zero_byte_mask(unsigned long long v) {
+    const unsigned long long low7 = 0x7f7f7f7f7f7f7f7fULL;
+    return ~(((v & low7) + low7) | v | low7);
+}
+
+void bitrow_pack_zero_bytes(unsigned char* dst, const unsigned char* src, size_t count) {
+    size_t x = 0;
+#if defined(BITROW_AVX2)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        for (; x + 32 <= count; x += 32) {
+            const unsigned int m = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(src + x)), zero));
+            unsigned char* d = dst + x / 8;
+            d[0] = reverse_table[m & 0xff];
+            d[1] = reverse_table[(m >> 8) & 0xff];
+            d[2] = reverse_table[(m >> 16) & 0xff];
+            d[3] = reverse_table[m >> 24];
+        }
+    }
+#endif
+#if defined(BITROW_SSE2)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 16 <= count; x += 16) {
+            const unsigned int m = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(src + x)), zero));
+            dst[x / 8] = reverse_table[m & 0xff];
+            dst[x / 8 + 1] = reverse_table[m >> 8];
+        }
+    }
+#endif
+    for (; x + 8 <= count; x += 8) {
+        unsigned long long v;
+        memcpy(&v, src + x, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = BITROW_BSWAP64(v);
+#endif
+        // gather the per-byte flags (byte i, least significant first) into bit (7 - i)
+        dst[x / 8] = (unsigned char)(((zero_byte_mask(v) >> 7) * 0x8040201008040201ULL) >> 56);
+    }
+    if (x < count) {
+        unsigned char last = 0;
+        for (size_t i = 0; x + i < count; i++) {
+            if (src[x + i] == 0) {
+                last |= (unsigned char)(0x80 >> i);
+            }
+        }
+        dst[x / 8] = last;
+    }
+}
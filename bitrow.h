@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Rows are 1-bit pixels packed MSB-first, as in 1-bit PNG scanlines.
+
+// Copies 'bit_count' pixels from the start of 'src' into 'dst' starting at pixel 'dst_x'.
+// Pixels of 'dst' outside [dst_x, dst_x + bit_count) are preserved. Never reads past
+// the (bit_count + 7) / 8 bytes of 'src'.
+void bitrow_append(unsigned char* dst, size_t dst_x, const unsigned char* src, size_t bit_count);
+
+// Packs one pixel per byte into a bit row: pixel x is set when src[x] is zero (land in the .dat slices).
+// Writes (count + 7) / 8 bytes; the unused low bits of the last byte are cleared.
+void bitrow_pack_zero_bytes(unsigned char* dst, const unsigned char* src, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
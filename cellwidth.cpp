@@ -0,0 +1,197 @@
+#include "precompiled.hpp"
+#include "cellwidth.hpp"
+
+using namespace astarrtree;
+
+static const char cell_width_magic[8] = { 'S', 'R', 'C', 'W', 'T', '\r', '\n', '\0' };
+static const uint32_t cell_width_version = 2;
+
+struct cell_width_header {
+    char magic[8];
+    uint32_t version;
+    float max_width_nm;
+    uint64_t cell_count;
+};
+
+bool cell_width_table::build(rtree_t* rtree_ptr, bool wrap, int width, const char* filename, float max_width_nm) {
+    if (rtree_ptr->size() == 0) {
+        return false;
+    }
+    // rows below the last cell are land, so the raster height is taken from the cells
+    const int height = rtree_ptr->bounds().max_corner().get<1>();
+    if (rtree_ptr->bounds().max_corner().get<0>() > width || height > width / 2) {
+        std::cerr << "Cells of the R-tree reach beyond a whole-globe raster " << width << " pixels wide" << std::endl;
+        return false;
+    }
+    std::vector<xy32xy32> cells;
+    cells.reserve(rtree_ptr->size());
+    for (auto it = rtree_ptr->begin(); it != rtree_ptr->end(); ++it) {
+        const box_t& b = it->first;
+        cells.push_back(xy32xy32{ { b.min_corner().get<0>(), b.min_corner().get<1>() },
+                                  { b.max_corner().get<0>(), b.max_corner().get<1>() } });
+    }
+    std::sort(cells.begin(), cells.end(), xy0_less);
+
+    // step lengths on the whole-globe raster: every pixel is 'v' tall, and its width shrinks with the row's latitude
+    const double radians_per_pixel = 2 * pi / width;
+    const float v = static_cast<float>(radians_per_pixel * earth_radius_nm);
+    std::vector<float> h(height);
+    for (int y = 0; y < height; y++) {
+        h[y] = static_cast<float>(v * cos(pi / 2 - (y + 0.5) * radians_per_pixel));
+    }
+    // Distances to land are only needed up to half of 'max_width_nm', and a path that short never leaves the
+    // rows within 'margin' of where it starts. So the raster is transformed in bands of rows, each with that
+    // margin above and below, and memory is bounded by one band instead of the whole raster.
+    const float max_distance = 0.5f * (max_width_nm + v);
+    const int margin = static_cast<int>(ceil(max_distance / v)) + 1;
+    const int band_rows = std::max(256, 2 * margin);
+    std::vector<float> largest(cells.size(), 0.0f);
+    std::vector<float> d;
+    std::vector<value_t> result_s;
+    for (int b0 = 0; b0 < height; b0 += band_rows) {
+        const int b1 = std::min(height, b0 + band_rows);
+        const int r0 = std::max(0, b0 - margin);
+        const int r1 = std::min(height, b1 + margin);
+        result_s.clear();
+        rtree_ptr->query(bgi::intersects(box_t(point_t(0, r0), point_t(width, r1 - 1))), std::back_inserter(result_s));
+
+        // distance to land: 0 on land, then relaxed from the neighbors already visited in each pass
+        d.assign(static_cast<size_t>(width) * (r1 - r0), 0.0f);
+        for (const auto& c : result_s) {
+            for (int y = std::max(c.first.min_corner().get<1>(), r0); y < std::min(c.first.max_corner().get<1>(), r1); y++) {
+                float* row = &d[static_cast<size_t>(y - r0) * width];
+                std::fill(row + c.first.min_corner().get<0>(), row + c.first.max_corner().get<0>(), std::numeric_limits<float>::infinity());
+            }
+        }
+        auto at = [&](int x, int y) -> float& {
+            return d[static_cast<size_t>(y - r0) * width + x];
+        };
+        auto relax = [&](int x, int y, int nx, int ny, float step) {
+            if (nx < 0 || nx >= width) {
+                if (!wrap) {
+                    return;
+                }
+                nx = (nx + width) % width;
+            }
+            float candidate;
+            if (ny < 0 || ny >= height) {
+                // rows beyond the raster (polar ice, or land below the last water row) count as land
+                candidate = step;
+            } else if (ny < r0 || ny >= r1) {
+                return;
+            } else {
+                candidate = at(nx, ny) + step;
+            }
+            if (candidate < at(x, y)) {
+                at(x, y) = candidate;
+            }
+        };
+        for (int y = r0; y < r1; y++) {
+            const float hd = 0.5f * (h[y] + h[std::max(y - 1, 0)]);
+            const float diag = sqrtf(hd * hd + v * v);
+            for (int x = 0; x < width; x++) {
+                if (at(x, y) == 0) {
+                    continue;
+                }
+                relax(x, y, x - 1, y, h[y]);
+                relax(x, y, x - 1, y - 1, diag);
+                relax(x, y, x, y - 1, v);
+                relax(x, y, x + 1, y - 1, diag);
+            }
+        }
+        for (int y = r1; y-- > r0; ) {
+            const float hd = 0.5f * (h[y] + h[std::min(y + 1, height - 1)]);
+            const float diag = sqrtf(hd * hd + v * v);
+            for (int x = width; x-- > 0; ) {
+                if (at(x, y) == 0) {
+                    continue;
+                }
+                relax(x, y, x + 1, y, h[y]);
+                relax(x, y, x + 1, y + 1, diag);
+                relax(x, y, x, y + 1, v);
+                relax(x, y, x - 1, y + 1, diag);
+            }
+        }
+
+        // the band's own rows of every cell crossing it
+        for (const auto& c : result_s) {
+            const xy32xy32 cell = { { c.first.min_corner().get<0>(), c.first.min_corner().get<1>() },
+                                    { c.first.max_corner().get<0>(), c.first.max_corner().get<1>() } };
+            const size_t i = std::lower_bound(cells.begin(), cells.end(), cell, xy0_less) - cells.begin();
+            for (int y = std::max(cell.xy0.y, b0); y < std::min(cell.xy1.y, b1); y++) {
+                const float* row = &at(0, y);
+                largest[i] = std::max(largest[i], *std::max_element(row + cell.xy0.x, row + cell.xy1.x));
+            }
+        }
+    }
+
+    std::vector<float> widths(cells.size());
+    for (size_t i = 0; i < cells.size(); i++) {
+        // distances are between pixel centers: a channel one pixel wide is one pixel from land on both sides
+        widths[i] = 2 * std::min(largest[i], max_distance) - v;
+    }
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        return false;
+    }
+    cell_width_header header;
+    memcpy(header.magic, cell_width_magic, sizeof(cell_width_magic));
+    header.version = cell_width_version;
+    header.max_width_nm = max_width_nm;
+    header.cell_count = cells.size();
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (size_t i = 0; ok && i < cells.size(); i++) {
+        ok = fwrite(&cells[i].xy0, sizeof(xy32), 1, fp) == 1;
+    }
+    ok = ok && fwrite(&widths[0], sizeof(float), widths.size(), fp) == widths.size();
+    // a full disk may only show up when the buffer is flushed
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Cell width table " << filename << " could not be written" << std::endl;
+        remove(filename);
+        return false;
+    }
+    printf("Cell width table %s: %zu cells, widths up to %.1f nm\n", filename, cells.size(), max_width_nm);
+    return true;
+}
+
+bool cell_width_table::open(const char* filename) {
+    namespace bi = boost::interprocess;
+    try {
+        mapping = bi::file_mapping(filename, bi::read_only);
+        region = bi::mapped_region(mapping, bi::read_only);
+    } catch (const bi::interprocess_exception& e) {
+        std::cerr << "Cell width table " << filename << " could not be opened: " << e.what() << std::endl;
+        return false;
+    }
+    const unsigned char* p = static_cast<const unsigned char*>(region.get_address());
+    const size_t size = region.get_size();
+    cell_width_header header;
+    if (size < sizeof(header)) {
+        std::cerr << "Cell width table " << filename << " is too short" << std::endl;
+        return false;
+    }
+    memcpy(&header, p, sizeof(header));
+    if (memcmp(header.magic, cell_width_magic, sizeof(cell_width_magic)) != 0 || header.version != cell_width_version) {
+        std::cerr << "Cell width table " << filename << " has an unknown format" << std::endl;
+        return false;
+    }
+    if (size < sizeof(header) + header.cell_count * (sizeof(xy32) + sizeof(float))) {
+        std::cerr << "Cell width table " << filename << " is truncated" << std::endl;
+        return false;
+    }
+    cell_count = static_cast<size_t>(header.cell_count);
+    cell_ptr = reinterpret_cast<const xy32*>(p + sizeof(header));
+    width_ptr = reinterpret_cast<const float*>(cell_ptr + cell_count);
+    return true;
+}
+
+float cell_width_table::width_nm(xy32 xy0) const {
+    const xy32* end = cell_ptr + cell_count;
+    const xy32* it = std::lower_bound(cell_ptr, end, xy0, yx_less);
+    if (it == end || it->x != xy0.x || it->y != xy0.y) {
+        return std::numeric_limits<float>::infinity();
+    }
+    return width_ptr[it - cell_ptr];
+}
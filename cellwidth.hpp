@@ -0,0 +1,34 @@
+#pragma once
+
+#include "astarrtree.hpp"
+
+namespace astarrtree {
+    // Passage width of every cell: twice the largest distance from any of its pixels to land, minus a pixel,
+    // in nautical miles on the whole-globe raster. A cell's own extent says little (the max-rect decomposition
+    // leaves thin slivers in open water), so narrow straits are found from the land distance instead.
+    // Widths are resolved up to the table's max_width_nm; wider passages are stored as max_width_nm.
+    //
+    // File layout (native byte order, memory-mapped read-only):
+    //   header : magic "SRCWT\r\n\0" (8), u32 version, f32 max_width_nm, u64 cell_count
+    //   cells  : xy32[cell_count], top-left corner of every cell in (y0, x0) order
+    //   widths : float[cell_count]
+    class cell_width_table {
+    public:
+        // Rasterizes the cells, runs a two-pass chamfer distance transform to land with per-row geodesic
+        // step lengths and writes the table. The transform runs over bands of rows, so memory grows with the
+        // raster width and 'max_width_nm', not with the raster area. 'width' is the width of the whole-globe raster
+        // the cells were cut from (see search_options::raster_width).
+        static bool build(rtree_t* rtree_ptr, bool wrap, int width, const char* filename, float max_width_nm = 64);
+
+        bool open(const char* filename);
+        size_t get_cell_count() const { return cell_count; }
+        // Passage width of the cell whose top-left corner is 'xy0'; infinity for unknown cells.
+        float width_nm(xy32 xy0) const;
+    private:
+        boost::interprocess::file_mapping mapping;
+        boost::interprocess::mapped_region region;
+        size_t cell_count = 0;
+        const xy32* cell_ptr = nullptr;
+        const float* width_ptr = nullptr;
+    };
+}
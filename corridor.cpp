@@ -0,0 +1,156 @@
+#include "precompiled.hpp"
+#include "corridor.hpp"
+
+using namespace astarrtree;
+
+// grid cells along the longer side of the corridor bounds
+static const int grid_resolution = 512;
+
+static xy32xy32 bounds_union(const xy32xy32& a, const xy32xy32& b) {
+    return xy32xy32{ { std::min(a.xy0.x, b.xy0.x), std::min(a.xy0.y, b.xy0.y) },
+                     { std::max(a.xy1.x, b.xy1.x), std::max(a.xy1.y, b.xy1.y) } };
+}
+
+// pixel rectangle [xy0, xy1) as an inclusive box, so boxes sharing only an edge do not intersect
+static box_t inclusive_box(const xy32xy32& r) {
+    return box_t(point_t(r.xy0.x, r.xy0.y), point_t(r.xy1.x - 1, r.xy1.y - 1));
+}
+
+corridor corridor::from_boxes(const std::vector<xy32xy32>& boxes) {
+    corridor c;
+    if (boxes.empty()) {
+        return c;
+    }
+    xy32xy32 bounds = boxes[0];
+    for (const auto& b : boxes) {
+        bounds = bounds_union(bounds, b);
+    }
+    c.reset_grid(bounds);
+    std::vector<box_t> values;
+    values.reserve(boxes.size());
+    for (const auto& b : boxes) {
+        if (b.xy0.x < b.xy1.x && b.xy0.y < b.xy1.y) {
+            values.push_back(inclusive_box(b));
+            c.cover_box(b);
+        }
+    }
+    // packing constructor
+    c.boxes = box_rtree_t(values.begin(), values.end());
+    return c;
+}
+
+corridor corridor::from_polygon(const std::vector<xy32>& ring) {
+    corridor c;
+    if (ring.size() < 3) {
+        return c;
+    }
+    xy32xy32 bounds = { ring[0], { ring[0].x + 1, ring[0].y + 1 } };
+    for (const auto& p : ring) {
+        bg::append(c.polygon.outer(), dpoint_t(p.x, p.y));
+        bounds = bounds_union(bounds, xy32xy32{ p, { p.x + 1, p.y + 1 } });
+    }
+    bg::correct(c.polygon);
+    c.has_polygon = true;
+    c.reset_grid(bounds);
+    c.cover_polygon();
+    return c;
+}
+
+corridor corridor::from_path(const std::vector<xy32>& path, int buffer) {
+    std::vector<xy32xy32> boxes;
+    buffer = std::max(buffer, 0);
+    const int step = std::max(buffer, 1);
+    auto add_square = [&boxes, buffer](int x, int y) {
+        boxes.push_back(xy32xy32{ { x - buffer, y - buffer }, { x + buffer + 1, y + buffer + 1 } });
+    };
+    for (size_t i = 0; i < path.size(); i++) {
+        add_square(path[i].x, path[i].y);
+        if (i + 1 < path.size()) {
+            // consecutive squares at most 'buffer' apart overlap, so the sweep has no gaps
+            const int dx = path[i + 1].x - path[i].x;
+            const int dy = path[i + 1].y - path[i].y;
+            const int samples = (std::max(abs(dx), abs(dy)) + step - 1) / step;
+            for (int s = 1; s < samples; s++) {
+                add_square(path[i].x + static_cast<int>(static_cast<int64_t>(dx) * s / samples),
+                           path[i].y + static_cast<int>(static_cast<int64_t>(dy) * s / samples));
+            }
+        }
+    }
+    return from_boxes(boxes);
+}
+
+void corridor::reset_grid(const xy32xy32& bounds) {
+    const int w = bounds.xy1.x - bounds.xy0.x;
+    const int h = bounds.xy1.y - bounds.xy0.y;
+    grid_origin = bounds.xy0;
+    grid_cell = std::max(1, (std::max(w, h) + grid_resolution - 1) / grid_resolution);
+    grid_width = (w + grid_cell - 1) / grid_cell;
+    grid_height = (h + grid_cell - 1) / grid_cell;
+    grid.assign(static_cast<size_t>(grid_width) * grid_height, GC_OUTSIDE);
+}
+
+void corridor::cover_box(const xy32xy32& box) {
+    const int gx0 = (box.xy0.x - grid_origin.x) / grid_cell;
+    const int gy0 = (box.xy0.y - grid_origin.y) / grid_cell;
+    const int gx1 = (box.xy1.x - 1 - grid_origin.x) / grid_cell;
+    const int gy1 = (box.xy1.y - 1 - grid_origin.y) / grid_cell;
+    for (int gy = gy0; gy <= gy1; gy++) {
+        const int cy0 = grid_origin.y + gy * grid_cell;
+        const bool rows_inside = box.xy0.y <= cy0 && cy0 + grid_cell <= box.xy1.y;
+        for (int gx = gx0; gx <= gx1; gx++) {
+            const int cx0 = grid_origin.x + gx * grid_cell;
+            unsigned char& g = grid[static_cast<size_t>(gy) * grid_width + gx];
+            if (rows_inside && box.xy0.x <= cx0 && cx0 + grid_cell <= box.xy1.x) {
+                g = GC_INSIDE;
+            } else if (g == GC_OUTSIDE) {
+                g = GC_PARTIAL;
+            }
+        }
+    }
+}
+
+void corridor::cover_polygon() {
+    for (int gy = 0; gy < grid_height; gy++) {
+        for (int gx = 0; gx < grid_width; gx++) {
+            const double x0 = grid_origin.x + gx * grid_cell;
+            const double y0 = grid_origin.y + gy * grid_cell;
+            const dbox_t cell(dpoint_t(x0, y0), dpoint_t(x0 + grid_cell, y0 + grid_cell));
+            unsigned char& g = grid[static_cast<size_t>(gy) * grid_width + gx];
+            dpolygon_t cell_polygon;
+            bg::convert(cell, cell_polygon);
+            if (bg::within(cell_polygon, polygon)) {
+                g = GC_INSIDE;
+            } else if (bg::intersects(cell, polygon)) {
+                g = GC_PARTIAL;
+            }
+        }
+    }
+}
+
+bool corridor::exact_intersects(const xy32xy32& cell) const {
+    if (has_polygon) {
+        return bg::intersects(dbox_t(dpoint_t(cell.xy0.x, cell.xy0.y), dpoint_t(cell.xy1.x, cell.xy1.y)), polygon);
+    }
+    return boxes.qbegin(bgi::intersects(inclusive_box(cell))) != boxes.qend();
+}
+
+bool corridor::intersects(const xy32xy32& cell) const {
+    const int gx0 = std::max(0, (cell.xy0.x - grid_origin.x) / grid_cell);
+    const int gy0 = std::max(0, (cell.xy0.y - grid_origin.y) / grid_cell);
+    const int gx1 = std::min(grid_width - 1, (cell.xy1.x - 1 - grid_origin.x) / grid_cell);
+    const int gy1 = std::min(grid_height - 1, (cell.xy1.y - 1 - grid_origin.y) / grid_cell);
+    if (cell.xy1.x <= grid_origin.x || cell.xy1.y <= grid_origin.y || gx0 > gx1 || gy0 > gy1) {
+        return false;
+    }
+    bool partial = false;
+    for (int gy = gy0; gy <= gy1; gy++) {
+        const unsigned char* row = &grid[static_cast<size_t>(gy) * grid_width];
+        for (int gx = gx0; gx <= gx1; gx++) {
+            if (row[gx] == GC_INSIDE) {
+                return true;
+            }
+            partial |= row[gx] == GC_PARTIAL;
+        }
+    }
+    return partial && exact_intersects(cell);
+}
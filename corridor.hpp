@@ -0,0 +1,46 @@
+#pragma once
+
+#include "astarrtree.hpp"
+
+namespace astarrtree {
+    // Region a route search is restricted to: cells not overlapping it are never expanded.
+    // A coarse coverage grid answers most queries; only cells over partially covered grid cells
+    // are tested against the exact boxes or polygon.
+    class corridor {
+    public:
+        // Union of boxes (pixel rectangles, xy1 exclusive).
+        static corridor from_boxes(const std::vector<xy32xy32>& boxes);
+        // Simple polygon given as its outer ring (closing vertex optional, either orientation).
+        static corridor from_polygon(const std::vector<xy32>& ring);
+        // Prior route plus a buffer: squares of 'buffer' pixels on each side swept along the polyline.
+        static corridor from_path(const std::vector<xy32>& path, int buffer);
+
+        bool empty() const { return grid.empty(); }
+        // True when 'cell' shares at least one pixel with the corridor.
+        bool intersects(const xy32xy32& cell) const;
+    private:
+        typedef bgm::point<double, 2, bg::cs::cartesian> dpoint_t;
+        typedef bgm::box<dpoint_t> dbox_t;
+        typedef bgm::polygon<dpoint_t> dpolygon_t;
+        typedef bgi::rtree<box_t, bgi::quadratic<16> > box_rtree_t;
+        enum grid_coverage : unsigned char {
+            GC_OUTSIDE,
+            GC_PARTIAL,
+            GC_INSIDE,
+        };
+
+        void reset_grid(const xy32xy32& bounds);
+        void cover_box(const xy32xy32& box);
+        void cover_polygon();
+        bool exact_intersects(const xy32xy32& cell) const;
+
+        box_rtree_t boxes;
+        dpolygon_t polygon;
+        bool has_polygon = false;
+        xy32 grid_origin = { 0, 0 };
+        int grid_cell = 1;
+        int grid_width = 0;
+        int grid_height = 0;
+        std::vector<unsigned char> grid;
+    };
+}
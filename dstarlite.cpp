@@ -0,0 +1,211 @@
+#include "precompiled.hpp"
+#include "dstarlite.hpp"
+
+using namespace astarrtree;
+
+static const float inf = std::numeric_limits<float>::infinity();
+
+dstar_lite::dstar_lite(const rect_graph& graph, cost_model costs)
+    : graph(graph)
+    , costs(costs)
+    , g(graph.size(), inf)
+    , rhs(graph.size(), inf)
+    , closed(graph.size(), 0)
+    , queued_key(graph.size())
+    , queued(graph.size(), false) {
+    if (costs == CM_GEODESIC) {
+        metric.reset(new geodesic_metric(graph.get_width()));
+    }
+}
+
+float dstar_lite::heuristic(uint32_t from, uint32_t to) const {
+    const xy32 a = cell_center(graph.cell(from));
+    const xy32 b = cell_center(graph.cell(to));
+    if (costs == CM_UNIT) {
+        return 0;
+    }
+    if (costs == CM_GEODESIC) {
+        return metric->distance_nm(a, b);
+    }
+    const float dx = static_cast<float>(wrapped_dx(a.x, b.x, graph.get_wrap() ? graph.get_width() : 0));
+    const float dy = static_cast<float>(a.y - b.y);
+    return sqrtf(dx * dx + dy * dy);
+}
+
+float dstar_lite::edge_cost(uint32_t e, uint32_t from) const {
+    const uint32_t to = graph.edge_target(e);
+    if (closed[from] || closed[to]) {
+        return inf;
+    }
+    xy32 b = cell_center(graph.cell(to));
+    b.x += graph.edge_shift(e);
+    return step_cost(costs, metric.get(), cell_center(graph.cell(from)), b);
+}
+
+dstar_lite::queue_key dstar_lite::calculate_key(uint32_t id) const {
+    const float m = std::min(g[id], rhs[id]);
+    return queue_key(m + heuristic(static_cast<uint32_t>(start_id), id) + km, m);
+}
+
+void dstar_lite::push(uint32_t id) {
+    queued_key[id] = calculate_key(id);
+    queued[id] = true;
+    open.push(queue_item{ queued_key[id], id });
+}
+
+void dstar_lite::update_vertex(uint32_t id) {
+    if (static_cast<int>(id) != goal_id) {
+        float best = inf;
+        for (uint32_t e = graph.edges_begin(id); e < graph.edges_end(id); e++) {
+            best = std::min(best, edge_cost(e, id) + g[graph.edge_target(e)]);
+        }
+        rhs[id] = best;
+    }
+    if (g[id] != rhs[id]) {
+        push(id);
+    } else {
+        queued[id] = false;
+    }
+}
+
+bool dstar_lite::compute_shortest_path() {
+    const uint32_t start = static_cast<uint32_t>(start_id);
+    for (;;) {
+        // drop stale entries: cells removed from the queue or queued again with another key
+        while (!open.empty() && (!queued[open.top().id] || queued_key[open.top().id] != open.top().k)) {
+            open.pop();
+        }
+        if (open.empty() || (!(open.top().k < calculate_key(start)) && rhs[start] == g[start])) {
+            break;
+        }
+        const queue_item top = open.top();
+        open.pop();
+        const uint32_t u = top.id;
+        const queue_key k_new = calculate_key(u);
+        if (top.k < k_new) {
+            push(u);
+            continue;
+        }
+        queued[u] = false;
+        expanded++;
+        if (g[u] > rhs[u]) {
+            g[u] = rhs[u];
+        } else {
+            g[u] = inf;
+            update_vertex(u);
+        }
+        for (uint32_t e = graph.edges_begin(u); e < graph.edges_end(u); e++) {
+            update_vertex(graph.edge_target(e));
+        }
+    }
+    return g[start] != inf;
+}
+
+bool dstar_lite::plan(xy32 start, xy32 goal) {
+    start_id = graph.find_containing(start);
+    goal_id = graph.find_containing(goal);
+    if (start_id < 0 || goal_id < 0) {
+        std::cerr << "dstar_lite: start or goal is not inside exactly one cell" << std::endl;
+        start_id = goal_id = -1;
+        return false;
+    }
+    std::fill(g.begin(), g.end(), inf);
+    std::fill(rhs.begin(), rhs.end(), inf);
+    std::fill(queued.begin(), queued.end(), false);
+    open = decltype(open)();
+    last_id = start_id;
+    km = 0;
+    expanded = 0;
+    rhs[goal_id] = 0;
+    push(static_cast<uint32_t>(goal_id));
+    return compute_shortest_path();
+}
+
+bool dstar_lite::move_to(xy32 position) {
+    const int id = graph.find_containing(position);
+    if (id < 0 || start_id < 0) {
+        return false;
+    }
+    start_id = id;
+    // keys queued so far were computed against the old start; km keeps them lower bounds
+    km += heuristic(static_cast<uint32_t>(last_id), static_cast<uint32_t>(start_id));
+    last_id = start_id;
+    return true;
+}
+
+int dstar_lite::close(const xy32xy32& box) {
+    std::vector<uint32_t> ids;
+    graph.find_overlapping(box, ids);
+    closures.push_back(ids);
+    change_closures(ids, 1);
+    return static_cast<int>(closures.size()) - 1;
+}
+
+void dstar_lite::reopen(int closure_id) {
+    if (closure_id < 0 || closure_id >= static_cast<int>(closures.size())) {
+        return;
+    }
+    std::vector<uint32_t> ids;
+    ids.swap(closures[closure_id]);
+    change_closures(ids, -1);
+}
+
+void dstar_lite::change_closures(const std::vector<uint32_t>& ids, int delta) {
+    std::vector<uint32_t> changed;
+    for (uint32_t id : ids) {
+        const bool was_closed = closed[id] != 0;
+        closed[id] = static_cast<uint16_t>(closed[id] + delta);
+        if (was_closed != (closed[id] != 0)) {
+            changed.push_back(id);
+        }
+    }
+    if (goal_id < 0) {
+        return;
+    }
+    // every edge of a changed cell changed cost: repair both ends
+    for (uint32_t id : changed) {
+        update_vertex(id);
+        for (uint32_t e = graph.edges_begin(id); e < graph.edges_end(id); e++) {
+            update_vertex(graph.edge_target(e));
+        }
+    }
+}
+
+bool dstar_lite::replan() {
+    if (start_id < 0) {
+        return false;
+    }
+    expanded = 0;
+    return compute_shortest_path();
+}
+
+std::vector<xy32xy32> dstar_lite::path() const {
+    std::vector<xy32xy32> cells;
+    if (start_id < 0 || g[start_id] == inf) {
+        return cells;
+    }
+    uint32_t u = static_cast<uint32_t>(start_id);
+    cells.push_back(graph.cell(u));
+    while (static_cast<int>(u) != goal_id && cells.size() <= graph.size()) {
+        float best = inf;
+        uint32_t next = u;
+        for (uint32_t e = graph.edges_begin(u); e < graph.edges_end(u); e++) {
+            const float c = edge_cost(e, u) + g[graph.edge_target(e)];
+            if (c < best) {
+                best = c;
+                next = graph.edge_target(e);
+            }
+        }
+        if (best == inf) {
+            cells.clear();
+            break;
+        }
+        u = next;
+        cells.push_back(graph.cell(u));
+    }
+    return cells;
+}
+
+size_t dstar_lite::get_closed_cell_count() const {
+    return graph.size() - static_cast<size_t>(std::count(closed.begin(), closed.end(), static_cast<uint16_t>(0)));
+}
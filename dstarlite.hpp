@@ -0,0 +1,71 @@
+#pragma once
+
+#include "rectgraph.hpp"
+
+namespace astarrtree {
+    // Incremental replanning over a rect_graph (D* Lite, Koenig & Likhachev, optimized version) with an overlay
+    // of closed boxes (ice, piracy zones, weather). Cells overlapping a closure are impassable as a whole, so a
+    // large open-water cell crossing the edge of a box would block water outside it: split the R-tree at every
+    // box that may be closed (split_rtree, then build the graph) before constructing the planner. After a
+    // closure or reopening only the costs that changed are repaired, and the ship may move along the route
+    // in between. The planner never modifies the R-tree or the graph.
+    //
+    // The search runs backwards from the goal, so 'g' holds costs to the goal. Steps cost the distance between
+    // cell centers under 'costs' (the entry-point costs of the forward search depend on the path taken, which
+    // an incremental search cannot repair locally).
+    class dstar_lite {
+    public:
+        dstar_lite(const rect_graph& graph, cost_model costs);
+
+        // Plans from 'start' to 'goal'. Returns false when either is not inside a cell or no route exists.
+        bool plan(xy32 start, xy32 goal);
+        // The ship is now at 'position'; the route is repaired from there on the next replan().
+        bool move_to(xy32 position);
+        // Returns the id of the closure.
+        int close(const xy32xy32& box);
+        void reopen(int closure_id);
+        // Repairs the route after move_to/close/reopen. Returns false when the goal is cut off.
+        bool replan();
+
+        // Cells from the current start cell to the goal cell, empty when there is no route.
+        std::vector<xy32xy32> path() const;
+        float path_cost() const { return start_id >= 0 ? g[start_id] : std::numeric_limits<float>::infinity(); }
+        // Cells expanded since the last plan() or replan() began.
+        size_t get_expanded() const { return expanded; }
+        size_t get_closed_cell_count() const;
+    private:
+        typedef std::pair<float, float> queue_key;
+        struct queue_item {
+            queue_key k;
+            uint32_t id;
+            bool operator>(const queue_item& o) const { return k > o.k; }
+        };
+
+        float heuristic(uint32_t from, uint32_t to) const;
+        float edge_cost(uint32_t e, uint32_t from) const;
+        queue_key calculate_key(uint32_t id) const;
+        void push(uint32_t id);
+        void update_vertex(uint32_t id);
+        // Marks 'ids' as closed (delta +1) or reopened (-1) and repairs the vertices whose costs changed.
+        void change_closures(const std::vector<uint32_t>& ids, int delta);
+        bool compute_shortest_path();
+
+        const rect_graph& graph;
+        cost_model costs;
+        std::unique_ptr<geodesic_metric> metric;
+        std::vector<float> g;
+        std::vector<float> rhs;
+        // closures overlapping each cell
+        std::vector<uint16_t> closed;
+        // key each cell is queued with; 'queued' is false for cells not in the queue (lazy deletion)
+        std::vector<queue_key> queued_key;
+        std::vector<bool> queued;
+        std::priority_queue<queue_item, std::vector<queue_item>, std::greater<queue_item> > open;
+        std::vector<std::vector<uint32_t> > closures;
+        int start_id = -1;
+        int goal_id = -1;
+        int last_id = -1;
+        float km = 0;
+        size_t expanded = 0;
+    };
+}
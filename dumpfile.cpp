@@ -0,0 +1,345 @@
+#include "precompiled.hpp"
+#include "dumpfile.hpp"
+#include "parallel.hpp"
+#include <zlib.h>
+
+using namespace dumpfile;
+
+static const char dump_magic[8] = { 'S', 'R', 'D', 'U', 'M', 'P', '\r', '\n' };
+static const size_t dump_header_size = 24;
+static const size_t block_header_size = 12;
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    p[0] = static_cast<unsigned char>(v);
+    p[1] = static_cast<unsigned char>(v >> 8);
+    p[2] = static_cast<unsigned char>(v >> 16);
+    p[3] = static_cast<unsigned char>(v >> 24);
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+static void put_u64(unsigned char* p, uint64_t v) {
+    put_u32(p, static_cast<uint32_t>(v));
+    put_u32(p + 4, static_cast<uint32_t>(v >> 32));
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    return static_cast<uint64_t>(get_u32(p)) | static_cast<uint64_t>(get_u32(p + 4)) << 32;
+}
+
+static void put_varint(std::vector<unsigned char>& out, int v) {
+    // zigzag: small negative and positive values both end up as small unsigned values
+    uint32_t u = (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+    while (u >= 0x80) {
+        out.push_back(static_cast<unsigned char>(u | 0x80));
+        u >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(u));
+}
+
+static bool get_varint(const unsigned char*& p, const unsigned char* end, int& v) {
+    uint32_t u = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p >= end) {
+            return false;
+        }
+        const unsigned char b = *p++;
+        u |= static_cast<uint32_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            v = static_cast<int>(u >> 1) ^ -static_cast<int>(u & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool rect_less(const xy32xy32& a, const xy32xy32& b) {
+    if (a.xy0.x != b.xy0.x || a.xy0.y != b.xy0.y) return xy0_less(a, b);
+    return yx_less(a.xy1, b.xy1);
+}
+
+void dumpfile::sort_rects(std::vector<xy32xy32>& rects) {
+    std::sort(rects.begin(), rects.end(), rect_less);
+}
+
+static void encode_block(const xy32xy32* rects, size_t count, std::vector<unsigned char>& out) {
+    out.resize(block_header_size);
+    int prev_x = 0;
+    int prev_y = 0;
+    for (size_t i = 0; i < count; i++) {
+        const xy32xy32& r = rects[i];
+        put_varint(out, r.xy0.y - prev_y);
+        put_varint(out, r.xy0.x - prev_x);
+        put_varint(out, r.xy1.x - r.xy0.x);
+        put_varint(out, r.xy1.y - r.xy0.y);
+        prev_x = r.xy0.x;
+        prev_y = r.xy0.y;
+    }
+    const size_t payload_size = out.size() - block_header_size;
+    put_u32(&out[0], static_cast<uint32_t>(count));
+    put_u32(&out[4], static_cast<uint32_t>(payload_size));
+    put_u32(&out[8], static_cast<uint32_t>(crc32(0, &out[block_header_size], static_cast<uInt>(payload_size))));
+}
+
+static bool decode_block(const unsigned char* block, xy32xy32* out) {
+    const uint32_t count = get_u32(block);
+    const uint32_t payload_size = get_u32(block + 4);
+    const unsigned char* q = block + block_header_size;
+    const unsigned char* end = q + payload_size;
+    if (crc32(0, q, payload_size) != get_u32(block + 8)) {
+        return false;
+    }
+    int prev_x = 0;
+    int prev_y = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        int dy, dx, w, h;
+        if (!get_varint(q, end, dy) || !get_varint(q, end, dx) || !get_varint(q, end, w) || !get_varint(q, end, h)) {
+            return false;
+        }
+        xy32xy32& r = out[i];
+        r.xy0.y = prev_y + dy;
+        r.xy0.x = prev_x + dx;
+        r.xy1.x = r.xy0.x + w;
+        r.xy1.y = r.xy0.y + h;
+        prev_x = r.xy0.x;
+        prev_y = r.xy0.y;
+    }
+    return true;
+}
+
+dump_writer::dump_writer()
+    : fp(nullptr), format(DF_RAW_XY32), rect_count(0) {
+}
+
+dump_writer::~dump_writer() {
+    close();
+}
+
+bool dump_writer::open(const char* filename, dump_format format) {
+    close();
+    fp = fopen(filename, "wb");
+    if (!fp) {
+        return false;
+    }
+    this->format = format;
+    rect_count = 0;
+    if (format == DF_COMPRESSED) {
+        // rect count is patched on close()
+        unsigned char header[dump_header_size];
+        memcpy(header, dump_magic, sizeof(dump_magic));
+        put_u32(header + 8, DUMP_VERSION);
+        put_u32(header + 12, static_cast<uint32_t>(DUMP_BLOCK_RECT_COUNT));
+        put_u64(header + 16, 0);
+        fwrite(header, 1, sizeof(header), fp);
+        pending.reserve(DUMP_CHUNK_RECT_COUNT);
+    }
+    return true;
+}
+
+void dump_writer::write(const xy32xy32* rects, size_t count) {
+    if (!fp) {
+        return;
+    }
+    rect_count += count;
+    if (format == DF_RAW_XY32) {
+        fwrite(rects, sizeof(xy32xy32), count, fp);
+        return;
+    }
+    while (count > 0) {
+        const size_t n = std::min(count, DUMP_CHUNK_RECT_COUNT - pending.size());
+        pending.insert(pending.end(), rects, rects + n);
+        rects += n;
+        count -= n;
+        if (pending.size() == DUMP_CHUNK_RECT_COUNT) {
+            flush_blocks();
+        }
+    }
+}
+
+void dump_writer::flush_blocks() {
+    if (pending.empty()) {
+        return;
+    }
+    const size_t block_count = (pending.size() + DUMP_BLOCK_RECT_COUNT - 1) / DUMP_BLOCK_RECT_COUNT;
+    encoded.resize(block_count);
+    parallel::parallel_for(block_count, [&](size_t b) {
+        const size_t begin = b * DUMP_BLOCK_RECT_COUNT;
+        const size_t count = std::min(DUMP_BLOCK_RECT_COUNT, pending.size() - begin);
+        std::sort(pending.begin() + begin, pending.begin() + begin + count, rect_less);
+        encode_block(&pending[begin], count, encoded[b]);
+    });
+    for (size_t b = 0; b < block_count; b++) {
+        fwrite(&encoded[b][0], 1, encoded[b].size(), fp);
+    }
+    pending.clear();
+}
+
+size_t dump_writer::close() {
+    if (!fp) {
+        return 0;
+    }
+    if (format == DF_COMPRESSED) {
+        flush_blocks();
+        unsigned char count_bytes[8];
+        put_u64(count_bytes, rect_count);
+        fseek(fp, 16, SEEK_SET);
+        fwrite(count_bytes, 1, sizeof(count_bytes), fp);
+    }
+    fclose(fp);
+    fp = nullptr;
+    return rect_count;
+}
+
+bool dumpfile::write_dump(const char* filename, dump_format format, std::vector<xy32xy32>& rects) {
+    dump_writer writer;
+    if (!writer.open(filename, format)) {
+        return false;
+    }
+    if (format == DF_COMPRESSED) {
+        sort_rects(rects);
+    }
+    if (!rects.empty()) {
+        writer.write(&rects[0], rects.size());
+    }
+    writer.close();
+    return true;
+}
+
+dump_view::dump_view()
+    : data(nullptr), rect_count(0), format(DF_RAW_XY32) {
+}
+
+bool dump_view::open(const char* filename, bool legacy_xy16) {
+    namespace bi = boost::interprocess;
+    data = nullptr;
+    rect_count = 0;
+    block_offsets.clear();
+    block_starts.clear();
+    this->filename = filename;
+    boost::system::error_code ec;
+    const auto file_size = boost::filesystem::file_size(filename, ec);
+    if (ec) {
+        return false;
+    }
+    format = legacy_xy16 ? DF_RAW_XY16 : DF_RAW_XY32;
+    if (file_size == 0) {
+        // an empty file cannot be mapped
+        region = bi::mapped_region();
+        return true;
+    }
+    mapping = bi::file_mapping(filename, bi::read_only);
+    region = bi::mapped_region(mapping, bi::read_only);
+    region.advise(bi::mapped_region::advice_sequential);
+    data = static_cast<const unsigned char*>(region.get_address());
+    const size_t size = region.get_size();
+    if (size >= dump_header_size && memcmp(data, dump_magic, sizeof(dump_magic)) == 0) {
+        format = DF_COMPRESSED;
+        index_compressed(data, size, filename);
+        return true;
+    }
+    rect_count = size / (format == DF_RAW_XY16 ? sizeof(xy16xy16) : sizeof(xy32xy32));
+    return true;
+}
+
+void dump_view::index_compressed(const unsigned char* p, size_t size, const char* filename) {
+    const uint32_t version = get_u32(p + 8);
+    if (version != DUMP_VERSION) {
+        std::cerr << "Unsupported dump version " << version << " in " << filename << std::endl;
+        abort();
+    }
+    rect_count = static_cast<size_t>(get_u64(p + 16));
+    // block headers are chained by payload size, so locate every block first; chunks decode them independently
+    size_t offset = dump_header_size;
+    size_t total = 0;
+    while (offset < size) {
+        if (offset + block_header_size > size) {
+            std::cerr << "Truncated block header in " << filename << std::endl;
+            abort();
+        }
+        const size_t count = get_u32(p + offset);
+        const size_t payload_size = get_u32(p + offset + 4);
+        if (payload_size == 0 || offset + block_header_size + payload_size > size) {
+            std::cerr << "Truncated block payload in " << filename << std::endl;
+            abort();
+        }
+        // every rectangle takes at least four varint bytes
+        if (count > payload_size / 4) {
+            std::cerr << "Corrupted block header in " << filename << " (block " << block_offsets.size() << ")" << std::endl;
+            abort();
+        }
+        block_offsets.push_back(offset);
+        block_starts.push_back(total);
+        total += count;
+        offset += block_header_size + payload_size;
+    }
+    if (total != rect_count) {
+        std::cerr << "Dump " << filename << " has " << total << " of " << rect_count << " rectangles" << std::endl;
+        abort();
+    }
+}
+
+size_t dump_view::chunk_count() const {
+    if (format == DF_COMPRESSED) {
+        return (block_offsets.size() + DUMP_CHUNK_BLOCK_COUNT - 1) / DUMP_CHUNK_BLOCK_COUNT;
+    }
+    return (rect_count + DUMP_CHUNK_RECT_COUNT - 1) / DUMP_CHUNK_RECT_COUNT;
+}
+
+rect_span dump_view::chunk(size_t c, std::vector<xy32xy32>& buffer) const {
+    rect_span span;
+    span.ptr = nullptr;
+    span.count = 0;
+    if (format == DF_RAW_XY32) {
+        const size_t begin = c * DUMP_CHUNK_RECT_COUNT;
+        span.ptr = reinterpret_cast<const xy32xy32*>(data) + begin;
+        span.count = std::min(DUMP_CHUNK_RECT_COUNT, rect_count - begin);
+        return span;
+    }
+    if (format == DF_RAW_XY16) {
+        const size_t begin = c * DUMP_CHUNK_RECT_COUNT;
+        const xy16xy16* r16 = reinterpret_cast<const xy16xy16*>(data) + begin;
+        buffer.resize(std::min(DUMP_CHUNK_RECT_COUNT, rect_count - begin));
+        parallel::parallel_for_range(buffer.size(), 65536, [&](size_t b, size_t e) {
+            for (size_t i = b; i < e; i++) {
+                buffer[i].xy0.x = r16[i].xy0.x;
+                buffer[i].xy0.y = r16[i].xy0.y;
+                buffer[i].xy1.x = r16[i].xy1.x;
+                buffer[i].xy1.y = r16[i].xy1.y;
+            }
+        });
+    } else {
+        const size_t first_block = c * DUMP_CHUNK_BLOCK_COUNT;
+        const size_t block_count = std::min(DUMP_CHUNK_BLOCK_COUNT, block_offsets.size() - first_block);
+        const size_t first_rect = block_starts[first_block];
+        const size_t end_rect = first_block + block_count < block_starts.size() ? block_starts[first_block + block_count] : rect_count;
+        buffer.resize(end_rect - first_rect);
+        // workers only flag bad blocks; they are reported after the join
+        std::vector<char> bad(block_count, 0);
+        parallel::parallel_for(block_count, [&](size_t b) {
+            const size_t block = first_block + b;
+            if (!decode_block(data + block_offsets[block], buffer.data() + (block_starts[block] - first_rect))) {
+                bad[b] = 1;
+            }
+        });
+        for (size_t b = 0; b < block_count; b++) {
+            if (bad[b]) {
+                std::cerr << "Block checksum mismatch or corrupted payload in " << filename << " (block " << first_block + b << ")" << std::endl;
+                abort();
+            }
+        }
+    }
+    span.ptr = buffer.data();
+    span.count = buffer.size();
+    return span;
+}
+
+void dump_view::read_all(std::vector<xy32xy32>& out) const {
+    out.reserve(out.size() + rect_count);
+    std::vector<xy32xy32> buffer;
+    for (size_t c = 0; c < chunk_count(); c++) {
+        const rect_span span = chunk(c, buffer);
+        out.insert(out.end(), span.begin(), span.end());
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "xy.hpp"
+
+namespace dumpfile {
+    // Compressed dump layout (all integers little-endian):
+    //   header  : magic "SRDUMP\r\n" (8), u32 version, u32 block_rect_count, u64 rect_count
+    //   blocks  : u32 rect_count, u32 payload_size, u32 crc32(payload), payload
+    //   payload : per rectangle zigzag varints of (y0 - prev y0, x0 - prev x0, width, height)
+    // Rectangles are sorted by (y0, x0) inside each block and deltas restart at every block,
+    // so a block can be decoded (and verified) on its own.
+    // Files without the magic are raw xy32xy32 (or xy16xy16) arrays as written by older builds.
+    // Raw xy32 stays the default output (other tools read it directly); compressed output is opt-in.
+    enum dump_format {
+        DF_RAW_XY16,
+        DF_RAW_XY32,
+        DF_COMPRESSED,
+    };
+
+    const unsigned int DUMP_VERSION = 1;
+    const size_t DUMP_BLOCK_RECT_COUNT = 4096;
+    // Blocks handed to the worker pool at once by dump_writer and dump_view (4 MB of rectangles).
+    const size_t DUMP_CHUNK_BLOCK_COUNT = 64;
+    const size_t DUMP_CHUNK_RECT_COUNT = DUMP_CHUNK_BLOCK_COUNT * DUMP_BLOCK_RECT_COUNT;
+
+    // Read-only, contiguous run of rectangles (a C++11 stand-in for span<const xy32xy32>).
+    struct rect_span {
+        const xy32xy32* ptr;
+        size_t count;
+        const xy32xy32* begin() const { return ptr; }
+        const xy32xy32* end() const { return ptr + count; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        const xy32xy32& operator[](size_t i) const { return ptr[i]; }
+    };
+
+    // Streaming dump writer. Compressed output is buffered one chunk at a time; the chunk's blocks
+    // are sorted and encoded in parallel and written in order, so memory stays bounded by the chunk.
+    class dump_writer {
+    public:
+        dump_writer();
+        ~dump_writer();
+        // Writes DF_COMPRESSED or DF_RAW_XY32 (legacy xy16 dumps are read-only).
+        bool open(const char* filename, dump_format format);
+        void write(const xy32xy32* rects, size_t count);
+        void write(rect_span rects) { write(rects.ptr, rects.count); }
+        void write(const xy32xy32& rect) { write(&rect, 1); }
+        // Flushes the pending blocks, patches the header rect count and returns the number of rectangles written.
+        size_t close();
+    private:
+        void flush_blocks();
+        FILE* fp;
+        dump_format format;
+        size_t rect_count;
+        std::vector<xy32xy32> pending;
+        std::vector<std::vector<unsigned char> > encoded;
+    };
+
+    // Memory-mapped dump file, read chunk by chunk. Raw xy32 chunks point straight into the mapping
+    // (zero copy, mapped with a sequential access hint); compressed blocks and legacy xy16 dumps are
+    // decoded in parallel into a caller-owned buffer of at most DUMP_CHUNK_RECT_COUNT rectangles.
+    class dump_view {
+    public:
+        dump_view();
+        // Detects the compressed format by its magic; anything else is a raw xy32 array
+        // (or a raw xy16 array when legacy_xy16 is set). Compressed block headers are checked here,
+        // payloads (and their checksums) when their chunk is read.
+        bool open(const char* filename, bool legacy_xy16 = false);
+        size_t size() const { return rect_count; }
+        size_t chunk_count() const;
+        // Rectangles of chunk c, valid until 'buffer' is touched again or the view is closed.
+        rect_span chunk(size_t c, std::vector<xy32xy32>& buffer) const;
+        // Appends every rectangle to 'out', for callers that need the whole dump at once.
+        void read_all(std::vector<xy32xy32>& out) const;
+        dump_format get_format() const { return format; }
+    private:
+        void index_compressed(const unsigned char* p, size_t size, const char* filename);
+        boost::interprocess::file_mapping mapping;
+        boost::interprocess::mapped_region region;
+        const unsigned char* data;
+        size_t rect_count;
+        std::vector<size_t> block_offsets;
+        std::vector<size_t> block_starts;
+        std::string filename;
+        dump_format format;
+    };
+
+    // Writes DF_COMPRESSED or DF_RAW_XY32 through dump_writer. Compressed output sorts 'rects'
+    // in place first so deltas stay small across block boundaries. Returns false if the file cannot be opened.
+    bool write_dump(const char* filename, dump_format format, std::vector<xy32xy32>& rects);
+
+    // Orders rectangles by (y0, x0, y1, x1).
+    void sort_rects(std::vector<xy32xy32>& rects);
+}
@@ -0,0 +1,216 @@
+#include "precompiled.hpp"
+#include "landmark.hpp"
+#include "rectgraph.hpp"
+#include "parallel.hpp"
+
+using namespace astarrtree;
+
+static const char landmark_magic[8] = { 'S', 'R', 'A', 'L', 'T', '\r', '\n', '\0' };
+static const uint32_t landmark_version = 2;
+
+struct landmark_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t landmark_count;
+    uint64_t cell_count;
+    uint32_t cost_model;
+    uint32_t wrap;
+};
+
+// Mixes the corners of a cell (splitmix64 finalizer); summed over a cell set it does not depend on the order.
+static uint64_t cell_hash(const xy32xy32& c) {
+    uint64_t h = (static_cast<uint64_t>(static_cast<uint32_t>(c.xy0.x)) << 32 | static_cast<uint32_t>(c.xy0.y))
+        ^ (static_cast<uint64_t>(static_cast<uint32_t>(c.xy1.x)) << 32 | static_cast<uint32_t>(c.xy1.y)) * 0x9e3779b97f4a7c15ull;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+// Reachable cell with the largest finite value in 'd' (ties broken by the lower id), or -1.
+static int farthest_cell(const std::vector<float>& d) {
+    int best = -1;
+    for (size_t i = 0; i < d.size(); i++) {
+        if (d[i] != std::numeric_limits<float>::infinity() && (best < 0 || d[i] > d[best])) {
+            best = static_cast<int>(i);
+        }
+    }
+    return best;
+}
+
+static bool write_table(const rect_graph& graph, cost_model costs, const std::vector<xy32>& landmarks,
+                        const std::vector<float>& table, const char* filename) {
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        return false;
+    }
+    landmark_header header;
+    memcpy(header.magic, landmark_magic, sizeof(landmark_magic));
+    header.version = landmark_version;
+    header.landmark_count = static_cast<uint32_t>(landmarks.size());
+    header.cell_count = graph.size();
+    header.cost_model = costs;
+    header.wrap = graph.get_wrap() ? 1 : 0;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fwrite(&landmarks[0], sizeof(xy32), landmarks.size(), fp) == landmarks.size();
+    for (uint32_t id = 0; ok && id < graph.size(); id++) {
+        ok = fwrite(&graph.cell(id), sizeof(xy32xy32), 1, fp) == 1;
+    }
+    ok = ok && fwrite(&table[0], sizeof(float), table.size(), fp) == table.size();
+    // a full disk may only show up when the buffer is flushed
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Landmark table " << filename << " could not be written" << std::endl;
+        remove(filename);
+        return false;
+    }
+    printf("Landmark table %s: %zu landmarks x %zu cells\n", filename, landmarks.size(), graph.size());
+    return true;
+}
+
+bool landmark_table::build(const rect_graph& graph, cost_model costs, int landmark_count, const char* filename) {
+    if (graph.size() == 0 || landmark_count <= 0) {
+        return false;
+    }
+    // seed: the largest cell is in the main ocean, so the landmarks spread over the connected water
+    uint32_t seed = 0;
+    int64_t seed_area = -1;
+    for (uint32_t id = 0; id < graph.size(); id++) {
+        const xy32xy32& c = graph.cell(id);
+        const int64_t area = static_cast<int64_t>(c.xy1.x - c.xy0.x) * (c.xy1.y - c.xy0.y);
+        if (area > seed_area) {
+            seed_area = area;
+            seed = id;
+        }
+    }
+    std::vector<float> d;
+    graph.one_to_all(cell_center(graph.cell(seed)), costs, d);
+    int next = farthest_cell(d);
+
+    std::vector<xy32> landmarks;
+    std::vector<float> table(graph.size() * static_cast<size_t>(landmark_count));
+    // smallest distance to any landmark so far; the next landmark is the cell maximizing it
+    std::vector<float> nearest(graph.size(), std::numeric_limits<float>::infinity());
+    for (int l = 0; l < landmark_count && next >= 0; l++) {
+        const xy32 landmark = cell_center(graph.cell(next));
+        auto start = std::chrono::steady_clock::now();
+        graph.one_to_all(landmark, costs, d);
+        for (size_t i = 0; i < d.size(); i++) {
+            table[i * landmark_count + l] = d[i];
+            if (d[i] < nearest[i]) {
+                nearest[i] = d[i];
+            }
+        }
+        landmarks.push_back(landmark);
+        printf("Landmark %d: (%d, %d), %.3f s\n", l, landmark.x, landmark.y,
+               std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        next = farthest_cell(nearest);
+        if (next >= 0 && nearest[next] == 0) {
+            break;
+        }
+    }
+    if (static_cast<int>(landmarks.size()) < landmark_count) {
+        // fewer distinct landmarks than asked for: compact the rows
+        for (size_t i = 0; i < graph.size(); i++) {
+            std::copy(&table[i * landmark_count], &table[i * landmark_count] + landmarks.size(), &table[i * landmarks.size()]);
+        }
+        table.resize(graph.size() * landmarks.size());
+    }
+
+    return write_table(graph, costs, landmarks, table, filename);
+}
+
+bool landmark_table::open(const char* filename) {
+    namespace bi = boost::interprocess;
+    try {
+        mapping = bi::file_mapping(filename, bi::read_only);
+        region = bi::mapped_region(mapping, bi::read_only);
+    } catch (const bi::interprocess_exception& e) {
+        std::cerr << "Landmark table " << filename << " could not be opened: " << e.what() << std::endl;
+        return false;
+    }
+    const unsigned char* p = static_cast<const unsigned char*>(region.get_address());
+    const size_t size = region.get_size();
+    landmark_header header;
+    if (size < sizeof(header)) {
+        std::cerr << "Landmark table " << filename << " is too short" << std::endl;
+        return false;
+    }
+    memcpy(&header, p, sizeof(header));
+    if (memcmp(header.magic, landmark_magic, sizeof(landmark_magic)) != 0 || header.version != landmark_version) {
+        std::cerr << "Landmark table " << filename << " has an unknown format" << std::endl;
+        return false;
+    }
+    const size_t expected = sizeof(header) + header.landmark_count * sizeof(xy32)
+        + header.cell_count * sizeof(xy32xy32) + header.cell_count * header.landmark_count * sizeof(float);
+    if (size < expected) {
+        std::cerr << "Landmark table " << filename << " is truncated" << std::endl;
+        return false;
+    }
+    landmark_count = header.landmark_count;
+    cell_count = static_cast<size_t>(header.cell_count);
+    costs = static_cast<cost_model>(header.cost_model);
+    wrap = header.wrap != 0;
+    landmark_ptr = reinterpret_cast<const xy32*>(p + sizeof(header));
+    cell_ptr = reinterpret_cast<const xy32xy32*>(landmark_ptr + landmark_count);
+    distance_ptr = reinterpret_cast<const float*>(cell_ptr + cell_count);
+    cell_checksum = 0;
+    for (size_t i = 0; i < cell_count; i++) {
+        cell_checksum += cell_hash(cell_ptr[i]);
+    }
+    return true;
+}
+
+bool landmark_table::refresh(const rect_graph& graph, const char* filename) const {
+    // a landmark that is now land is dropped rather than moved, so the others keep their meaning
+    std::vector<xy32> landmarks;
+    for (size_t l = 0; l < landmark_count; l++) {
+        if (graph.find_containing(landmark_ptr[l]) >= 0) {
+            landmarks.push_back(landmark_ptr[l]);
+        } else {
+            printf("Landmark (%d, %d) is no longer in a cell; dropped\n", landmark_ptr[l].x, landmark_ptr[l].y);
+        }
+    }
+    if (landmarks.empty()) {
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::vector<float> table(graph.size() * landmarks.size());
+    parallel::parallel_for(landmarks.size(), [&](size_t l) {
+        std::vector<float> d;
+        graph.one_to_all(landmarks[l], costs, d);
+        for (size_t i = 0; i < d.size(); i++) {
+            table[i * landmarks.size() + l] = d[i];
+        }
+    });
+    printf("Landmark distances refreshed: %zu landmarks, %.3f s\n", landmarks.size(),
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    // write next to the mapped file first: this table may be mapped from 'filename'
+    const std::string temp_filename = std::string(filename) + ".tmp";
+    if (!write_table(graph, costs, landmarks, table, temp_filename.c_str())) {
+        return false;
+    }
+    return rename(temp_filename.c_str(), filename) == 0;
+}
+
+bool landmark_table::matches(rtree_t* rtree_ptr) const {
+    if (rtree_ptr->size() != cell_count) {
+        return false;
+    }
+    // checked on every search (the tree may have been patched in place since), so no per-cell lookups
+    uint64_t checksum = 0;
+    for (auto it = rtree_ptr->begin(); it != rtree_ptr->end(); ++it) {
+        checksum += cell_hash(xy32xy32{ { it->first.min_corner().get<0>(), it->first.min_corner().get<1>() },
+                                        { it->first.max_corner().get<0>(), it->first.max_corner().get<1>() } });
+    }
+    return checksum == cell_checksum;
+}
+
+int landmark_table::find(xy32 xy0) const {
+    const xy32xy32* end = cell_ptr + cell_count;
+    const xy32xy32 key = { xy0, xy0 };
+    const xy32xy32* it = std::lower_bound(cell_ptr, end, key, xy0_less);
+    if (it == end || it->xy0.x != xy0.x || it->xy0.y != xy0.y) {
+        return -1;
+    }
+    return static_cast<int>(it - cell_ptr);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "astarrtree.hpp"
+
+namespace astarrtree {
+    class rect_graph;
+
+    // Landmark (ALT) distance table: the one-to-all cost from a few landmark pixels to every cell, so the cell
+    // search can bound the remaining cost with the triangle inequality instead of the straight line alone.
+    // The costs come from one_to_all, which picks entry pixels greedily like the cell search, so they are path
+    // costs rather than exact shortest distances and the bound is approximate (see landmark_lower_bound):
+    // searches with a table expand far fewer cells but may return a route a few percent longer or shorter.
+    //
+    // File layout (native byte order, memory-mapped read-only):
+    //   header    : magic "SRALT\r\n\0" (8), u32 version, u32 landmark_count, u64 cell_count,
+    //               u32 cost_model, u32 wrap
+    //   landmarks : xy32[landmark_count]
+    //   cells     : xy32xy32[cell_count], every cell in (y0, x0) order
+    //   distances : float[cell_count][landmark_count], infinity where a landmark cannot reach the cell
+    class landmark_table {
+    public:
+        // Picks 'landmark_count' landmarks by farthest-point selection (each one the reachable cell farthest
+        // from all landmarks so far, starting from the cell farthest from the largest one) and writes the table.
+        static bool build(const rect_graph& graph, cost_model costs, int landmark_count, const char* filename);
+
+        // Recomputes the distances from this table's landmarks over 'graph' (after a patch_rtree) and writes
+        // the table to 'filename', which may be the file this one is mapped from. A map edit anywhere can
+        // change distances everywhere, so every cell is recomputed; only the landmark selection is skipped.
+        bool refresh(const rect_graph& graph, const char* filename) const;
+
+        bool open(const char* filename);
+        size_t get_landmark_count() const { return landmark_count; }
+        size_t get_cell_count() const { return cell_count; }
+        cost_model get_cost_model() const { return costs; }
+        bool get_wrap() const { return wrap; }
+        // Whether the table was built from the cells of 'rtree_ptr': equal count and equal order-independent
+        // checksum of the cell rectangles. One pass over the tree per call, so a tree patched in place is caught.
+        bool matches(rtree_t* rtree_ptr) const;
+        // Id of the cell whose top-left corner is 'xy0', or -1.
+        int find(xy32 xy0) const;
+        // Distances from every landmark to cell 'id'.
+        const float* distances(int id) const { return distance_ptr + static_cast<size_t>(id) * landmark_count; }
+    private:
+        boost::interprocess::file_mapping mapping;
+        boost::interprocess::mapped_region region;
+        size_t landmark_count = 0;
+        size_t cell_count = 0;
+        cost_model costs = CM_EUCLIDEAN;
+        bool wrap = false;
+        const xy32* landmark_ptr = nullptr;
+        const xy32xy32* cell_ptr = nullptr;
+        const float* distance_ptr = nullptr;
+        // sum of the cell hashes, compared with the tree's by matches()
+        uint64_t cell_checksum = 0;
+    };
+}
@@ -0,0 +1,320 @@
+#include "precompiled.hpp"
+#include "bitrow.h"
+#include "png_parallel.h"
+#include "parallel.hpp"
+
+// Builds the 1-bit water/land slices straight from the MOD44W GeoTIFF tiles
+// (replaces modis/merge.py + png-writer and the intermediate .dat slices).
+//
+// The tiles form a 30 x 12 grid named MOD44W_Water_2000_<lat><lng><lng+1>.tif. Tile rows are stacked
+// from the south ('BA' at the bottom), rows inside a tile are stored north first, and a pixel byte of
+// 0 is land (a set bit in the PNG). Missing tiles are left as water, as merge.py did.
+
+using namespace boost::interprocess;
+
+static void abort_(const char * s, ...) {
+    va_list args;
+    va_start(args, s);
+    vfprintf(stderr, s, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    abort();
+}
+
+struct modis_column {
+    int lng;
+    int width;
+};
+
+struct modis_row {
+    const char* lat;
+    int height;
+};
+
+static const modis_column modis_columns[] = {
+    { 1, 5761 }, { 3, 5761 }, { 5, 5761 }, { 7, 5761 }, { 9, 5760 }, { 11, 5761 }, { 13, 5761 }, { 15, 5761 }, { 17, 5761 }, { 19, 5760 },
+    { 21, 5761 }, { 23, 5761 }, { 25, 5761 }, { 27, 5761 }, { 29, 5760 }, { 31, 5761 }, { 33, 5761 }, { 35, 5761 }, { 37, 5761 }, { 39, 5760 },
+    { 41, 5761 }, { 43, 5761 }, { 45, 5761 }, { 47, 5761 }, { 49, 5760 }, { 51, 5761 }, { 53, 5761 }, { 55, 5761 }, { 57, 5761 }, { 59, 5760 },
+};
+
+// south to north
+static const modis_row modis_rows[] = {
+    { "BA", 7372 }, { "DC", 5121 }, { "FE", 7681 }, { "HG", 7681 }, { "KJ", 7681 }, { "ML", 7681 },
+    { "PN", 7681 }, { "RQ", 7681 }, { "TS", 7681 }, { "VU", 7681 }, { "XW", 9601 }, { "ZY", 2870 },
+};
+
+static const int modis_column_count = sizeof(modis_columns) / sizeof(modis_columns[0]);
+static const int modis_row_count = sizeof(modis_rows) / sizeof(modis_rows[0]);
+
+enum tiff_tag {
+    TIFF_TAG_WIDTH = 256,
+    TIFF_TAG_HEIGHT = 257,
+    TIFF_TAG_BITS_PER_SAMPLE = 258,
+    TIFF_TAG_COMPRESSION = 259,
+    TIFF_TAG_STRIP_OFFSET = 273,
+    TIFF_TAG_SAMPLES_PER_PIXEL = 277,
+    TIFF_TAG_ROWS_PER_STRIP = 278,
+    TIFF_TAG_STRIP_BYTE_COUNT = 279,
+};
+
+enum tiff_type {
+    TIFF_TYPE_SHORT = 3,
+    TIFF_TYPE_LONG = 4,
+};
+
+// Memory-mapped, uncompressed 8-bit strip TIFF. Rows are read in place from the mapping.
+class tiff_strips {
+public:
+    bool open(const char* filename) {
+        try {
+            file = file_mapping(filename, read_only);
+            region = mapped_region(file, read_only);
+        } catch (const interprocess_exception&) {
+            return false;
+        }
+        this->filename = filename;
+        base = static_cast<const unsigned char*>(region.get_address());
+        size = region.get_size();
+        parse();
+        return true;
+    }
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    // Row y counted from the top of the image.
+    const unsigned char* row(int y) const {
+        return strips[y / rows_per_strip] + static_cast<size_t>(y % rows_per_strip) * width;
+    }
+private:
+    unsigned int read_u16(size_t offset) const {
+        check_range(offset, 2);
+        return base[offset] | base[offset + 1] << 8;
+    }
+    unsigned int read_u32(size_t offset) const {
+        check_range(offset, 4);
+        return base[offset] | base[offset + 1] << 8 | base[offset + 2] << 16 | static_cast<unsigned int>(base[offset + 3]) << 24;
+    }
+    void check_range(size_t offset, size_t count) const {
+        if (offset > size || count > size - offset) {
+            abort_("[tiff_strips] %s: offset %zu (+%zu) is past the end of the file", filename.c_str(), offset, count);
+        }
+    }
+    // Values of one IFD entry. Like merge.py, arrays that do not fit the 4-byte value field are read from
+    // the offset it holds; SHORT arrays are also accepted.
+    std::vector<unsigned int> read_values(size_t entry) const {
+        const unsigned int type = read_u16(entry + 2);
+        const unsigned int count = read_u32(entry + 4);
+        if (type != TIFF_TYPE_SHORT && type != TIFF_TYPE_LONG) {
+            abort_("[tiff_strips] %s: tag %u has unsupported type %u", filename.c_str(), read_u16(entry), type);
+        }
+        const size_t value_size = type == TIFF_TYPE_SHORT ? 2 : 4;
+        const size_t values = static_cast<size_t>(count) * value_size <= 4 ? entry + 8 : read_u32(entry + 8);
+        std::vector<unsigned int> ret(count);
+        for (size_t i = 0; i < count; i++) {
+            ret[i] = value_size == 2 ? read_u16(values + i * 2) : read_u32(values + i * 4);
+        }
+        return ret;
+    }
+    void parse() {
+        if (size < 8 || base[0] != 'I' || base[1] != 'I' || read_u16(2) != 42) {
+            abort_("[tiff_strips] %s is not a little-endian TIFF", filename.c_str());
+        }
+        const size_t ifd = read_u32(4);
+        const unsigned int tag_count = read_u16(ifd);
+        std::map<unsigned int, std::vector<unsigned int> > tags;
+        for (unsigned int i = 0; i < tag_count; i++) {
+            const size_t entry = ifd + 2 + i * 12;
+            tags[read_u16(entry)] = read_values(entry);
+        }
+        width = static_cast<int>(single_value(tags, TIFF_TAG_WIDTH, 0));
+        height = static_cast<int>(single_value(tags, TIFF_TAG_HEIGHT, 0));
+        if (width <= 0 || height <= 0) {
+            abort_("[tiff_strips] %s: missing or invalid image size", filename.c_str());
+        }
+        if (single_value(tags, TIFF_TAG_BITS_PER_SAMPLE, 1) != 8
+            || single_value(tags, TIFF_TAG_SAMPLES_PER_PIXEL, 1) != 1
+            || single_value(tags, TIFF_TAG_COMPRESSION, 1) != 1) {
+            abort_("[tiff_strips] %s: only uncompressed 8-bit single-sample images are supported", filename.c_str());
+        }
+        rows_per_strip = static_cast<int>(std::min<unsigned int>(single_value(tags, TIFF_TAG_ROWS_PER_STRIP, height), height));
+        const std::vector<unsigned int>& offsets = tags[TIFF_TAG_STRIP_OFFSET];
+        const std::vector<unsigned int>& byte_counts = tags[TIFF_TAG_STRIP_BYTE_COUNT];
+        if (rows_per_strip <= 0) {
+            abort_("[tiff_strips] %s: invalid rows per strip", filename.c_str());
+        }
+        const size_t strip_count = (height + rows_per_strip - 1) / rows_per_strip;
+        if (offsets.size() != strip_count || byte_counts.size() != strip_count) {
+            abort_("[tiff_strips] %s: expected %zu strips, got %zu offsets and %zu byte counts",
+                   filename.c_str(), strip_count, offsets.size(), byte_counts.size());
+        }
+        strips.resize(strip_count);
+        for (size_t i = 0; i < strip_count; i++) {
+            const size_t rows = std::min<size_t>(rows_per_strip, height - i * rows_per_strip);
+            if (byte_counts[i] != rows * width) {
+                abort_("[tiff_strips] %s: strip %zu has %u bytes, expected %zu", filename.c_str(), i, byte_counts[i], rows * width);
+            }
+            check_range(offsets[i], byte_counts[i]);
+            strips[i] = base + offsets[i];
+        }
+        region.advise(mapped_region::advice_sequential);
+    }
+    unsigned int single_value(const std::map<unsigned int, std::vector<unsigned int> >& tags, unsigned int tag, unsigned int default_value) const {
+        auto it = tags.find(tag);
+        if (it == tags.end()) {
+            return default_value;
+        }
+        if (it->second.empty()) {
+            abort_("[tiff_strips] %s: tag %u has no value", filename.c_str(), tag);
+        }
+        return it->second[0];
+    }
+
+    std::string filename;
+    file_mapping file;
+    mapped_region region;
+    const unsigned char* base = nullptr;
+    size_t size = 0;
+    int width = 0;
+    int height = 0;
+    int rows_per_strip = 0;
+    std::vector<const unsigned char*> strips;
+};
+
+class modis_mosaic {
+public:
+    void open(const std::string& tif_dir) {
+        int x = 0;
+        for (int c = 0; c < modis_column_count; c++) {
+            column_x.push_back(x);
+            x += modis_columns[c].width;
+        }
+        width = x;
+        int south = 0;
+        for (int r = 0; r < modis_row_count; r++) {
+            row_south.push_back(south);
+            south += modis_rows[r].height;
+        }
+        height = south;
+        tiles.resize(modis_row_count * modis_column_count);
+        int missing = 0;
+        for (int r = 0; r < modis_row_count; r++) {
+            for (int c = 0; c < modis_column_count; c++) {
+                const std::string filename = str(boost::format("%1%/MOD44W_Water_2000_%2%%3$02d%4$02d.tif")
+                                                 % tif_dir % modis_rows[r].lat % modis_columns[c].lng % (modis_columns[c].lng + 1));
+                std::unique_ptr<tiff_strips> tile(new tiff_strips());
+                if (!tile->open(filename.c_str())) {
+                    missing++;
+                    continue;
+                }
+                if (tile->get_width() != modis_columns[c].width || tile->get_height() != modis_rows[r].height) {
+                    abort_("[modis_mosaic] %s is %d x %d, expected %d x %d", filename.c_str(),
+                           tile->get_width(), tile->get_height(), modis_columns[c].width, modis_rows[r].height);
+                }
+                tiles[r * modis_column_count + c] = std::move(tile);
+            }
+        }
+        printf("Mosaic %d x %d: %d tiles mapped, %d missing (left as water)\n",
+               width, height, modis_row_count * modis_column_count - missing, missing);
+    }
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    // Fills 'out' with pixels [x0, x0 + count) of mosaic row y (counted from the north), one byte per
+    // pixel as in the tiles; 1 (water) where no tile covers it.
+    void read_row(int y, int x0, int count, unsigned char* out) const {
+        memset(out, 1, count);
+        const int south = height - 1 - y;
+        int r = modis_row_count - 1;
+        while (r > 0 && row_south[r] > south) {
+            r--;
+        }
+        const int tile_y = row_south[r] + modis_rows[r].height - 1 - south;
+        for (int c = 0; c < modis_column_count; c++) {
+            const int begin = std::max(x0, column_x[c]);
+            const int end = std::min(x0 + count, column_x[c] + modis_columns[c].width);
+            const tiff_strips* tile = tiles[r * modis_column_count + c].get();
+            if (begin < end && tile) {
+                memcpy(out + (begin - x0), tile->row(tile_y) + (begin - column_x[c]), end - begin);
+            }
+        }
+    }
+private:
+    int width = 0;
+    int height = 0;
+    std::vector<int> column_x;
+    std::vector<int> row_south;
+    std::vector<std::unique_ptr<tiff_strips> > tiles;
+};
+
+// Slice (wi, hi) covers columns [wi * slice_size, ...) and, like merge.py, rows counted from the
+// south: hi = 0 is the southernmost band. Rows are assembled and packed in parallel one band at a
+// time and fed to the parallel deflate writer in order.
+static void write_slice_png(const modis_mosaic& mosaic, int wi, int hi, int slice_size, const char* output_filename, const PNGPARALLELOPTIONS* png_options) {
+    const int band_rows = 512;
+    const size_t rowbytes = (slice_size + 7) / 8;
+    const int x0 = wi * slice_size;
+    const int y0 = mosaic.get_height() - (hi + 1) * slice_size;
+    png_color palettep[] = { { 255, 255, 255 }, { 0, 0, 0 }, };
+    PNGPARALLEL* writer = png_parallel_open(output_filename, slice_size, slice_size, 1, PNG_COLOR_TYPE_PALETTE, palettep, 2, png_options);
+    std::vector<unsigned char> band(band_rows * rowbytes);
+    for (int band_y = 0; band_y < slice_size; band_y += band_rows) {
+        const int rows = std::min(band_rows, slice_size - band_y);
+        parallel::parallel_for_range(rows, 16, [&](size_t begin, size_t end) {
+            std::vector<unsigned char> pixels(slice_size);
+            for (size_t i = begin; i < end; i++) {
+                mosaic.read_row(y0 + band_y + static_cast<int>(i), x0, slice_size, pixels.data());
+                bitrow_pack_zero_bytes(&band[i * rowbytes], pixels.data(), slice_size);
+            }
+        });
+        for (int i = 0; i < rows; i++) {
+            png_parallel_write_row(writer, &band[i * rowbytes]);
+        }
+    }
+    png_parallel_close(writer);
+}
+
+int main(int argc, char* argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    std::string tif_dir;
+    std::string output_format;
+    int slice_size = 0;
+    PNGPARALLELOPTIONS png_options;
+    png_parallel_default_options(&png_options);
+    desc.add_options()
+        ("help", "produce help message")
+        ("tif", po::value<std::string>(&tif_dir)->default_value("tif"), "directory of MOD44W_Water_2000_*.tif tiles")
+        ("output", po::value<std::string>(&output_format)->default_value("w%d-h%d.png"), "output PNG file name pattern (slice column, slice row)")
+        ("slice", po::value<int>(&slice_size)->default_value(0), "slice size in pixels (0: mosaic height, i.e. 2 x 1 slices)")
+        ("level", po::value<int>(&png_options.level)->default_value(png_options.level), "zlib compression level")
+        ("rows-per-block", po::value<int>(&png_options.rows_per_block)->default_value(png_options.rows_per_block), "rows per deflate block (0: about 1 MB)")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    modis_mosaic mosaic;
+    mosaic.open(tif_dir);
+    if (slice_size == 0) {
+        slice_size = mosaic.get_height();
+    }
+    const int wc = mosaic.get_width() / std::max(slice_size, 1);
+    const int hc = mosaic.get_height() / std::max(slice_size, 1);
+    if (slice_size <= 0 || wc == 0 || hc == 0) {
+        abort_("invalid slice size %d for a %d x %d mosaic", slice_size, mosaic.get_width(), mosaic.get_height());
+    }
+    printf("Slice size %d: %d x %d slices\n", slice_size, wc, hc);
+    auto start = std::chrono::steady_clock::now();
+    for (int hi = 0; hi < hc; hi++) {
+        for (int wi = 0; wi < wc; wi++) {
+            char output_filename[1024];
+            snprintf(output_filename, sizeof(output_filename), output_format.c_str(), wi, hi);
+            printf("Writing %s...\n", output_filename);
+            write_slice_png(mosaic, wi, hi, slice_size, output_filename, &png_options);
+        }
+    }
+    printf("Done in %.1f s\n", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+    inline size_t default_thread_count() {
+        const unsigned int n = std::thread::hardware_concurrency();
+        return n > 0 ? n : 1;
+    }
+
+    // Runs f(i) for every i in [0, count), fork-join style: every call starts thread_count - 1 new threads
+    // (the caller is the last worker) and joins them, so keep calls coarse and run small batches inline.
+    // Work items are handed out one by one, so uneven items (e.g. components of very different sizes)
+    // are balanced automatically. Runs inline when count or thread_count is 1.
+    template<typename F>
+    void parallel_for(size_t count, F f, size_t thread_count = 0) {
+        if (thread_count == 0) {
+            thread_count = default_thread_count();
+        }
+        if (thread_count > count) {
+            thread_count = count;
+        }
+        if (thread_count <= 1) {
+            for (size_t i = 0; i < count; i++) {
+                f(i);
+            }
+            return;
+        }
+        std::atomic<size_t> next(0);
+        auto worker = [&]() {
+            for (size_t i = next++; i < count; i = next++) {
+                f(i);
+            }
+        };
+        std::vector<std::thread> threads;
+        threads.reserve(thread_count - 1);
+        for (size_t t = 0; t < thread_count - 1; t++) {
+            threads.push_back(std::thread(worker));
+        }
+        worker();
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    // Splits [0, count) into contiguous chunks (at least min_chunk elements each) and runs f(begin, end) per chunk.
+    template<typename F>
+    void parallel_for_range(size_t count, size_t min_chunk, F f, size_t thread_count = 0) {
+        if (thread_count == 0) {
+            thread_count = default_thread_count();
+        }
+        if (min_chunk == 0) {
+            min_chunk = 1;
+        }
+        size_t chunk_count = (count + min_chunk - 1) / min_chunk;
+        if (chunk_count > thread_count * 4) {
+            chunk_count = thread_count * 4;
+        }
+        if (chunk_count <= 1) {
+            if (count > 0) {
+                f(static_cast<size_t>(0), count);
+            }
+            return;
+        }
+        const size_t chunk = (count + chunk_count - 1) / chunk_count;
+        parallel_for(chunk_count, [&](size_t c) {
+            const size_t begin = c * chunk;
+            const size_t end = begin + chunk < count ? begin + chunk : count;
+            if (begin < end) {
+                f(begin, end);
+            }
+        }, thread_count);
+    }
+}
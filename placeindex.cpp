@@ -0,0 +1,213 @@
+#include "precompiled.hpp"
+#include "placeindex.hpp"
+#include "parallel.hpp"
+
+using namespace placeindex;
+
+using astarrtree::pi;
+using astarrtree::earth_radius_nm;
+
+static std::vector<char> read_file(const char* filename) {
+    std::vector<char> data;
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) {
+        std::cerr << "Place file " << filename << " could not be opened" << std::endl;
+        return data;
+    }
+    fseek(fp, 0, SEEK_END);
+    data.resize(static_cast<size_t>(ftell(fp)));
+    fseek(fp, 0, SEEK_SET);
+    if (!data.empty() && fread(&data[0], 1, data.size(), fp) != data.size()) {
+        data.clear();
+    }
+    fclose(fp);
+    return data;
+}
+
+// NUL-padded fixed-width field
+static std::string fixed_string(const char* p, size_t size) {
+    return std::string(p, std::find(p, p + size, '\0'));
+}
+
+static std::string lower(std::string s) {
+    boost::algorithm::to_lower(s);
+    return s;
+}
+
+std::vector<place> placeindex::load_seaports(const char* filename) {
+    const size_t record_size = 96; // 80s 8s f f
+    std::vector<char> data = read_file(filename);
+    std::vector<place> places;
+    places.reserve(data.size() / record_size);
+    for (size_t offset = 0; offset + record_size <= data.size(); offset += record_size) {
+        const char* r = &data[offset];
+        place p;
+        p.name = fixed_string(r, 80);
+        p.code = fixed_string(r + 80, 8);
+        memcpy(&p.lat, r + 88, sizeof(float));
+        memcpy(&p.lng, r + 92, sizeof(float));
+        p.population = 0;
+        places.push_back(p);
+    }
+    return places;
+}
+
+std::vector<place> placeindex::load_cities(const char* filename) {
+    const size_t record_size = 80; // 64s 4s i f f
+    std::vector<char> data = read_file(filename);
+    std::vector<place> places;
+    places.reserve(data.size() / record_size);
+    for (size_t offset = 0; offset + record_size <= data.size(); offset += record_size) {
+        const char* r = &data[offset];
+        place p;
+        p.name = fixed_string(r, 64);
+        p.code = fixed_string(r + 64, 4);
+        memcpy(&p.population, r + 68, sizeof(int));
+        memcpy(&p.lng, r + 72, sizeof(float));
+        memcpy(&p.lat, r + 76, sizeof(float));
+        places.push_back(p);
+    }
+    return places;
+}
+
+static void unit_vector(float lat, float lng, float* v) {
+    const double phi = lat * pi / 180;
+    const double lambda = lng * pi / 180;
+    v[0] = static_cast<float>(cos(phi) * cos(lambda));
+    v[1] = static_cast<float>(cos(phi) * sin(lambda));
+    v[2] = static_cast<float>(sin(phi));
+}
+
+kdtree::kdtree(const std::vector<place>& places) {
+    nodes.resize(places.size());
+    for (size_t i = 0; i < places.size(); i++) {
+        unit_vector(places[i].lat, places[i].lng, nodes[i].p);
+        nodes[i].index = static_cast<int>(i);
+    }
+    build(0, nodes.size(), 0);
+}
+
+void kdtree::build(size_t begin, size_t end, int axis) {
+    if (end - begin <= 1) {
+        return;
+    }
+    const size_t mid = begin + (end - begin) / 2;
+    std::nth_element(nodes.begin() + begin, nodes.begin() + mid, nodes.begin() + end, [axis](const node& a, const node& b) {
+        return a.p[axis] < b.p[axis];
+    });
+    build(begin, mid, (axis + 1) % 3);
+    build(mid + 1, end, (axis + 1) % 3);
+}
+
+void kdtree::search(size_t begin, size_t end, int axis, const float* q, int& best, float& best_d2) const {
+    if (begin >= end) {
+        return;
+    }
+    const size_t mid = begin + (end - begin) / 2;
+    const node& n = nodes[mid];
+    const float dx = n.p[0] - q[0], dy = n.p[1] - q[1], dz = n.p[2] - q[2];
+    const float d2 = dx * dx + dy * dy + dz * dz;
+    if (d2 < best_d2) {
+        best_d2 = d2;
+        best = n.index;
+    }
+    const float split = q[axis] - n.p[axis];
+    const int next_axis = (axis + 1) % 3;
+    // near side first; the far side only when the splitting plane is closer than the best so far
+    if (split < 0) {
+        search(begin, mid, next_axis, q, best, best_d2);
+        if (split * split < best_d2) {
+            search(mid + 1, end, next_axis, q, best, best_d2);
+        }
+    } else {
+        search(mid + 1, end, next_axis, q, best, best_d2);
+        if (split * split < best_d2) {
+            search(begin, mid, next_axis, q, best, best_d2);
+        }
+    }
+}
+
+int kdtree::nearest(float lat, float lng, float* distance_nm) const {
+    float q[3];
+    unit_vector(lat, lng, q);
+    int best = -1;
+    float best_d2 = std::numeric_limits<float>::infinity();
+    search(0, nodes.size(), 0, q, best, best_d2);
+    if (distance_nm && best >= 0) {
+        *distance_nm = static_cast<float>(2 * earth_radius_nm * asin(std::min(1.0, sqrt(static_cast<double>(best_d2)) / 2)));
+    }
+    return best;
+}
+
+snapper::snapper(const std::vector<place>& ports, const std::vector<place>& cities, astarrtree::rtree_t* rtree_ptr, int width)
+    : ports(ports)
+    , cities(cities)
+    , rtree_ptr(rtree_ptr)
+    , width(width)
+    , port_tree(ports) {
+    // ports are fixed, so each one is snapped to water once here and a query is a k-d tree lookup
+    port_water.resize(ports.size());
+    parallel::parallel_for_range(ports.size(), 256, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            port_water[i].valid = astarrtree::nearest_cell_pixel(rtree_ptr, to_pixel(ports[i].lat, ports[i].lng), port_water[i].pixel);
+        }
+    });
+    for (size_t i = 0; i < ports.size(); i++) {
+        port_by_key.insert(std::make_pair(lower(ports[i].code), static_cast<int>(i)));
+        port_by_key.insert(std::make_pair(lower(ports[i].name), static_cast<int>(i)));
+    }
+    for (size_t i = 0; i < cities.size(); i++) {
+        auto inserted = city_by_name.insert(std::make_pair(lower(cities[i].name), static_cast<int>(i)));
+        if (!inserted.second && cities[inserted.first->second].population < cities[i].population) {
+            inserted.first->second = static_cast<int>(i);
+        }
+    }
+}
+
+xy32 snapper::to_pixel(float lat, float lng) const {
+    return astarrtree::lat_lng_to_pixel(lat, lng, width);
+}
+
+snap_result snapper::snap(float lat, float lng) const {
+    snap_result result = { -1, 0, { 0, 0 } };
+    result.port = port_tree.nearest(lat, lng, &result.port_distance_nm);
+    if (result.port >= 0) {
+        if (port_water[result.port].valid) {
+            result.water = port_water[result.port].pixel;
+        } else {
+            result.port = -1;
+        }
+    }
+    return result;
+}
+
+std::vector<snap_result> snapper::snap_batch(const std::vector<std::pair<float, float> >& points) const {
+    std::vector<snap_result> results(points.size());
+    // queries are read-only, so chunks run concurrently
+    parallel::parallel_for_range(points.size(), 1024, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            results[i] = snap(points[i].first, points[i].second);
+        }
+    });
+    return results;
+}
+
+bool snapper::resolve(const std::string& query, float& lat, float& lng) const {
+    if (sscanf(query.c_str(), "%f,%f", &lat, &lng) == 2) {
+        return true;
+    }
+    const std::string key = lower(query);
+    auto port_it = port_by_key.find(key);
+    if (port_it != port_by_key.end()) {
+        lat = ports[port_it->second].lat;
+        lng = ports[port_it->second].lng;
+        return true;
+    }
+    auto city_it = city_by_name.find(key);
+    if (city_it != city_by_name.end()) {
+        lat = cities[city_it->second].lat;
+        lng = cities[city_it->second].lng;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "astarrtree.hpp"
+
+namespace placeindex {
+    // A named point: a port from seaports.dat or a city from cities10k.dat (see crawler/).
+    struct place {
+        std::string name;
+        std::string code;   // UN/LOCODE for ports, ISO country code for cities
+        float lat;
+        float lng;
+        int population;     // cities only
+    };
+
+    // struct '80s8sff' records: ASCII name, LOCODE, latitude, longitude (crawler/locode/parse.py).
+    std::vector<place> load_seaports(const char* filename);
+    // struct '64s4siff' records: ASCII name, country code, population, longitude, latitude (crawler/cities/city10k.py).
+    std::vector<place> load_cities(const char* filename);
+
+    // Static k-d tree over places as points on the unit sphere. Chord length orders like great-circle
+    // distance, so nearest queries need no special case at the anti-meridian or near the poles.
+    class kdtree {
+    public:
+        explicit kdtree(const std::vector<place>& places);
+        // Index of the nearest place, or -1 when there are none; 'distance_nm' receives the great-circle distance.
+        int nearest(float lat, float lng, float* distance_nm = nullptr) const;
+    private:
+        struct node {
+            float p[3];
+            int index;
+        };
+        void build(size_t begin, size_t end, int axis);
+        void search(size_t begin, size_t end, int axis, const float* q, int& best, float& best_d2) const;
+        // implicit balanced tree: the node splitting [begin, end) sits at the middle, axes cycle x, y, z
+        std::vector<node> nodes;
+    };
+
+    struct snap_result {
+        int port;               // index into the port list, -1 when unresolved
+        float port_distance_nm; // from the query point to the port
+        xy32 water;             // water pixel nearest to the port
+    };
+
+    // Resolves endpoints for route queries: point -> nearest port -> nearest water pixel of a whole-globe
+    // 2:1 equirectangular water raster (x from the anti-meridian, y from the north pole) 'width' pixels wide.
+    class snapper {
+    public:
+        snapper(const std::vector<place>& ports, const std::vector<place>& cities, astarrtree::rtree_t* rtree_ptr, int width);
+        snap_result snap(float lat, float lng) const;
+        // Snaps every point (latitude, longitude) in parallel.
+        std::vector<snap_result> snap_batch(const std::vector<std::pair<float, float> >& points) const;
+        // "lat,lng", a LOCODE, a port name or a city name (the most populous city of that name);
+        // case-insensitive. Returns false for unknown names.
+        bool resolve(const std::string& query, float& lat, float& lng) const;
+        xy32 to_pixel(float lat, float lng) const;
+        const place& port(int index) const { return ports[index]; }
+    private:
+        const std::vector<place>& ports;
+        const std::vector<place>& cities;
+        astarrtree::rtree_t* rtree_ptr;
+        int width;
+        kdtree port_tree;
+        struct water_pixel {
+            xy32 pixel;
+            bool valid;
+        };
+        std::vector<water_pixel> port_water;
+        std::unordered_map<std::string, int> port_by_key;
+        std::unordered_map<std::string, int> city_by_name;
+    };
+}
@@ -0,0 +1,270 @@
+#include "precompiled.h"
+#include "png_parallel.h"
+#include <zlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define PNGPARALLEL_WINDOW_SIZE 32768
+#define PNGPARALLEL_MAX_CHUNK (1 << 30)
+
+typedef struct _PNGBLOCK {
+    unsigned char* out;
+    size_t out_size;
+    uLong adler;
+} PNGBLOCK;
+
+struct _PNGPARALLEL {
+    FILE* fp;
+    int width, height;
+    size_t row_size;        // filter byte + rowbytes
+    int rows_per_block;
+    int thread_count;
+    int level;
+    int rows_written;
+    int rows_buffered;
+    int header_written;
+    uLong adler;
+    // history (the last 32 KB of earlier batches, used as deflate dictionary) directly followed by the batch rows
+    unsigned char* buffer;
+    size_t history_size;
+    unsigned char* batch;
+    PNGBLOCK* blocks;
+};
+
+static void abort_(const char * s, ...) {
+    va_list args;
+    va_start(args, s);
+    vfprintf(stderr, s, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    abort();
+}
+
+static void put_u32_be(unsigned char* p, unsigned long v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+// Writes one chunk whose data is prefix + data + suffix (any part may be empty).
+static void write_chunk(FILE* fp, const char* type, const unsigned char* prefix, size_t prefix_size,
+                        const unsigned char* data, size_t size, const unsigned char* suffix, size_t suffix_size) {
+    unsigned char header[8];
+    unsigned char crc_bytes[4];
+    uLong crc = crc32(0L, Z_NULL, 0);
+    put_u32_be(header, (unsigned long)(prefix_size + size + suffix_size));
+    memcpy(header + 4, type, 4);
+    crc = crc32(crc, header + 4, 4);
+    if (prefix_size) crc = crc32(crc, prefix, (uInt)prefix_size);
+    if (size) crc = crc32(crc, data, (uInt)size);
+    if (suffix_size) crc = crc32(crc, suffix, (uInt)suffix_size);
+    put_u32_be(crc_bytes, crc);
+    if (fwrite(header, 1, 8, fp) != 8
+        || (prefix_size && fwrite(prefix, 1, prefix_size, fp) != prefix_size)
+        || (size && fwrite(data, 1, size, fp) != size)
+        || (suffix_size && fwrite(suffix, 1, suffix_size, fp) != suffix_size)
+        || fwrite(crc_bytes, 1, 4, fp) != 4)
+        abort_("[png_parallel] Error during writing %.4s chunk", type);
+}
+
+static int channels_of(int color_type) {
+    switch (color_type) {
+    case PNG_COLOR_TYPE_GRAY: return 1;
+    case PNG_COLOR_TYPE_PALETTE: return 1;
+    case PNG_COLOR_TYPE_GRAY_ALPHA: return 2;
+    case PNG_COLOR_TYPE_RGB: return 3;
+    case PNG_COLOR_TYPE_RGB_ALPHA: return 4;
+    }
+    abort_("[png_parallel] Unsupported color type %d", color_type);
+    return 0;
+}
+
+void png_parallel_default_options(PNGPARALLELOPTIONS* options) {
+    options->level = Z_DEFAULT_COMPRESSION;
+    options->rows_per_block = 0;
+    options->thread_count = 0;
+}
+
+PNGPARALLEL* png_parallel_open(const char* filename, int width, int height, int bit_depth, int color_type,
+                               png_const_colorp palette, int num_palette, const PNGPARALLELOPTIONS* options) {
+    PNGPARALLELOPTIONS defaults;
+    if (!options) {
+        png_parallel_default_options(&defaults);
+        options = &defaults;
+    }
+    if (width <= 0 || height <= 0)
+        abort_("[png_parallel] Invalid image size %d x %d", width, height);
+    PNGPARALLEL* w = (PNGPARALLEL*)calloc(1, sizeof(PNGPARALLEL));
+    w->fp = fopen(filename, "wb");
+    if (!w->fp)
+        abort_("[png_parallel] File %s could not be opened for writing", filename);
+    w->width = width;
+    w->height = height;
+    w->row_size = 1 + ((size_t)width * bit_depth * channels_of(color_type) + 7) / 8;
+    w->level = options->level;
+    w->thread_count = options->thread_count;
+    if (w->thread_count <= 0) {
+#ifdef _OPENMP
+        w->thread_count = omp_get_max_threads();
+#else
+        w->thread_count = 1;
+#endif
+    }
+    w->rows_per_block = options->rows_per_block;
+    if (w->rows_per_block <= 0) {
+        w->rows_per_block = (int)((1 << 20) / w->row_size);
+        if (w->rows_per_block < 1)
+            w->rows_per_block = 1;
+    }
+    w->adler = adler32(0L, Z_NULL, 0);
+    w->buffer = (unsigned char*)malloc(PNGPARALLEL_WINDOW_SIZE + w->row_size * w->rows_per_block * w->thread_count);
+    w->batch = w->buffer + PNGPARALLEL_WINDOW_SIZE;
+    w->blocks = (PNGBLOCK*)calloc(w->thread_count, sizeof(PNGBLOCK));
+    if (!w->buffer || !w->blocks)
+        abort_("[png_parallel] Out of memory");
+
+    static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    unsigned char ihdr[13];
+    put_u32_be(ihdr, width);
+    put_u32_be(ihdr + 4, height);
+    ihdr[8] = (unsigned char)bit_depth;
+    ihdr[9] = (unsigned char)color_type;
+    ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+    ihdr[11] = PNG_FILTER_TYPE_BASE;
+    ihdr[12] = PNG_INTERLACE_NONE;
+    if (fwrite(signature, 1, 8, w->fp) != 8)
+        abort_("[png_parallel] Error during writing header");
+    write_chunk(w->fp, "IHDR", NULL, 0, ihdr, sizeof(ihdr), NULL, 0);
+    if (palette && num_palette > 0) {
+        unsigned char plte[256 * 3];
+        for (int i = 0; i < num_palette && i < 256; i++) {
+            plte[i * 3] = palette[i].red;
+            plte[i * 3 + 1] = palette[i].green;
+            plte[i * 3 + 2] = palette[i].blue;
+        }
+        write_chunk(w->fp, "PLTE", NULL, 0, plte, (size_t)num_palette * 3, NULL, 0);
+    }
+    return w;
+}
+
+// Raw-deflates one block, primed with the preceding window, ending on a byte boundary with a sync
+// flush (or Z_FINISH for the last block of the image).
+static void compress_block(const unsigned char* dict, size_t dict_size, const unsigned char* in, size_t in_size,
+                           int last, int level, PNGBLOCK* block) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        abort_("[png_parallel] deflateInit2 failed");
+    if (dict_size && deflateSetDictionary(&zs, dict, (uInt)dict_size) != Z_OK)
+        abort_("[png_parallel] deflateSetDictionary failed");
+    size_t capacity = deflateBound(&zs, (uLong)in_size) + 64;
+    block->out = (unsigned char*)realloc(block->out, capacity);
+    zs.next_in = (Bytef*)in;
+    zs.avail_in = (uInt)in_size;
+    zs.next_out = block->out;
+    zs.avail_out = (uInt)capacity;
+    for (;;) {
+        const int ret = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+        if (ret == Z_STREAM_ERROR)
+            abort_("[png_parallel] deflate failed");
+        // done when the stream ended, or all input was flushed with output space to spare
+        if (last ? ret == Z_STREAM_END : (zs.avail_in == 0 && zs.avail_out > 0))
+            break;
+        const size_t used = capacity - zs.avail_out;
+        capacity *= 2;
+        block->out = (unsigned char*)realloc(block->out, capacity);
+        zs.next_out = block->out + used;
+        zs.avail_out = (uInt)(capacity - used);
+    }
+    block->out_size = capacity - zs.avail_out;
+    deflateEnd(&zs);
+    block->adler = adler32(adler32(0L, Z_NULL, 0), in, (uInt)in_size);
+}
+
+static void write_zlib_header(PNGPARALLEL* w, unsigned char* header) {
+    int flevel = 2;
+    if (w->level >= 0 && w->level <= 1)
+        flevel = 0;
+    else if (w->level >= 2 && w->level <= 5)
+        flevel = 1;
+    else if (w->level >= 7)
+        flevel = 3;
+    header[0] = 0x78; // deflate, 32 KB window
+    header[1] = (unsigned char)(flevel << 6);
+    header[1] += (unsigned char)((31 - (header[0] * 256 + header[1]) % 31) % 31);
+}
+
+static void flush_batch(PNGPARALLEL* w, int last) {
+    const int block_count = (w->rows_buffered + w->rows_per_block - 1) / w->rows_per_block;
+    const size_t block_size = w->row_size * w->rows_per_block;
+    const size_t batch_size = w->row_size * w->rows_buffered;
+    int b;
+#pragma omp parallel for schedule(dynamic, 1) num_threads(w->thread_count)
+    for (b = 0; b < block_count; b++) {
+        const size_t offset = block_size * b;
+        const size_t size = offset + block_size <= batch_size ? block_size : batch_size - offset;
+        size_t dict_size = w->history_size + offset;
+        if (dict_size > PNGPARALLEL_WINDOW_SIZE)
+            dict_size = PNGPARALLEL_WINDOW_SIZE;
+        compress_block(w->batch + offset - dict_size, dict_size, w->batch + offset, size,
+                       last && b == block_count - 1, w->level, &w->blocks[b]);
+    }
+    for (b = 0; b < block_count; b++) {
+        const size_t offset = block_size * b;
+        const size_t size = offset + block_size <= batch_size ? block_size : batch_size - offset;
+        const PNGBLOCK* block = &w->blocks[b];
+        w->adler = adler32_combine(w->adler, block->adler, (z_off_t)size);
+        for (size_t written = 0; written < block->out_size; written += PNGPARALLEL_MAX_CHUNK) {
+            const size_t chunk = block->out_size - written < PNGPARALLEL_MAX_CHUNK ? block->out_size - written : PNGPARALLEL_MAX_CHUNK;
+            const int trailer = last && b == block_count - 1 && written + chunk == block->out_size;
+            unsigned char zlib_header[2];
+            unsigned char adler_bytes[4];
+            const int header = !w->header_written;
+            if (header) {
+                write_zlib_header(w, zlib_header);
+                w->header_written = 1;
+            }
+            if (trailer)
+                put_u32_be(adler_bytes, w->adler);
+            write_chunk(w->fp, "IDAT", zlib_header, header ? 2 : 0, block->out + written, chunk, adler_bytes, trailer ? 4 : 0);
+        }
+    }
+    // keep the tail as the dictionary of the next batch
+    size_t keep = w->history_size + batch_size;
+    if (keep > PNGPARALLEL_WINDOW_SIZE)
+        keep = PNGPARALLEL_WINDOW_SIZE;
+    memmove(w->buffer + PNGPARALLEL_WINDOW_SIZE - keep, w->batch + batch_size - keep, keep);
+    w->history_size = keep;
+    w->rows_buffered = 0;
+}
+
+void png_parallel_write_row(PNGPARALLEL* w, png_const_bytep row) {
+    if (w->rows_written >= w->height)
+        abort_("[png_parallel] More rows than the image height %d", w->height);
+    if (w->rows_buffered == w->rows_per_block * w->thread_count) {
+        // a full batch is only compressed once another row arrives, so the last block is always
+        // compressed by png_parallel_close with Z_FINISH
+        flush_batch(w, 0);
+    }
+    unsigned char* dst = w->batch + w->row_size * w->rows_buffered;
+    dst[0] = PNG_FILTER_VALUE_NONE;
+    memcpy(dst + 1, row, w->row_size - 1);
+    w->rows_buffered++;
+    w->rows_written++;
+}
+
+void png_parallel_close(PNGPARALLEL* w) {
+    if (w->rows_written != w->height)
+        abort_("[png_parallel] %d rows written, image height is %d", w->rows_written, w->height);
+    flush_batch(w, 1);
+    write_chunk(w->fp, "IEND", NULL, 0, NULL, 0, NULL, 0);
+    if (fclose(w->fp) != 0)
+        abort_("[png_parallel] Error during closing file");
+    for (int b = 0; b < w->thread_count; b++)
+        free(w->blocks[b].out);
+    free(w->blocks);
+    free(w->buffer);
+    free(w);
+}
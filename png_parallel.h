@@ -0,0 +1,36 @@
+#pragma once
+
+#include <png.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streaming PNG writer that deflates independent row blocks in parallel (pigz-style) and joins them
+// into one zlib stream: every block but the last ends with a sync flush, each block is primed with the
+// previous 32 KB as its dictionary, and the block adler32 values are combined for the stream trailer.
+// Rows are stored unfiltered (what libpng picks for palette and sub-byte images anyway).
+typedef struct _PNGPARALLEL PNGPARALLEL;
+
+typedef struct _PNGPARALLELOPTIONS {
+    int level;            // zlib compression level, -1 (default) or 0..9
+    int rows_per_block;   // rows per deflate block; 0 picks about 1 MB of row data per block
+    int thread_count;     // blocks compressed at once; 0 uses all OpenMP threads (1 without OpenMP)
+} PNGPARALLELOPTIONS;
+
+void png_parallel_default_options(PNGPARALLELOPTIONS* options);
+
+// Opens 'filename' and writes the signature, IHDR and PLTE (when palette is not NULL) chunks.
+// Aborts with a message on I/O errors, like the other PNG tools.
+PNGPARALLEL* png_parallel_open(const char* filename, int width, int height, int bit_depth, int color_type,
+                               png_const_colorp palette, int num_palette, const PNGPARALLELOPTIONS* options);
+
+// Appends one row of png rowbytes (width * bits per pixel, rounded up to whole bytes).
+void png_parallel_write_row(PNGPARALLEL* writer, png_const_bytep row);
+
+// Flushes the remaining rows, writes the stream trailer and IEND, and frees the writer.
+void png_parallel_close(PNGPARALLEL* writer);
+
+#ifdef __cplusplus
+}
+#endif
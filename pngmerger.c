@@ -1,21 +1,17 @@
 #include "precompiled.h"
-
-#define PIXELSET1BIT(row, x) (row)[(x) / 8] |= (1 << (7 - ((x) % 8)))
-#define PIXELGETBIT(row, x) ((((row)[(x) / 8] >> (7 - ((x) % 8))) & 1))
-#define PIXELSET0BIT(row, x) (row)[(x) / 8] &= ~(1 << (7 - ((x) % 8)))
+#include "bitrow.h"
+#include "png_parallel.h"
 
 typedef struct _PNGCONTEXT {
-    int x, y;
-
     int width, height;
     png_byte color_type;
     png_byte bit_depth;
 
     png_structp png_ptr;
     png_infop info_ptr;
-    int number_of_passes;
-    png_bytep * row_pointers;
+    png_bytep row;
     FILE *fp;
+    PNGPARALLEL* writer;
 } PNGCONTEXT;
 
 static void abort_(const char * s, ...) {
@@ -27,23 +23,8 @@ static void abort_(const char * s, ...) {
     abort();
 }
 
-static void free_raw_pointers(PNGCONTEXT* context) {
-    /* cleanup heap allocation */
-    for (context->y = 0; context->y < context->height; context->y++)
-        free(context->row_pointers[context->y]);
-    free(context->row_pointers);
-    context->row_pointers = 0;
-}
-
-static void malloc_raw_pointers(PNGCONTEXT* context) {
-    const png_size_t bytes_per_row = png_get_rowbytes(context->png_ptr, context->info_ptr);
-    context->row_pointers = (png_bytep*)malloc(sizeof(png_bytep) * context->height);
-    for (context->y = 0; context->y < context->height; context->y++)
-        context->row_pointers[context->y] = (png_byte*)malloc(bytes_per_row);
-}
-
-void open_to_read_png_file(const char* file_name, PNGCONTEXT* context) {
-    printf("Open to read %s...\n", file_name);
+// Reads the header only; rows are pulled one by one with png_read_row afterwards.
+static void open_to_read_png_file(const char* file_name, PNGCONTEXT* context) {
     memset(context, 0, sizeof(PNGCONTEXT));
 
     char header[8];    // 8 is the maximum size that can be checked
@@ -80,127 +61,152 @@ void open_to_read_png_file(const char* file_name, PNGCONTEXT* context) {
     context->color_type = png_get_color_type(context->png_ptr, context->info_ptr);
     context->bit_depth = png_get_bit_depth(context->png_ptr, context->info_ptr);
 
-    context->number_of_passes = png_set_interlace_handling(context->png_ptr);
+    if (context->bit_depth != 1)
+        abort_("[read_png_file] File %s is not a 1-bit image (bit depth %d)", file_name, context->bit_depth);
+    if (png_get_interlace_type(context->png_ptr, context->info_ptr) != PNG_INTERLACE_NONE)
+        abort_("[read_png_file] File %s is interlaced; row streaming needs a non-interlaced image", file_name);
+
     png_read_update_info(context->png_ptr, context->info_ptr);
 
+    context->row = (png_bytep)malloc(png_get_rowbytes(context->png_ptr, context->info_ptr));
+}
 
-    /* read file */
+static void read_png_row(PNGCONTEXT* context) {
     if (setjmp(png_jmpbuf(context->png_ptr)))
-        abort_("[read_png_file] Error during read_image");
-
-    malloc_raw_pointers(context);
+        abort_("[read_png_file] Error during read_row");
 
-    png_read_image(context->png_ptr, context->row_pointers);
+    png_read_row(context->png_ptr, context->row, NULL);
+}
 
+static void close_read_png_file(PNGCONTEXT* context) {
+    png_destroy_read_struct(&context->png_ptr, &context->info_ptr, NULL);
+    free(context->row);
+    context->row = 0;
     fclose(context->fp);
+    context->fp = 0;
 }
 
-static void open_to_write_png_file(const char* output_filename, PNGCONTEXT* context, int width, int height) {
-    printf("Open to write %s...\n", output_filename);
+static void open_to_write_png_file(const char* output_filename, PNGCONTEXT* context, int width, int height, const PNGPARALLELOPTIONS* png_options) {
+    printf("Open to write %s (%d x %d)...\n", output_filename, width, height);
     memset(context, 0, sizeof(PNGCONTEXT));
 
-    /* create file */
-    context->fp = fopen(output_filename, "wb");
-    if (!context->fp)
-        abort_("[write_png_file] File %s could not be opened for writing", output_filename);
-
-
-    /* initialize stuff */
-    context->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-
-    if (!context->png_ptr)
-        abort_("[write_png_file] png_create_write_struct failed");
-
-    context->info_ptr = png_create_info_struct(context->png_ptr);
-    if (!context->info_ptr)
-        abort_("[write_png_file] png_create_info_struct failed");
-
-    if (setjmp(png_jmpbuf(context->png_ptr)))
-        abort_("[write_png_file] Error during init_io");
-
-    png_init_io(context->png_ptr, context->fp);
-
-
-    /* write header */
-    if (setjmp(png_jmpbuf(context->png_ptr)))
-        abort_("[write_png_file] Error during writing header");
-
     context->color_type = PNG_COLOR_TYPE_PALETTE;
     context->bit_depth = 1;
     context->width = width;
     context->height = height;
 
-    png_set_IHDR(context->png_ptr, context->info_ptr, width, height,
-                 context->bit_depth, context->color_type, PNG_INTERLACE_NONE,
-                 PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-
-
-    int num_palette = 2;
     png_color palettep[] = { { 255, 255, 255 }, { 0, 0, 0 }, };
-    //png_get_PLTE(png_ptr, info_ptr, &palettep, &num_palette);
-    png_set_PLTE(context->png_ptr, context->info_ptr, palettep, num_palette);
+    context->writer = png_parallel_open(output_filename, width, height, context->bit_depth, context->color_type, palettep, 2, png_options);
 
-    png_write_info(context->png_ptr, context->info_ptr);
-
-    malloc_raw_pointers(context);
+    context->row = (png_bytep)calloc(((size_t)width + 7) / 8, 1);
 }
 
-static void write_and_close_png_file(PNGCONTEXT* context) {
-    printf("Writing to disk...\n");
-
-    /* write bytes */
-    if (setjmp(png_jmpbuf(context->png_ptr)))
-        abort_("[write_png_file] Error during writing bytes");
-
-    png_write_image(context->png_ptr, context->row_pointers);
-
-    /* end write */
-    if (setjmp(png_jmpbuf(context->png_ptr)))
-        abort_("[write_png_file] Error during end of write");
+static void write_png_row(PNGCONTEXT* context) {
+    png_parallel_write_row(context->writer, context->row);
+}
 
-    png_write_end(context->png_ptr, NULL);
+static void close_write_png_file(PNGCONTEXT* context) {
+    png_parallel_close(context->writer);
+    context->writer = 0;
 
-    free_raw_pointers(context);
+    free(context->row);
+    context->row = 0;
+}
 
-    fclose(context->fp);
+static void tile_filename(char* out, size_t out_size, const char* pattern, int col, int row) {
+    snprintf(out, out_size, pattern, col, row);
 }
 
-static void merge_data(PNGCONTEXT* input1, PNGCONTEXT* input2, PNGCONTEXT* output) {
-    const png_size_t bytes_per_row1 = png_get_rowbytes(input1->png_ptr, input1->info_ptr);
-    const png_size_t bytes_per_row2 = png_get_rowbytes(input2->png_ptr, input2->info_ptr);
-    if (input1->width != input2->width) {
-        abort_("width not match: %d != %d", input1->width, input2->width);
+// Merges a columns x rows grid of 1-bit tiles into one image. 'pattern' is a printf format taking the
+// column and row index (e.g. "w%d-h%d.png"). Tiles in the same grid column must share a width and tiles
+// in the same grid row must share a height. Only one row per open tile (one grid row at a time) and one
+// output row are held in memory.
+static void merge_png_grid(const char* pattern, int columns, int rows, const char* output_filename, const PNGPARALLELOPTIONS* png_options) {
+    char filename[1024];
+    int* widths = (int*)calloc(columns, sizeof(int));
+    int* heights = (int*)calloc(rows, sizeof(int));
+    PNGCONTEXT* inputs = (PNGCONTEXT*)calloc(columns, sizeof(PNGCONTEXT));
+    PNGCONTEXT output;
+
+    // header-only pass to validate the grid and get the output size
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            tile_filename(filename, sizeof(filename), pattern, c, r);
+            open_to_read_png_file(filename, &inputs[c]);
+            if (r == 0) {
+                widths[c] = inputs[c].width;
+            } else if (widths[c] != inputs[c].width) {
+                abort_("width not match: %s %d != %d", filename, inputs[c].width, widths[c]);
+            }
+            if (c == 0) {
+                heights[r] = inputs[c].height;
+            } else if (heights[r] != inputs[c].height) {
+                abort_("height not match: %s %d != %d", filename, inputs[c].height, heights[r]);
+            }
+            close_read_png_file(&inputs[c]);
+        }
+    }
+    int output_width = 0;
+    int output_height = 0;
+    for (int c = 0; c < columns; c++) {
+        output_width += widths[c];
     }
-    if (bytes_per_row1 != bytes_per_row2) {
-        abort_("bytes per row not match: %zu != %zu", bytes_per_row1, bytes_per_row2);
+    for (int r = 0; r < rows; r++) {
+        output_height += heights[r];
     }
-    for (int y = 0; y < output->height; y++) {
-        memcpy(output->row_pointers[y], input1->row_pointers[y], bytes_per_row1);
-        // could not use simple 'memcpy' because of it cannot be used with 'bit'-level addressing...
-        for (int x2 = 0; x2 < input2->width; x2++) {
-            if (PIXELGETBIT(input2->row_pointers[y], x2)) {
-                PIXELSET1BIT(output->row_pointers[y], input1->width + x2);
-            } else {
-                PIXELSET0BIT(output->row_pointers[y], input1->width + x2);
+
+    open_to_write_png_file(output_filename, &output, output_width, output_height, png_options);
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            tile_filename(filename, sizeof(filename), pattern, c, r);
+            printf("Open to read %s...\n", filename);
+            open_to_read_png_file(filename, &inputs[c]);
+        }
+        for (int y = 0; y < heights[r]; y++) {
+            int x = 0;
+            for (int c = 0; c < columns; c++) {
+                read_png_row(&inputs[c]);
+                bitrow_append(output.row, x, inputs[c].row, widths[c]);
+                x += widths[c];
             }
+            write_png_row(&output);
         }
+        for (int c = 0; c < columns; c++) {
+            close_read_png_file(&inputs[c]);
+        }
+        printf("Grid row %d/%d merged.\n", r + 1, rows);
     }
+    close_write_png_file(&output);
+
+    free(inputs);
+    free(heights);
+    free(widths);
 }
 
 // output resolution: 172824 x 86412 = 14934067488
 // output bytes: 14934067488 / 8 = 1866758436
-static void merge_png(const char* input1_filename, const char* input2_filename, const char* output_filename) {
-    PNGCONTEXT input1, input2, output;
-    open_to_read_png_file(input1_filename, &input1);
-    open_to_read_png_file(input2_filename, &input2);
-    open_to_write_png_file(output_filename, &output, input1.width * 2, input1.height);
-    merge_data(&input1, &input2, &output);
-    write_and_close_png_file(&output);
-    free_raw_pointers(&input1);
-    free_raw_pointers(&input2);
-}
-
-int main() {
-    merge_png("C:\\sea-server\\modis\\png-2x1-offset\\w0-h0.png", "C:\\sea-server\\modis\\png-2x1-offset\\w1-h0.png", "C:\\sea-server\\modis\\png-2x1-offset\\merged.png");
+int main(int argc, char* argv[]) {
+    PNGPARALLELOPTIONS png_options;
+    png_parallel_default_options(&png_options);
+    if (argc == 1) {
+        merge_png_grid("C:\\sea-server\\modis\\png-2x1-offset\\w%d-h%d.png", 2, 1, "C:\\sea-server\\modis\\png-2x1-offset\\merged.png", &png_options);
+        return 0;
+    }
+    if (argc < 5 || argc > 7) {
+        fprintf(stderr, "Usage: %s <tile pattern, e.g. w%%d-h%%d.png> <columns> <rows> <output png> [zlib level] [rows per deflate block]\n", argv[0]);
+        return 1;
+    }
+    const int columns = atoi(argv[2]);
+    const int rows = atoi(argv[3]);
+    if (columns <= 0 || rows <= 0) {
+        abort_("invalid grid size: %s x %s", argv[2], argv[3]);
+    }
+    if (argc > 5) {
+        png_options.level = atoi(argv[5]);
+    }
+    if (argc > 6) {
+        png_options.rows_per_block = atoi(argv[6]);
+    }
+    merge_png_grid(argv[1], columns, rows, argv[4], &png_options);
     return 0;
 }
@@ -1,17 +1,9 @@
 #include "precompiled.h"
-
-int x, y;
-
-int width, height;
-png_byte color_type;
-png_byte bit_depth;
-
-png_structp png_ptr;
-png_infop info_ptr;
-int number_of_passes;
-png_bytep * row_pointers;
-
-#define PIXELSETBIT(row, x) (row)[(x) / 8] |= (1 << (7 - ((x) % 8)))
+#include "bitrow.h"
+#include "png_parallel.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 static void abort_(const char * s, ...) {
     va_list args;
@@ -26,103 +18,80 @@ static int nearest_8_mul(int v) {
     return (v + ((1 << 3) - 1)) >> 3;
 }
 
-static void write_png_file(const char* input_filename, const char* output_filename, int slice_size) {
-    /* create file */
-    FILE *fp = fopen(output_filename, "wb");
-    if (!fp)
-        abort_("[write_png_file] File %s could not be opened for writing", output_filename);
-
-
-    /* initialize stuff */
-    png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-
-    if (!png_ptr)
-        abort_("[write_png_file] png_create_write_struct failed");
-
-    info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr)
-        abort_("[write_png_file] png_create_info_struct failed");
-
-    if (setjmp(png_jmpbuf(png_ptr)))
-        abort_("[write_png_file] Error during init_io");
-
-    png_init_io(png_ptr, fp);
-    
-
-    /* write header */
-    if (setjmp(png_jmpbuf(png_ptr)))
-        abort_("[write_png_file] Error during writing header");
+// Converts one slice_size x slice_size .dat slice (one byte per pixel, 0 = land) to a 1-bit PNG.
+// Rows are streamed, so only one input row and one deflate batch are held in memory.
+static void write_png_file(const char* input_filename, const char* output_filename, int slice_size, const PNGPARALLELOPTIONS* png_options) {
+    FILE* fin = fopen(input_filename, "rb");
+    if (!fin)
+        abort_("[write_png_file] File %s could not be opened for reading", input_filename);
+    setvbuf(fin, NULL, _IOFBF, 1 << 20);
 
-    color_type = PNG_COLOR_TYPE_PALETTE;
-    bit_depth = 1;
-    width = slice_size;
-    height = slice_size;
+    const int width = slice_size;
+    const int height = slice_size;
+    png_color palettep[] = { { 255, 255, 255 }, { 0, 0, 0 },  };
+    PNGPARALLEL* writer = png_parallel_open(output_filename, width, height, 1, PNG_COLOR_TYPE_PALETTE, palettep, 2, png_options);
 
-    row_pointers = calloc(height, sizeof(void*));
-    FILE* fin = fopen(input_filename, "rb");
     unsigned char* row_in = malloc(width);
+    png_bytep row_out = malloc(nearest_8_mul(width));
     for (int y = 0; y < height; y++) {
-        png_bytep row_out = calloc(nearest_8_mul(width), 1);
-        fread(row_in, 1, width, fin);
-        for (int x = 0; x < width; x++) {
-            if (row_in[x] == 0) {
-                PIXELSETBIT(row_out, x);
-            }
-        }
-        row_pointers[y] = row_out;
+        if (fread(row_in, 1, width, fin) != (size_t)width)
+            abort_("[write_png_file] File %s is shorter than %d x %d", input_filename, width, height);
+        bitrow_pack_zero_bytes(row_out, row_in, width);
+        png_parallel_write_row(writer, row_out);
     }
+    free(row_out);
     free(row_in);
-    row_in = 0;
     fclose(fin);
 
-    png_set_IHDR(png_ptr, info_ptr, width, height,
-                 bit_depth, color_type, PNG_INTERLACE_NONE,
-                 PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-
-
-    int num_palette = 2;
-    png_color palettep[] = { { 255, 255, 255 }, { 0, 0, 0 },  };
-    //png_get_PLTE(png_ptr, info_ptr, &palettep, &num_palette);
-    png_set_PLTE(png_ptr, info_ptr, palettep, num_palette);
-
-    png_write_info(png_ptr, info_ptr);
-
-    /* write bytes */
-    if (setjmp(png_jmpbuf(png_ptr)))
-        abort_("[write_png_file] Error during writing bytes");
-
-    png_write_image(png_ptr, row_pointers);
-
-
-    /* end write */
-    if (setjmp(png_jmpbuf(png_ptr)))
-        abort_("[write_png_file] Error during end of write");
-
-    png_write_end(png_ptr, NULL);
-
-    /* cleanup heap allocation */
-    for (y = 0; y<height; y++)
-        free(row_pointers[y]);
-    free(row_pointers);
-
-    fclose(fp);
+    png_parallel_close(writer);
 }
 
-static void convert_dat_to_png(const char* input_filename_format, const char* output_filename_format, int wc, int hc, int slice_size) {
-    for (int hi = 0; hi < hc; hi++) {
-        for (int wi = 0; wi < wc; wi++) {
-            char input_filename[128];
-            char output_filename[128];
-            sprintf(input_filename, input_filename_format, wi, hi);
-            sprintf(output_filename, output_filename_format, wi, hi);
-            printf("Writing %s...\n", output_filename);
-            write_png_file(input_filename, output_filename, slice_size);
-        }
+// Tiles are independent, so they are converted in parallel when built with OpenMP
+// (thread count follows OMP_NUM_THREADS). Deflate blocks inside a tile only get extra threads when
+// there are fewer tiles than threads, because nested parallel regions run on one thread.
+static void convert_dat_to_png(const char* input_filename_format, const char* output_filename_format, int wc, int hc, int slice_size, const PNGPARALLELOPTIONS* png_options) {
+    const int tile_count = wc * hc;
+    int i;
+#pragma omp parallel for schedule(dynamic, 1) if(tile_count >= omp_get_max_threads())
+    for (i = 0; i < tile_count; i++) {
+        const int wi = i % wc;
+        const int hi = i / wc;
+        char input_filename[1024];
+        char output_filename[1024];
+        snprintf(input_filename, sizeof(input_filename), input_filename_format, wi, hi);
+        snprintf(output_filename, sizeof(output_filename), output_filename_format, wi, hi);
+        printf("Writing %s...\n", output_filename);
+        write_png_file(input_filename, output_filename, slice_size, png_options);
     }
 }
 
-int main() {
-    //convert_dat_to_png("C:\\sea-server\\modis\\w%d-h%d.dat", "C:\\sea-server\\modis\\w%d-h%d.png", 4, 2, 21603 * 2);
-    convert_dat_to_png("d:\\bin\\w%d-h%d.dat", "d:\\bin\\w%d-h%d.png", 2, 1, 21603 * 2 * 2);
+int main(int argc, char* argv[]) {
+    PNGPARALLELOPTIONS png_options;
+    png_parallel_default_options(&png_options);
+    if (argc == 1) {
+        //convert_dat_to_png("C:\\sea-server\\modis\\w%d-h%d.dat", "C:\\sea-server\\modis\\w%d-h%d.png", 4, 2, 21603 * 2, &png_options);
+        convert_dat_to_png("d:\\bin\\w%d-h%d.dat", "d:\\bin\\w%d-h%d.png", 2, 1, 21603 * 2 * 2, &png_options);
+        return 0;
+    }
+    if (argc < 6 || argc > 8) {
+        fprintf(stderr, "Usage: %s <input .dat pattern, e.g. w%%d-h%%d.dat> <output .png pattern> <columns> <rows> <slice size> [zlib level] [rows per deflate block]\n", argv[0]);
+        return 1;
+    }
+    const int wc = atoi(argv[3]);
+    const int hc = atoi(argv[4]);
+    const int slice_size = atoi(argv[5]);
+    if (wc <= 0 || hc <= 0 || slice_size <= 0) {
+        abort_("invalid grid or slice size: %s x %s, %s", argv[3], argv[4], argv[5]);
+    }
+    if (argc > 6) {
+        png_options.level = atoi(argv[6]);
+    }
+    if (argc > 7) {
+        png_options.rows_per_block = atoi(argv[7]);
+    }
+#ifdef _OPENMP
+    printf("Converting %d tiles on up to %d threads...\n", wc * hc, omp_get_max_threads());
+#endif
+    convert_dat_to_png(argv[1], argv[2], wc, hc, slice_size, &png_options);
     return 0;
 }
@@ -12,13 +12,20 @@
 #include <list>
 #include <set>
 #include <unordered_set>
+#include <algorithm>
+#include <chrono>
+#include <queue>
+#include <memory>
 #include <boost/interprocess/managed_mapped_file.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <boost/geometry.hpp>
 #include <boost/geometry/geometries/point.hpp>
 #include <boost/geometry/geometries/box.hpp>
 #include <boost/geometry/index/rtree.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
+#include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
 
 #define PNG_DEBUG 3
@@ -0,0 +1,297 @@
+#include "precompiled.hpp"
+#include "rectgraph.hpp"
+#include "rectpatch.hpp"
+
+using namespace astarrtree;
+
+static const char graph_magic[8] = { 'S', 'R', 'G', 'R', 'A', 'P', 'H', '\0' };
+static const uint32_t graph_version = 1;
+
+struct graph_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t wrap;
+    int32_t width;
+    uint32_t reserved;
+    uint64_t cell_count;
+    uint64_t edge_count;
+};
+
+void rect_graph::build(rtree_t* rtree_ptr, bool wrap, int width) {
+    this->rtree_ptr = rtree_ptr;
+    this->wrap = wrap;
+    this->width = width;
+    cells.clear();
+    cells.reserve(rtree_ptr->size());
+    for (auto it = rtree_ptr->begin(); it != rtree_ptr->end(); ++it) {
+        const box_t& b = it->first;
+        cells.push_back(xy32xy32{ { b.min_corner().get<0>(), b.min_corner().get<1>() },
+                                  { b.max_corner().get<0>(), b.max_corner().get<1>() } });
+    }
+    std::sort(cells.begin(), cells.end(), xy0_less);
+
+    offsets.assign(1, 0);
+    offsets.reserve(cells.size() + 1);
+    targets.clear();
+    shifts.clear();
+    std::vector<value_t> result_s;
+    for (uint32_t id = 0; id < cells.size(); id++) {
+        add_touching(id, result_s);
+        offsets.push_back(static_cast<uint32_t>(targets.size()));
+    }
+    printf("Rect graph: %zu cells, %zu edges\n", cells.size(), targets.size());
+}
+
+bool rect_graph::save(const char* filename) const {
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        return false;
+    }
+    graph_header header;
+    memcpy(header.magic, graph_magic, sizeof(graph_magic));
+    header.version = graph_version;
+    header.wrap = wrap ? 1 : 0;
+    header.width = width;
+    header.reserved = 0;
+    header.cell_count = cells.size();
+    header.edge_count = targets.size();
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fwrite(cells.data(), sizeof(xy32xy32), cells.size(), fp) == cells.size();
+    ok = ok && fwrite(offsets.data(), sizeof(uint32_t), offsets.size(), fp) == offsets.size();
+    ok = ok && fwrite(targets.data(), sizeof(uint32_t), targets.size(), fp) == targets.size();
+    ok = ok && fwrite(shifts.data(), sizeof(int), shifts.size(), fp) == shifts.size();
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Rect graph " << filename << " could not be written" << std::endl;
+        remove(filename);
+    }
+    return ok;
+}
+
+bool rect_graph::load(rtree_t* rtree_ptr, bool wrap, int width, const char* filename) {
+    cells.clear();
+    offsets.clear();
+    targets.clear();
+    shifts.clear();
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+    graph_header header;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1
+        && memcmp(header.magic, graph_magic, sizeof(graph_magic)) == 0 && header.version == graph_version
+        && (header.wrap != 0) == wrap && header.cell_count == rtree_ptr->size()
+        && header.width == width;
+    if (ok) {
+        cells.resize(static_cast<size_t>(header.cell_count));
+        offsets.resize(cells.size() + 1);
+        targets.resize(static_cast<size_t>(header.edge_count));
+        shifts.resize(targets.size());
+        ok = fread(cells.data(), sizeof(xy32xy32), cells.size(), fp) == cells.size()
+            && fread(offsets.data(), sizeof(uint32_t), offsets.size(), fp) == offsets.size()
+            && fread(targets.data(), sizeof(uint32_t), targets.size(), fp) == targets.size()
+            && fread(shifts.data(), sizeof(int), shifts.size(), fp) == shifts.size()
+            && offsets.front() == 0 && offsets.back() == targets.size()
+            && std::is_sorted(offsets.begin(), offsets.end())
+            && std::all_of(targets.begin(), targets.end(), [this](uint32_t t) { return t < cells.size(); });
+    }
+    fclose(fp);
+    // same count and every tree cell in the graph: the cell sets are equal
+    for (auto it = rtree_ptr->begin(); ok && it != rtree_ptr->end(); ++it) {
+        const int id = find(xy32{ it->first.min_corner().get<0>(), it->first.min_corner().get<1>() });
+        ok = id >= 0 && cells[id].xy1.x == it->first.max_corner().get<0>() && cells[id].xy1.y == it->first.max_corner().get<1>();
+    }
+    if (!ok) {
+        std::cerr << "Rect graph " << filename << " does not match the R-tree, wrap setting or raster width and is ignored" << std::endl;
+        cells.clear();
+        offsets.clear();
+        targets.clear();
+        shifts.clear();
+        return false;
+    }
+    this->rtree_ptr = rtree_ptr;
+    this->wrap = wrap;
+    this->width = width;
+    printf("Rect graph %s: %zu cells, %zu edges\n", filename, cells.size(), targets.size());
+    return true;
+}
+
+void rect_graph::add_touching(uint32_t id, std::vector<value_t>& result_s) {
+    auto add = [&](const box_t& query_box, int shift) {
+        result_s.clear();
+        rtree_ptr->query(bgi::intersects(query_box), std::back_inserter(result_s));
+        for (const auto& v : result_s) {
+            const int target = find(xy32{ v.first.min_corner().get<0>(), v.first.min_corner().get<1>() });
+            if (target >= 0 && static_cast<uint32_t>(target) != id) {
+                targets.push_back(static_cast<uint32_t>(target));
+                shifts.push_back(shift);
+            }
+        }
+    };
+    const xy32xy32& c = cells[id];
+    add(box_t(point_t(c.xy0.x, c.xy0.y), point_t(c.xy1.x, c.xy1.y)), 0);
+    if (wrap && c.xy0.x == 0) {
+        add(box_t(point_t(width, c.xy0.y), point_t(width, c.xy1.y)), -width);
+    }
+    if (wrap && c.xy1.x == width) {
+        add(box_t(point_t(0, c.xy0.y), point_t(0, c.xy1.y)), width);
+    }
+}
+
+void rect_graph::apply_patch(const rect_patch& patch) {
+    std::vector<xy32xy32> removed(patch.removed);
+    std::sort(removed.begin(), removed.end(), xy0_less);
+    std::vector<xy32xy32> inserted(patch.inserted);
+    std::sort(inserted.begin(), inserted.end(), xy0_less);
+    // every cell whose neighbors may have changed touches the replaced area
+    xy32xy32 dirty = patch.window;
+    for (const auto& r : removed) {
+        dirty.xy0.x = std::min(dirty.xy0.x, r.xy0.x);
+        dirty.xy0.y = std::min(dirty.xy0.y, r.xy0.y);
+        dirty.xy1.x = std::max(dirty.xy1.x, r.xy1.x);
+        dirty.xy1.y = std::max(dirty.xy1.y, r.xy1.y);
+    }
+    auto touches_dirty = [&](const xy32xy32& c) {
+        if (c.xy1.y < dirty.xy0.y || c.xy0.y > dirty.xy1.y) {
+            return false;
+        }
+        if (c.xy1.x >= dirty.xy0.x && c.xy0.x <= dirty.xy1.x) {
+            return true;
+        }
+        return wrap && ((dirty.xy0.x == 0 && c.xy1.x == width) || (dirty.xy1.x == width && c.xy0.x == 0));
+    };
+
+    // merge the kept cells with the inserted ones, both in (y0, x0) order
+    std::vector<xy32xy32> old_cells;
+    old_cells.swap(cells);
+    std::vector<int> new_id(old_cells.size(), -1);
+    std::vector<int> old_id;
+    cells.reserve(old_cells.size() - removed.size() + inserted.size());
+    old_id.reserve(cells.capacity());
+    size_t r = 0;
+    size_t i = 0;
+    for (size_t o = 0; o <= old_cells.size(); o++) {
+        while (r < removed.size() && (o == old_cells.size() || xy0_less(removed[r], old_cells[o]))) {
+            r++;
+        }
+        while (i < inserted.size() && (o == old_cells.size() || xy0_less(inserted[i], old_cells[o]))) {
+            cells.push_back(inserted[i++]);
+            old_id.push_back(-1);
+        }
+        if (o == old_cells.size()) {
+            break;
+        }
+        if (r < removed.size() && removed[r].xy0.x == old_cells[o].xy0.x && removed[r].xy0.y == old_cells[o].xy0.y) {
+            r++;
+            continue;
+        }
+        new_id[o] = static_cast<int>(cells.size());
+        cells.push_back(old_cells[o]);
+        old_id.push_back(static_cast<int>(o));
+    }
+
+    std::vector<uint32_t> old_offsets;
+    std::vector<uint32_t> old_targets;
+    std::vector<int> old_shifts;
+    old_offsets.swap(offsets);
+    old_targets.swap(targets);
+    old_shifts.swap(shifts);
+    offsets.assign(1, 0);
+    offsets.reserve(cells.size() + 1);
+    targets.reserve(old_targets.size());
+    shifts.reserve(old_shifts.size());
+    std::vector<value_t> result_s;
+    size_t relinked = 0;
+    for (uint32_t id = 0; id < cells.size(); id++) {
+        if (old_id[id] >= 0 && !touches_dirty(cells[id])) {
+            // none of its neighbors was replaced: renumber the old edges
+            const uint32_t o = static_cast<uint32_t>(old_id[id]);
+            for (uint32_t e = old_offsets[o]; e < old_offsets[o + 1]; e++) {
+                targets.push_back(static_cast<uint32_t>(new_id[old_targets[e]]));
+                shifts.push_back(old_shifts[e]);
+            }
+        } else {
+            add_touching(id, result_s);
+            relinked++;
+        }
+        offsets.push_back(static_cast<uint32_t>(targets.size()));
+    }
+    printf("Rect graph patched: -%zu +%zu cells, %zu cells relinked, %zu cells, %zu edges\n",
+           removed.size(), inserted.size(), relinked, cells.size(), targets.size());
+}
+
+int rect_graph::find(xy32 xy0) const {
+    const xy32xy32 key = { xy0, xy0 };
+    auto it = std::lower_bound(cells.begin(), cells.end(), key, xy0_less);
+    if (it == cells.end() || it->xy0.x != xy0.x || it->xy0.y != xy0.y) {
+        return -1;
+    }
+    return static_cast<int>(it - cells.begin());
+}
+
+int rect_graph::find_containing(xy32 p) const {
+    std::vector<value_t> result_s;
+    rtree_ptr->query(bgi::contains(box_t(point_t(p.x, p.y), point_t(p.x + 1, p.y + 1))), std::back_inserter(result_s));
+    if (result_s.size() != 1) {
+        return -1;
+    }
+    return find(xy32{ result_s[0].first.min_corner().get<0>(), result_s[0].first.min_corner().get<1>() });
+}
+
+void rect_graph::find_overlapping(const xy32xy32& box, std::vector<uint32_t>& ids) const {
+    ids.clear();
+    std::vector<value_t> result_s;
+    // cells only touching the box along an edge do not overlap it
+    rtree_ptr->query(bgi::intersects(box_t(point_t(box.xy0.x, box.xy0.y), point_t(box.xy1.x, box.xy1.y))), std::back_inserter(result_s));
+    for (const auto& v : result_s) {
+        if (v.first.max_corner().get<0>() > box.xy0.x && v.first.min_corner().get<0>() < box.xy1.x
+            && v.first.max_corner().get<1>() > box.xy0.y && v.first.min_corner().get<1>() < box.xy1.y) {
+            const int id = find(xy32{ v.first.min_corner().get<0>(), v.first.min_corner().get<1>() });
+            if (id >= 0) {
+                ids.push_back(static_cast<uint32_t>(id));
+            }
+        }
+    }
+}
+
+void rect_graph::one_to_all(xy32 source, cost_model costs, std::vector<float>& distances, std::vector<xy32>* entries, float max_cost) const {
+    distances.assign(cells.size(), std::numeric_limits<float>::infinity());
+    std::vector<xy32> entry(cells.size(), source);
+    const int source_id = find_containing(source);
+    if (source_id < 0) {
+        std::cerr << "one_to_all: source (" << source.x << ", " << source.y << ") is not inside exactly one cell" << std::endl;
+        return;
+    }
+    std::unique_ptr<geodesic_metric> metric;
+    if (costs == CM_GEODESIC) {
+        metric.reset(new geodesic_metric(width));
+    }
+    typedef std::pair<float, uint32_t> queue_item;
+    std::priority_queue<queue_item, std::vector<queue_item>, std::greater<queue_item> > open;
+    distances[source_id] = 0;
+    open.push(queue_item(0.0f, static_cast<uint32_t>(source_id)));
+    while (!open.empty()) {
+        const queue_item top = open.top();
+        open.pop();
+        const uint32_t u = top.second;
+        if (top.first > distances[u]) {
+            continue;
+        }
+        for (uint32_t e = offsets[u]; e < offsets[u + 1]; e++) {
+            const uint32_t v = targets[e];
+            const int shift = shifts[e];
+            const xy32xy32 shifted = { { cells[v].xy0.x + shift, cells[v].xy0.y }, { cells[v].xy1.x + shift, cells[v].xy1.y } };
+            xy32 p = nearest_entry_pixel(cells[u], shifted, entry[u]);
+            const float d = distances[u] + step_cost(costs, metric.get(), entry[u], p);
+            if (d < distances[v] && d <= max_cost) {
+                p.x -= shift;
+                distances[v] = d;
+                entry[v] = p;
+                open.push(queue_item(d, v));
+            }
+        }
+    }
+    if (entries) {
+        entries->swap(entry);
+    }
+}
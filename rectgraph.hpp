@@ -0,0 +1,71 @@
+#pragma once
+
+#include "astarrtree.hpp"
+
+namespace astarrtree {
+    struct rect_patch;
+
+    // Adjacency of the max-rect cells of an R-tree in compressed sparse row form, for searches that visit
+    // most of the graph (landmark preprocessing, one-to-all) where per-node R-tree queries would dominate.
+    // Cells are numbered in (y0, x0) order. Two cells are adjacent when they share an edge or a corner,
+    // or touch across the wrap seam.
+    //
+    // Saved graph layout (native byte order):
+    //   header  : magic "SRGRAPH\0" (8), u32 version, u32 wrap, i32 width, u32 reserved, u64 cell_count, u64 edge_count
+    //   cells   : xy32xy32[cell_count]
+    //   offsets : u32[cell_count + 1]
+    //   targets : u32[edge_count]
+    //   shifts  : i32[edge_count]
+    class rect_graph {
+    public:
+        // 'width' is the width of the whole-globe raster the cells were cut from (see search_options::raster_width);
+        // it places the wrap seam and scales the geodesic costs.
+        void build(rtree_t* rtree_ptr, bool wrap, int width);
+        // Writes the graph so later runs can load() it instead of querying the R-tree for every cell.
+        bool save(const char* filename) const;
+        // Reads a graph written by save() for 'rtree_ptr'. Returns false (leaving the graph empty) when the file is
+        // missing or damaged, or was saved with another wrap setting, raster width or for other cells (an R-tree
+        // patched since).
+        bool load(rtree_t* rtree_ptr, bool wrap, int width, const char* filename);
+        // Follows patch_rtree on the same R-tree: cells are renumbered, and only the cells touching the replaced
+        // area query the R-tree for their neighbors again; the edges of all others are copied.
+        void apply_patch(const rect_patch& patch);
+
+        size_t size() const { return cells.size(); }
+        const xy32xy32& cell(uint32_t id) const { return cells[id]; }
+        // Neighbors of 'id' are targets[offsets[id] .. offsets[id + 1]); shifts[] holds the x offset that moves
+        // each neighbor next to 'id' (non-zero across the wrap seam only).
+        uint32_t edges_begin(uint32_t id) const { return offsets[id]; }
+        uint32_t edges_end(uint32_t id) const { return offsets[id + 1]; }
+        uint32_t edge_target(uint32_t e) const { return targets[e]; }
+        int edge_shift(uint32_t e) const { return shifts[e]; }
+        size_t edge_count() const { return targets.size(); }
+        int get_width() const { return width; }
+        bool get_wrap() const { return wrap; }
+
+        // Id of the cell whose top-left corner is 'xy0', or -1.
+        int find(xy32 xy0) const;
+        // Id of the cell containing 'p', or -1.
+        int find_containing(xy32 p) const;
+        // Ids of the cells overlapping 'box' (pixels [xy0, xy1)).
+        void find_overlapping(const xy32xy32& box, std::vector<uint32_t>& ids) const;
+
+        // Cost of reaching every cell from the pixel 'source', as a dense array indexed by cell id (infinity
+        // when unreachable or farther than 'max_cost'). Each cell is entered at the pixel nearest to where the
+        // previous one was entered, as the cell search does; 'entries' receives those pixels when set.
+        // The search stops once every remaining cell costs more than 'max_cost'.
+        void one_to_all(xy32 source, cost_model costs, std::vector<float>& distances, std::vector<xy32>* entries = nullptr,
+                        float max_cost = std::numeric_limits<float>::infinity()) const;
+    private:
+        // Appends the edges of cell 'id' found in the R-tree.
+        void add_touching(uint32_t id, std::vector<value_t>& result_s);
+
+        rtree_t* rtree_ptr = nullptr;
+        int width = 0;
+        bool wrap = false;
+        std::vector<xy32xy32> cells;
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> targets;
+        std::vector<int> shifts;
+    };
+}
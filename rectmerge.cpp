@@ -0,0 +1,153 @@
+#include "precompiled.hpp"
+#include "rectmerge.hpp"
+
+using namespace rectmerge;
+
+static uint64_t corner_key(int x, int y) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32 | static_cast<uint32_t>(y);
+}
+
+// Single sweep merging horizontally (same y span, touching x) or vertically (same x span, touching y) adjacent rectangles.
+static bool merge_pass(std::vector<xy32xy32>& rects, bool horizontal) {
+    if (horizontal) {
+        std::sort(rects.begin(), rects.end(), [](const xy32xy32& a, const xy32xy32& b) {
+            if (a.xy0.y != b.xy0.y) return a.xy0.y < b.xy0.y;
+            if (a.xy1.y != b.xy1.y) return a.xy1.y < b.xy1.y;
+            return a.xy0.x < b.xy0.x;
+        });
+    } else {
+        std::sort(rects.begin(), rects.end(), [](const xy32xy32& a, const xy32xy32& b) {
+            if (a.xy0.x != b.xy0.x) return a.xy0.x < b.xy0.x;
+            if (a.xy1.x != b.xy1.x) return a.xy1.x < b.xy1.x;
+            return a.xy0.y < b.xy0.y;
+        });
+    }
+    size_t out = 0;
+    for (size_t i = 0; i < rects.size(); i++) {
+        if (out > 0) {
+            xy32xy32& last = rects[out - 1];
+            const xy32xy32& r = rects[i];
+            if (horizontal && last.xy0.y == r.xy0.y && last.xy1.y == r.xy1.y && last.xy1.x == r.xy0.x) {
+                last.xy1.x = r.xy1.x;
+                continue;
+            }
+            if (!horizontal && last.xy0.x == r.xy0.x && last.xy1.x == r.xy1.x && last.xy1.y == r.xy0.y) {
+                last.xy1.y = r.xy1.y;
+                continue;
+            }
+        }
+        rects[out++] = rects[i];
+    }
+    bool changed = out != rects.size();
+    rects.resize(out);
+    return changed;
+}
+
+size_t rectmerge::merge_full_edges(std::vector<xy32xy32>& rects) {
+    const size_t before = rects.size();
+    bool changed;
+    do {
+        changed = merge_pass(rects, true);
+        changed = merge_pass(rects, false) || changed;
+    } while (changed);
+    return before - rects.size();
+}
+
+// Splits 'longer' at 'split' along the shared axis, grows 'shorter' over the matching part and stores the remainder in 'longer'.
+// 'a' is always the left/upper rectangle, 'b' the right/lower one.
+static void split_pair(xy32xy32& a, xy32xy32& b, bool horizontal, bool aligned_at_start) {
+    if (horizontal) {
+        const int ha = a.xy1.y - a.xy0.y;
+        const int hb = b.xy1.y - b.xy0.y;
+        xy32xy32 merged, rest;
+        if (ha < hb) {
+            merged = xy32xy32{ { a.xy0.x, a.xy0.y },{ b.xy1.x, a.xy1.y } };
+            rest = aligned_at_start
+                ? xy32xy32{ { b.xy0.x, a.xy1.y },{ b.xy1.x, b.xy1.y } }
+                : xy32xy32{ { b.xy0.x, b.xy0.y },{ b.xy1.x, a.xy0.y } };
+        } else {
+            merged = xy32xy32{ { a.xy0.x, b.xy0.y },{ b.xy1.x, b.xy1.y } };
+            rest = aligned_at_start
+                ? xy32xy32{ { a.xy0.x, b.xy1.y },{ a.xy1.x, a.xy1.y } }
+                : xy32xy32{ { a.xy0.x, a.xy0.y },{ a.xy1.x, b.xy0.y } };
+        }
+        a = merged;
+        b = rest;
+    } else {
+        const int wa = a.xy1.x - a.xy0.x;
+        const int wb = b.xy1.x - b.xy0.x;
+        xy32xy32 merged, rest;
+        if (wa < wb) {
+            merged = xy32xy32{ { a.xy0.x, a.xy0.y },{ a.xy1.x, b.xy1.y } };
+            rest = aligned_at_start
+                ? xy32xy32{ { a.xy1.x, b.xy0.y },{ b.xy1.x, b.xy1.y } }
+                : xy32xy32{ { b.xy0.x, b.xy0.y },{ a.xy0.x, b.xy1.y } };
+        } else {
+            merged = xy32xy32{ { b.xy0.x, a.xy0.y },{ b.xy1.x, b.xy1.y } };
+            rest = aligned_at_start
+                ? xy32xy32{ { b.xy1.x, a.xy0.y },{ a.xy1.x, a.xy1.y } }
+                : xy32xy32{ { a.xy0.x, a.xy0.y },{ b.xy0.x, a.xy1.y } };
+        }
+        a = merged;
+        b = rest;
+    }
+}
+
+static size_t split_round(std::vector<xy32xy32>& rects) {
+    std::unordered_map<uint64_t, size_t> top_left, bottom_left, top_right;
+    top_left.reserve(rects.size());
+    bottom_left.reserve(rects.size());
+    top_right.reserve(rects.size());
+    for (size_t i = 0; i < rects.size(); i++) {
+        top_left[corner_key(rects[i].xy0.x, rects[i].xy0.y)] = i;
+        bottom_left[corner_key(rects[i].xy0.x, rects[i].xy1.y)] = i;
+        top_right[corner_key(rects[i].xy1.x, rects[i].xy0.y)] = i;
+    }
+    std::vector<char> used(rects.size(), 0);
+    size_t split_count = 0;
+    auto try_pair = [&](size_t ai, const std::unordered_map<uint64_t, size_t>& index, uint64_t key, bool horizontal, bool aligned_at_start) {
+        auto it = index.find(key);
+        if (it == index.end() || used[ai] || used[it->second] || it->second == ai) {
+            return;
+        }
+        xy32xy32& a = rects[ai];
+        xy32xy32& b = rects[it->second];
+        // the pair must actually touch along the split axis and must not already be a full-edge match
+        if (horizontal && (a.xy1.x != b.xy0.x || (a.xy0.y == b.xy0.y && a.xy1.y == b.xy1.y))) {
+            return;
+        }
+        if (!horizontal && (a.xy1.y != b.xy0.y || (a.xy0.x == b.xy0.x && a.xy1.x == b.xy1.x))) {
+            return;
+        }
+        split_pair(a, b, horizontal, aligned_at_start);
+        used[ai] = 1;
+        used[it->second] = 1;
+        split_count++;
+    };
+    for (size_t i = 0; i < rects.size(); i++) {
+        const xy32xy32 a = rects[i];
+        // right neighbor sharing the top or bottom edge line
+        try_pair(i, top_left, corner_key(a.xy1.x, a.xy0.y), true, true);
+        try_pair(i, bottom_left, corner_key(a.xy1.x, a.xy1.y), true, false);
+        // lower neighbor sharing the left or right edge line
+        try_pair(i, top_left, corner_key(a.xy0.x, a.xy1.y), false, true);
+        try_pair(i, top_right, corner_key(a.xy1.x, a.xy1.y), false, false);
+    }
+    return split_count;
+}
+
+size_t rectmerge::split_and_remerge(std::vector<xy32xy32>& rects, int max_rounds) {
+    const size_t before = rects.size();
+    merge_full_edges(rects);
+    for (int round = 0; round < max_rounds; round++) {
+        std::vector<xy32xy32> candidate(rects);
+        size_t split_count = split_round(candidate);
+        merge_full_edges(candidate);
+        printf("  Split round %d: %zu splits, %zu -> %zu rectangles\n", round + 1, split_count, rects.size(), candidate.size());
+        if (split_count == 0 || candidate.size() >= rects.size()) {
+            break;
+        }
+        rects.swap(candidate);
+    }
+    return before - rects.size();
+}
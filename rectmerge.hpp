@@ -0,0 +1,15 @@
+#pragma once
+
+#include "xy.hpp"
+
+namespace rectmerge {
+    // Merges rectangles sharing a full edge (same span on the shared side) until nothing changes.
+    // Input rectangles must not overlap. Returns the number of rectangles removed.
+    size_t merge_full_edges(std::vector<xy32xy32>& rects);
+
+    // Count-neutral split-and-remerge heuristic: when two rectangles touch along a partial edge that
+    // starts (or ends) at the same coordinate, the longer one is split so the matching part can be merged
+    // with the shorter one. A round is kept only if the following full-edge merge ends up with fewer
+    // rectangles than before. Returns the number of rectangles removed.
+    size_t split_and_remerge(std::vector<xy32xy32>& rects, int max_rounds = 8);
+}
@@ -0,0 +1,141 @@
+#include "precompiled.hpp"
+#include "rectpatch.hpp"
+#include "rectmerge.hpp"
+
+using namespace astarrtree;
+
+// Largest rectangle of covered pixels, by the histogram-stack scan over every row; area 0 when nothing is left.
+static xy32xy32 largest_rect(const std::vector<uint8_t>& mask, int w, int h, int64_t& best_area) {
+    std::vector<int> hist(w, 0);
+    std::vector<int> stack;
+    xy32xy32 best = { { 0, 0 }, { 0, 0 } };
+    best_area = 0;
+    for (int y = 0; y < h; y++) {
+        const uint8_t* row = &mask[static_cast<size_t>(y) * w];
+        for (int x = 0; x < w; x++) {
+            hist[x] = row[x] ? hist[x] + 1 : 0;
+        }
+        stack.clear();
+        for (int x = 0; x <= w; x++) {
+            const int height = x < w ? hist[x] : 0;
+            while (!stack.empty() && hist[stack.back()] >= height) {
+                const int top = hist[stack.back()];
+                stack.pop_back();
+                const int left = stack.empty() ? 0 : stack.back() + 1;
+                const int64_t area = static_cast<int64_t>(top) * (x - left);
+                if (area > best_area) {
+                    best_area = area;
+                    best = xy32xy32{ { left, y + 1 - top }, { x, y + 1 } };
+                }
+            }
+            stack.push_back(x);
+        }
+    }
+    return best;
+}
+
+void astarrtree::decompose_max_rects(std::vector<uint8_t>& mask, int w, int h, std::vector<xy32xy32>& rects) {
+    for (;;) {
+        int64_t area;
+        const xy32xy32 r = largest_rect(mask, w, h, area);
+        if (area == 0) {
+            break;
+        }
+        for (int y = r.xy0.y; y < r.xy1.y; y++) {
+            std::fill(&mask[static_cast<size_t>(y) * w + r.xy0.x], &mask[static_cast<size_t>(y) * w + r.xy1.x], 0);
+        }
+        rects.push_back(r);
+    }
+}
+
+// Appends the parts of 'c' outside 'window' to 'out': full-width strips above and below, the rest beside it.
+static void append_outside(const xy32xy32& c, const xy32xy32& window, std::vector<xy32xy32>& out) {
+    const int y0 = std::max(c.xy0.y, window.xy0.y);
+    const int y1 = std::min(c.xy1.y, window.xy1.y);
+    if (c.xy0.y < window.xy0.y) {
+        out.push_back(xy32xy32{ c.xy0, { c.xy1.x, window.xy0.y } });
+    }
+    if (c.xy1.y > window.xy1.y) {
+        out.push_back(xy32xy32{ { c.xy0.x, window.xy1.y }, c.xy1 });
+    }
+    if (c.xy0.x < window.xy0.x) {
+        out.push_back(xy32xy32{ { c.xy0.x, y0 }, { window.xy0.x, y1 } });
+    }
+    if (c.xy1.x > window.xy1.x) {
+        out.push_back(xy32xy32{ { window.xy1.x, y0 }, { c.xy1.x, y1 } });
+    }
+}
+
+// Inserts 'rects' with ids after the largest in use (ids of earlier builds and patches are not dense).
+static void insert_rects(rtree_t* rtree_ptr, const std::vector<xy32xy32>& rects) {
+    int id = -1;
+    for (auto it = rtree_ptr->begin(); it != rtree_ptr->end(); ++it) {
+        id = std::max(id, it->second);
+    }
+    for (const auto& r : rects) {
+        rtree_ptr->insert(std::make_pair(box_t(point_t(r.xy0.x, r.xy0.y), point_t(r.xy1.x, r.xy1.y)), ++id));
+    }
+}
+
+rect_patch astarrtree::patch_rtree(rtree_t* rtree_ptr, const xy32xy32& window, std::vector<uint8_t>& mask) {
+    rect_patch patch;
+    patch.window = window;
+    const int w = window.xy1.x - window.xy0.x;
+    const int h = window.xy1.y - window.xy0.y;
+
+    std::vector<value_t> result_s;
+    rtree_ptr->query(bgi::intersects(box_t(point_t(window.xy0.x, window.xy0.y), point_t(window.xy1.x, window.xy1.y))),
+                     std::back_inserter(result_s));
+    for (const auto& v : result_s) {
+        const xy32xy32 c = { { v.first.min_corner().get<0>(), v.first.min_corner().get<1>() },
+                             { v.first.max_corner().get<0>(), v.first.max_corner().get<1>() } };
+        // cells only touching the window along an edge stay
+        if (c.xy1.x <= window.xy0.x || c.xy0.x >= window.xy1.x || c.xy1.y <= window.xy0.y || c.xy0.y >= window.xy1.y) {
+            continue;
+        }
+        rtree_ptr->remove(v);
+        patch.removed.push_back(c);
+        // the parts outside the window did not change
+        append_outside(c, window, patch.inserted);
+    }
+
+    const size_t strip_count = patch.inserted.size();
+    decompose_max_rects(mask, w, h, patch.inserted);
+    for (size_t i = strip_count; i < patch.inserted.size(); i++) {
+        xy32xy32& r = patch.inserted[i];
+        r.xy0.x += window.xy0.x;
+        r.xy0.y += window.xy0.y;
+        r.xy1.x += window.xy0.x;
+        r.xy1.y += window.xy0.y;
+    }
+    rectmerge::merge_full_edges(patch.inserted);
+    insert_rects(rtree_ptr, patch.inserted);
+    return patch;
+}
+
+rect_patch astarrtree::split_rtree(rtree_t* rtree_ptr, const xy32xy32& box) {
+    rect_patch patch;
+    patch.window = box;
+    std::vector<value_t> result_s;
+    rtree_ptr->query(bgi::intersects(box_t(point_t(box.xy0.x, box.xy0.y), point_t(box.xy1.x, box.xy1.y))),
+                     std::back_inserter(result_s));
+    for (const auto& v : result_s) {
+        const xy32xy32 c = { { v.first.min_corner().get<0>(), v.first.min_corner().get<1>() },
+                             { v.first.max_corner().get<0>(), v.first.max_corner().get<1>() } };
+        // cells only touching the box along an edge and cells inside it stay
+        if (c.xy1.x <= box.xy0.x || c.xy0.x >= box.xy1.x || c.xy1.y <= box.xy0.y || c.xy0.y >= box.xy1.y) {
+            continue;
+        }
+        if (c.xy0.x >= box.xy0.x && c.xy1.x <= box.xy1.x && c.xy0.y >= box.xy0.y && c.xy1.y <= box.xy1.y) {
+            continue;
+        }
+        rtree_ptr->remove(v);
+        patch.removed.push_back(c);
+        patch.inserted.push_back(xy32xy32{ { std::max(c.xy0.x, box.xy0.x), std::max(c.xy0.y, box.xy0.y) },
+                                           { std::min(c.xy1.x, box.xy1.x), std::min(c.xy1.y, box.xy1.y) } });
+        append_outside(c, box, patch.inserted);
+    }
+    // no merging: a merge could join a part inside the box with one outside again
+    insert_rects(rtree_ptr, patch.inserted);
+    return patch;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "astarrtree.hpp"
+
+namespace astarrtree {
+    // Cells replaced by patch_rtree: the old cells overlapping the dirty window and the cells inserted for them.
+    struct rect_patch {
+        xy32xy32 window;
+        std::vector<xy32xy32> removed;
+        std::vector<xy32xy32> inserted;
+    };
+
+    // Greedy max-rect decomposition of a w x h mask (row-major, non-zero pixels are covered), as dump_max_rect
+    // does for a whole raster: the largest rectangle is taken until no pixel is left. 'mask' is cleared.
+    // Rectangles are appended to 'rects' in mask coordinates.
+    void decompose_max_rects(std::vector<uint8_t>& mask, int w, int h, std::vector<xy32xy32>& rects);
+
+    // Applies a raster edit without rebuilding the R-tree: the cells overlapping 'window' are removed, the parts
+    // of them outside the window are kept as strips, the window is decomposed again from 'mask' (window-sized,
+    // row-major, non-zero for pixels the R-tree should cover) and everything is merged along full edges before
+    // being inserted. Cells elsewhere are untouched. Tables describing the old cells go stale: follow up with
+    // rect_graph::apply_patch and landmark_table::refresh, rebuild cell width tables and clear route caches.
+    rect_patch patch_rtree(rtree_t* rtree_ptr, const xy32xy32& window, std::vector<uint8_t>& mask);
+
+    // Splits the cells crossing the edge of 'box' into the part inside it and strips outside, so that every cell
+    // lies either inside the box or outside it; the covered pixels stay the same. Used to close an area exactly
+    // (see dstar_lite); follow up as for patch_rtree.
+    rect_patch split_rtree(rtree_t* rtree_ptr, const xy32xy32& box);
+}
@@ -0,0 +1,84 @@
+#include "precompiled.hpp"
+#include "routecache.hpp"
+
+using namespace astarrtree;
+
+size_t route_cache::key_hash::operator()(const key& k) const {
+    size_t h = 0;
+    auto combine = [&h](size_t v) {
+        h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    };
+    combine(std::hash<int>()(k.from_cell.x));
+    combine(std::hash<int>()(k.from_cell.y));
+    combine(std::hash<int>()(k.to_cell.x));
+    combine(std::hash<int>()(k.to_cell.y));
+    combine(std::hash<int>()(k.from.x));
+    combine(std::hash<int>()(k.from.y));
+    combine(std::hash<int>()(k.to.x));
+    combine(std::hash<int>()(k.to.y));
+    combine(std::hash<int>()(static_cast<int>(k.costs) * 2 + (k.wrap ? 1 : 0)));
+    combine(std::hash<const void*>()(k.landmarks));
+    return h;
+}
+
+bool route_cache::key_equal::operator()(const key& a, const key& b) const {
+    return a.from_cell.x == b.from_cell.x && a.from_cell.y == b.from_cell.y
+        && a.to_cell.x == b.to_cell.x && a.to_cell.y == b.to_cell.y
+        && a.from.x == b.from.x && a.from.y == b.from.y && a.to.x == b.to.x && a.to.y == b.to.y
+        && a.costs == b.costs && a.wrap == b.wrap && a.landmarks == b.landmarks;
+}
+
+// The path, the list node and the hash map node with its bucket pointer.
+size_t route_cache::entry_bytes(const entry& e) {
+    return sizeof(entry) + 2 * sizeof(void*)
+        + e.cells.capacity() * sizeof(xy32xy32)
+        + sizeof(std::pair<key, entry_iterator>) + 2 * sizeof(void*);
+}
+
+route_cache::route_cache(size_t max_bytes)
+    : max_bytes(max_bytes) {
+}
+
+bool route_cache::find(const key& k, std::vector<xy32xy32>& cells) {
+    auto it = index.find(k);
+    if (it == index.end()) {
+        misses++;
+        return false;
+    }
+    hits++;
+    entries.splice(entries.begin(), entries, it->second);
+    cells = it->second->cells;
+    return true;
+}
+
+void route_cache::insert(const key& k, const std::vector<xy32xy32>& cells) {
+    auto it = index.find(k);
+    if (it != index.end()) {
+        bytes -= entry_bytes(*it->second);
+        entries.erase(it->second);
+        index.erase(it);
+    }
+    entries.push_front(entry{ k, cells });
+    entries.front().cells.shrink_to_fit();
+    index[k] = entries.begin();
+    bytes += entry_bytes(entries.front());
+    // the newest entry stays even when it alone is over the budget
+    while (bytes > max_bytes && entries.size() > 1) {
+        bytes -= entry_bytes(entries.back());
+        index.erase(entries.back().k);
+        entries.pop_back();
+        evictions++;
+    }
+}
+
+void route_cache::clear() {
+    entries.clear();
+    index.clear();
+    bytes = 0;
+}
+
+void route_cache::print_stats() const {
+    const size_t lookups = hits + misses;
+    printf("Route cache: %zu entries, %.1f KB of %.1f KB, %zu hits / %zu lookups (%.1f%%), %zu evictions\n",
+           entries.size(), bytes / 1024.0, max_bytes / 1024.0, hits, lookups, lookups ? 100.0 * hits / lookups : 0.0, evictions);
+}
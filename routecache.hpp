@@ -0,0 +1,62 @@
+#pragma once
+
+#include "astarrtree.hpp"
+
+namespace astarrtree {
+    // Least-recently-used cache of cell paths keyed by the endpoints and the search settings that change the path.
+    // Under distance costs each cell is entered at the pixel nearest to where the path stands, so the path depends
+    // on the endpoint pixels, not just their cells: those keys hold the exact pixels and only a repeated query
+    // (a port pair snapped to the same water pixels, say) hits. Unit-cost paths only depend on the cells.
+    // A hit skips the cell search; only the waypoint refinement runs again.
+    // Entries belong to one R-tree and are not checked against it: clear() the cache after patch_rtree.
+    // Entries are evicted once their estimated memory exceeds 'max_bytes'. Not thread-safe.
+    class route_cache {
+    public:
+        struct key {
+            xy32 from_cell;     // top-left corners identify cells
+            xy32 to_cell;
+            xy32 from;          // endpoint pixels; (0, 0) for CM_UNIT
+            xy32 to;
+            cost_model costs;
+            bool wrap;
+            // table the search was bounded with (or null); tables are told apart by identity
+            const landmark_table* landmarks;
+        };
+
+        explicit route_cache(size_t max_bytes);
+
+        // Copies the cached path into 'cells' and marks it most recently used.
+        bool find(const key& k, std::vector<xy32xy32>& cells);
+        void insert(const key& k, const std::vector<xy32xy32>& cells);
+        void clear();
+
+        size_t get_hits() const { return hits; }
+        size_t get_misses() const { return misses; }
+        size_t get_evictions() const { return evictions; }
+        size_t get_entry_count() const { return entries.size(); }
+        size_t get_bytes() const { return bytes; }
+        void print_stats() const;
+    private:
+        struct entry {
+            key k;
+            std::vector<xy32xy32> cells;
+        };
+        struct key_hash {
+            size_t operator()(const key& k) const;
+        };
+        struct key_equal {
+            bool operator()(const key& a, const key& b) const;
+        };
+        typedef std::list<entry>::iterator entry_iterator;
+        static size_t entry_bytes(const entry& e);
+
+        size_t max_bytes;
+        size_t bytes = 0;
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        // most recently used first
+        std::list<entry> entries;
+        std::unordered_map<key, entry_iterator, key_hash, key_equal> index;
+    };
+}
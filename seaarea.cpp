@@ -0,0 +1,176 @@
+#include "precompiled.hpp"
+#include "seaarea.hpp"
+#include "parallel.hpp"
+
+using namespace seaarea;
+
+bool sea_area_index::load(const char* filename) {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) {
+        std::cerr << "Sea area file " << filename << " could not be opened" << std::endl;
+        return false;
+    }
+    areas.clear();
+    grids.clear();
+    bbox_rtree.clear();
+    bool ok = true;
+    for (;;) {
+        char name[128];
+        float bbox[4];
+        int counts[2];
+        if (fread(name, sizeof(name), 1, fp) != 1) {
+            break;
+        }
+        if (fread(bbox, sizeof(bbox), 1, fp) != 1 || fread(counts, sizeof(counts), 1, fp) != 1
+            || counts[0] < 0 || counts[1] < 0) {
+            ok = false;
+            break;
+        }
+        sea_area a;
+        a.name = std::string(name, std::find(name, name + sizeof(name), '\0'));
+        a.bbox = lnglat_box_t(lnglat_t(bbox[0], bbox[1]), lnglat_t(bbox[2], bbox[3]));
+        a.parts.resize(counts[0]);
+        a.lng.resize(counts[1]);
+        a.lat.resize(counts[1]);
+        if ((counts[0] && fread(&a.parts[0], sizeof(int), counts[0], fp) != static_cast<size_t>(counts[0]))
+            || (counts[1] && fread(&a.lng[0], sizeof(float), counts[1], fp) != static_cast<size_t>(counts[1]))
+            || (counts[1] && fread(&a.lat[0], sizeof(float), counts[1], fp) != static_cast<size_t>(counts[1]))) {
+            ok = false;
+            break;
+        }
+        areas.push_back(std::move(a));
+    }
+    fclose(fp);
+    if (!ok) {
+        std::cerr << "Sea area file " << filename << " is truncated after " << areas.size() << " areas" << std::endl;
+        return false;
+    }
+
+    grids.resize(areas.size());
+    parallel::parallel_for(areas.size(), [&](size_t i) {
+        build_grid(areas[i], grids[i]);
+    });
+    std::vector<std::pair<lnglat_box_t, int> > boxes;
+    boxes.reserve(areas.size());
+    for (size_t i = 0; i < areas.size(); i++) {
+        boxes.push_back(std::make_pair(areas[i].bbox, static_cast<int>(i)));
+    }
+    // packing constructor: bulk loading gives a better tree than inserting one by one
+    bbox_rtree = bgi::rtree<std::pair<lnglat_box_t, int>, bgi::rstar<16> >(boxes.begin(), boxes.end());
+    return true;
+}
+
+void sea_area_index::build_grid(const sea_area& a, edge_grid& grid) const {
+    std::vector<edge> all;
+    all.reserve(a.lng.size());
+    for (size_t p = 0; p < a.parts.size(); p++) {
+        const size_t begin = static_cast<size_t>(a.parts[p]);
+        const size_t end = p + 1 < a.parts.size() ? static_cast<size_t>(a.parts[p + 1]) : a.lng.size();
+        if (begin >= end || end > a.lng.size()) {
+            continue;
+        }
+        // shapefile rings repeat the first point at the end; closing explicitly covers rings that do not
+        for (size_t i = begin; i < end; i++) {
+            const size_t j = i + 1 < end ? i + 1 : begin;
+            if (a.lat[i] != a.lat[j]) {
+                all.push_back(edge{ a.lng[i], a.lat[i], a.lng[j], a.lat[j] });
+            }
+        }
+    }
+    grid.y_min = a.bbox.min_corner().get<1>();
+    const float height = a.bbox.max_corner().get<1>() - grid.y_min;
+    // about four edges per band on average
+    const size_t band_count = std::max<size_t>(1, std::min<size_t>(4096, all.size() / 4));
+    grid.band_height = height > 0 ? height / band_count : 1.0f;
+    auto band_of = [&](float y) {
+        const int b = static_cast<int>((y - grid.y_min) / grid.band_height);
+        return static_cast<size_t>(std::min(std::max(b, 0), static_cast<int>(band_count) - 1));
+    };
+    grid.offsets.assign(band_count + 1, 0);
+    for (const auto& e : all) {
+        for (size_t b = band_of(std::min(e.y0, e.y1)); b <= band_of(std::max(e.y0, e.y1)); b++) {
+            grid.offsets[b + 1]++;
+        }
+    }
+    for (size_t b = 0; b < band_count; b++) {
+        grid.offsets[b + 1] += grid.offsets[b];
+    }
+    grid.edges.resize(grid.offsets[band_count]);
+    std::vector<uint32_t> fill(grid.offsets.begin(), grid.offsets.end() - 1);
+    for (const auto& e : all) {
+        for (size_t b = band_of(std::min(e.y0, e.y1)); b <= band_of(std::max(e.y0, e.y1)); b++) {
+            grid.edges[fill[b]++] = e;
+        }
+    }
+}
+
+bool sea_area_index::contains(int id, float lat, float lng) const {
+    const edge_grid& grid = grids[id];
+    const int band_count = static_cast<int>(grid.offsets.size()) - 1;
+    const int b = std::min(std::max(static_cast<int>((lat - grid.y_min) / grid.band_height), 0), band_count - 1);
+    // crossing number of a ray towards +longitude; (y0 > lat) != (y1 > lat) counts a vertex on the ray once
+    bool inside = false;
+    for (uint32_t i = grid.offsets[b]; i < grid.offsets[b + 1]; i++) {
+        const edge& e = grid.edges[i];
+        if ((e.y0 > lat) != (e.y1 > lat)) {
+            const float x = e.x0 + (lat - e.y0) * (e.x1 - e.x0) / (e.y1 - e.y0);
+            if (lng < x) {
+                inside = !inside;
+            }
+        }
+    }
+    return inside;
+}
+
+int sea_area_index::find(float lat, float lng) const {
+    int best = -1;
+    for (auto it = bbox_rtree.qbegin(bgi::intersects(lnglat_t(lng, lat))); it != bbox_rtree.qend(); ++it) {
+        const int id = it->second;
+        if ((best < 0 || id < best) && contains(id, lat, lng)) {
+            best = id;
+        }
+    }
+    return best;
+}
+
+std::vector<int> sea_area_index::classify(const std::vector<std::pair<float, float> >& points) const {
+    std::vector<int> result(points.size());
+    parallel::parallel_for_range(points.size(), 4096, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            result[i] = find(points[i].first, points[i].second);
+        }
+    });
+    return result;
+}
+
+std::vector<int> sea_area_index::along_route(const std::vector<xy32>& waypoints, int width, float step) const {
+    std::vector<int> crossed;
+    auto visit = [&](float x, float y) {
+        float lat, lng;
+        astarrtree::pixel_to_lat_lng(x, y, width, lat, lng);
+        const int id = find(lat, lng);
+        if (id >= 0 && (crossed.empty() || crossed.back() != id)) {
+            crossed.push_back(id);
+        }
+    };
+    for (size_t i = 0; i < waypoints.size(); i++) {
+        const float x0 = waypoints[i].x + 0.5f, y0 = waypoints[i].y + 0.5f;
+        if (i + 1 == waypoints.size()) {
+            visit(x0, y0);
+            break;
+        }
+        // take the short way around when consecutive waypoints are on both sides of the seam
+        int dx = waypoints[i + 1].x - waypoints[i].x;
+        if (dx > width / 2) {
+            dx -= width;
+        } else if (dx < -width / 2) {
+            dx += width;
+        }
+        const int dy = waypoints[i + 1].y - waypoints[i].y;
+        const int samples = std::max(1, static_cast<int>(ceil(sqrt(static_cast<double>(dx) * dx + static_cast<double>(dy) * dy) / step)));
+        for (int s = 0; s < samples; s++) {
+            visit(x0 + dx * s / static_cast<float>(samples), y0 + dy * s / static_cast<float>(samples));
+        }
+    }
+    return crossed;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "astarrtree.hpp"
+
+namespace seaarea {
+    namespace bg = boost::geometry;
+    namespace bgm = bg::model;
+    namespace bgi = bg::index;
+
+    typedef bgm::point<float, 2, bg::cs::cartesian> lnglat_t;
+    typedef bgm::box<lnglat_t> lnglat_box_t;
+
+    // One IHO sea area polygon (crawler/seaarea/seaarea.py). Rings are closed point runs starting at
+    // each 'parts' index; holes are rings too, so the even-odd rule over all rings gives the interior.
+    struct sea_area {
+        std::string name;
+        lnglat_box_t bbox;
+        std::vector<int> parts;
+        std::vector<float> lng;
+        std::vector<float> lat;
+    };
+
+    // Point (longitude, latitude) -> sea area: a bbox R-tree selects candidate polygons, then a per-polygon
+    // edge grid of horizontal bands limits the crossing-number test to the edges of the point's band.
+    class sea_area_index {
+    public:
+        // Reads seaareas.dat: per area a '128s' name, '4f' bbox (min lng, min lat, max lng, max lat),
+        // part and point counts, the part start indices, then all longitudes and all latitudes.
+        bool load(const char* filename);
+
+        size_t size() const { return areas.size(); }
+        const sea_area& area(int id) const { return areas[id]; }
+        // Id of the area containing the point (the lowest id when areas overlap), or -1.
+        int find(float lat, float lng) const;
+        // find() for every (latitude, longitude) point, in parallel.
+        std::vector<int> classify(const std::vector<std::pair<float, float> >& points) const;
+        // Areas crossed by a pixel route on a whole-globe 2:1 equirectangular raster of 'width' pixels,
+        // in crossing order without repeats of consecutive areas. Segments are sampled every 'step' pixels
+        // and may cross the wrap seam.
+        std::vector<int> along_route(const std::vector<xy32>& waypoints, int width, float step = 1.0f) const;
+    private:
+        struct edge {
+            float x0, y0, x1, y1;
+        };
+        struct edge_grid {
+            float y_min;
+            float band_height;
+            std::vector<uint32_t> offsets;  // edges of band b are edges[offsets[b] .. offsets[b + 1])
+            std::vector<edge> edges;
+        };
+        void build_grid(const sea_area& a, edge_grid& grid) const;
+        bool contains(int id, float lat, float lng) const;
+
+        std::vector<sea_area> areas;
+        std::vector<edge_grid> grids;
+        bgi::rtree<std::pair<lnglat_box_t, int>, bgi::rstar<16> > bbox_rtree;
+    };
+}
@@ -1,8 +1,23 @@
 #include "precompiled.hpp"
 #include "MaxMatch.h"
 #include "AStar.h"
+#include "png_parallel.h"
 #include "xy.hpp"
 #include "astarrtree.hpp"
+#include "corridor.hpp"
+#include "rectgraph.hpp"
+#include "dstarlite.hpp"
+#include "rectpatch.hpp"
+#include "alternatives.hpp"
+#include "landmark.hpp"
+#include "routecache.hpp"
+#include "cellwidth.hpp"
+#include "placeindex.hpp"
+#include "seaarea.hpp"
+#include "vessel.hpp"
+#include "rectmerge.hpp"
+#include "dumpfile.hpp"
+#include "parallel.hpp"
 
 // --------------------------------
 // w0-h0 : 180 MB (8,636,451 nodes)
@@ -43,6 +58,7 @@ struct xy32v {
 typedef std::unordered_map<int, std::vector<xy32v> > int_xy32vvector_map;
 typedef std::vector<xy32xy32> xy32xy32vector;
 typedef std::set<xy32> xyset;
+typedef std::vector<xy32> xy32vector;
 typedef MaxMatch<std::string> MaxMatchString;
 typedef MaxMatch<int> MaxMatchInt;
 
@@ -91,6 +107,46 @@ namespace std {
 
 std::vector<RECTPIXEL> rect_pixel_set;
 
+// One bit per pixel with the same bit layout as a 1-bit PNG row (MSB first),
+// so a whole mask row can be applied to row_pointers with byte operations.
+struct pixel_bitmap {
+    int width = 0;
+    int height = 0;
+    size_t row_bytes = 0;
+    std::vector<png_byte> bits;
+
+    void reset(int w, int h) {
+        width = w;
+        height = h;
+        row_bytes = (static_cast<size_t>(w) + 7) / 8;
+        bits.assign(row_bytes * h, 0);
+    }
+    png_byte* row(int y) {
+        return &bits[row_bytes * y];
+    }
+    bool get(int x, int y) const {
+        return ((bits[row_bytes * y + x / 8] >> (7 - (x % 8))) & 1) != 0;
+    }
+    void set(int x, int y) {
+        bits[row_bytes * y + x / 8] |= (1 << (7 - (x % 8)));
+    }
+    // set pixels [x0, x1] (inclusive) on row y
+    void set_span(int x0, int x1, int y) {
+        png_byte* r = row(y);
+        int first_byte = x0 / 8;
+        int last_byte = x1 / 8;
+        png_byte first_mask = static_cast<png_byte>(0xff >> (x0 % 8));
+        png_byte last_mask = static_cast<png_byte>(0xff << (7 - (x1 % 8)));
+        if (first_byte == last_byte) {
+            r[first_byte] |= first_mask & last_mask;
+            return;
+        }
+        r[first_byte] |= first_mask;
+        memset(r + first_byte + 1, 0xff, last_byte - first_byte - 1);
+        r[last_byte] |= last_mask;
+    }
+};
+
 namespace bi = boost::interprocess;
 namespace bg = boost::geometry;
 namespace bgm = bg::model;
@@ -122,8 +178,9 @@ xy32xy32vector hori_lines;
 xy32xy32vector vert_lines;
 MaxMatchInt bipartite;
 int land_color_index;
-xyset cut_boundary_pixels;
-std::vector<xyset> seed_pixels;
+pixel_bitmap cut_boundary_pixels;
+std::vector<xy32vector> seed_pixels;
+dumpfile::dump_format dump_output_format = dumpfile::DF_RAW_XY32;
 #define PIXELBIT(row, x) (((((row)[(x) / 8] >> (7 - ((x) % 8))) & 1) == land_color_index) ? 1 : 0)
 #define PIXELSETBIT(row, x) (row)[(x) / 8] |= (1 << (7 - ((x) % 8)))
 #define PIXELCLEARBIT(row, x) (row)[(x) / 8] &= ~(1 << (7 - ((x) % 8)))
@@ -134,6 +191,7 @@ std::vector<xyset> seed_pixels;
 #define PIXELINVERTBITXY(x, y) PIXELINVERTBIT(row_pointers[(y)], (x))
 
 void write_dump_file(rtree_t * rtree_ptr, rtree_t::bounds_type &rtree_bounds, const char * dump_filename);
+void write_dump_rects(const char* dump_filename, std::vector<xy32xy32>& rects);
 void write_dump_file_32(rtree_t * rtree_ptr, rtree_t::bounds_type &rtree_bounds, const char * dump_filename);
 
 void abort_(const char * s, ...) {
@@ -146,52 +204,19 @@ void abort_(const char * s, ...) {
 }
 
 void write_png_file(const char *filename) {
-
-    FILE *fp = fopen(filename, "wb");
-    if (!fp) abort();
-
-    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!png) abort();
-
-    png_infop info = png_create_info_struct(png);
-    if (!info) abort();
-
-    if (setjmp(png_jmpbuf(png))) abort();
-
-    png_init_io(png, fp);
-
-    // Output is 1bit depth, palette format.
+    // Output is 1bit depth, palette format (palette of the source image, or white/black without one).
     int num_palette = 2;
-    png_colorp palettep;
-    png_get_PLTE(png_ptr, info_ptr, &palettep, &num_palette);
-    png_set_PLTE(png, info, palettep, num_palette);
-
-    png_set_IHDR(png,
-                 info,
-                 width, height,
-                 1,
-                 PNG_COLOR_TYPE_PALETTE,
-                 PNG_INTERLACE_NONE,
-                 PNG_COMPRESSION_TYPE_DEFAULT,
-                 PNG_FILTER_TYPE_DEFAULT
-    );
-    png_write_info(png, info);
-
-    // To remove the alpha channel for PNG_COLOR_TYPE_RGB format,
-    // Use png_set_filler().
-    //png_set_filler(png, 0, PNG_FILLER_AFTER);
-
-    png_write_image(png, row_pointers);
-    png_write_end(png, NULL);
-
-    /*
-    for(int y = 0; y < height; y++) {
-        free(row_pointers[y]);
+    png_color default_palette[] = { { 255, 255, 255 }, { 0, 0, 0 } };
+    png_colorp palettep = default_palette;
+    if (png_ptr && info_ptr) {
+        png_get_PLTE(png_ptr, info_ptr, &palettep, &num_palette);
     }
-    free(row_pointers);
-     */
 
-    fclose(fp);
+    PNGPARALLEL* writer = png_parallel_open(filename, width, height, 1, PNG_COLOR_TYPE_PALETTE, palettep, num_palette, nullptr);
+    for (int y = 0; y < height; y++) {
+        png_parallel_write_row(writer, row_pointers[y]);
+    }
+    png_parallel_close(writer);
 }
 
 void read_png_file(const char* file_name, png_byte red) {
@@ -606,8 +631,8 @@ void maximum_matching() {
         i++;
     }
     printf("Get total edge count: %zu\n", bipartite.getEdgeCount());
-    printf("Solving maximum matching using Hopcroft-Karp...\n");
-    int c(bipartite.hopcroftKarp());
+    printf("Solving maximum matching using Hopcroft-Karp (per connected component)...\n");
+    int c(bipartite.hopcroftKarpParallel());
     std::cout << "Match size: " << c << std::endl;
 
     if (verbose) {
@@ -619,6 +644,7 @@ void maximum_matching() {
         }
     }
     printf("Solving minimum vertex cover from maximum matching...\n");
+    cut_boundary_pixels.reset(width, height);
     MaxMatchInt::VertexIndexSet hori_min_vertex, vert_min_vertex;
     bipartite.findMinimumVertexCover(hori_min_vertex, vert_min_vertex);
     i = 1;
@@ -639,17 +665,17 @@ void maximum_matching() {
             hori_cut_count++;
 
             // cut boundary caching
-            xyset boundary_up, boundary_down;
+            xy32vector boundary_up, boundary_down;
             for (int k = it.xy0.x; k < it.xy1.x; k++) {
                 xy32 boundary;
                 boundary.x = k + 1;
                 boundary.y = it.xy0.y + 0;
-                cut_boundary_pixels.insert(boundary);
-                boundary_up.insert(boundary);
+                cut_boundary_pixels.set(boundary.x, boundary.y);
+                boundary_up.push_back(boundary);
 
                 boundary.y = it.xy0.y + 1;
-                cut_boundary_pixels.insert(boundary);
-                boundary_down.insert(boundary);
+                cut_boundary_pixels.set(boundary.x, boundary.y);
+                boundary_down.push_back(boundary);
             }
             seed_pixels.push_back(boundary_up);
             seed_pixels.push_back(boundary_down);
@@ -676,17 +702,17 @@ void maximum_matching() {
             // cut caching
             vert_cut_count++;
             // cut boundary caching
-            xyset boundary_left, boundary_right;
+            xy32vector boundary_left, boundary_right;
             for (int k = it.xy0.y; k < it.xy1.y; k++) {
                 xy32 boundary;
                 boundary.x = it.xy0.x + 0;
                 boundary.y = k + 1;
-                cut_boundary_pixels.insert(boundary);
-                boundary_left.insert(boundary);
+                cut_boundary_pixels.set(boundary.x, boundary.y);
+                boundary_left.push_back(boundary);
 
                 boundary.x = it.xy0.x + 1;
-                cut_boundary_pixels.insert(boundary);
-                boundary_right.insert(boundary);
+                cut_boundary_pixels.set(boundary.x, boundary.y);
+                boundary_right.push_back(boundary);
             }
             seed_pixels.push_back(boundary_left);
             seed_pixels.push_back(boundary_right);
@@ -700,84 +726,100 @@ void maximum_matching() {
     printf("Total vertical cut count: %d\n", vert_cut_count);
 }
 
+// Flood fill every seed into a segment, stopping at cut boundaries.
+// Visited/segment state lives in pixel bitmaps and the fill walks whole spans per row,
+// so memory is O(width * height / 8) and runtime is linear in the filled pixels.
 void propagate_seed_pixels() {
-    xyset covered;
-    std::vector<xyset> segment_list;
+    pixel_bitmap covered;
+    pixel_bitmap segments;
+    covered.reset(width, height);
+    segments.reset(width, height);
+    auto fillable = [&covered](int x, int y) {
+        return PIXELBITXY(x, y) != 0
+            && !covered.get(x, y)
+            && !cut_boundary_pixels.get(x, y);
+    };
+    size_t segment_count = 0;
+    xy32vector span_seeds;
     int seed_pixel_index = 0;
     for (const auto& seed : seed_pixels) {
         seed_pixel_index++;
         if (seed_pixel_index % 20000 == 0) {
             printf("Propagating seed pixel index %d...\n", seed_pixel_index);
         }
-        xyset segment;
         // this seed already covered by previous segments
         bool skip_this_seed = false;
         for (const auto& seed_pixel : seed) {
-            if (covered.find(seed_pixel) != covered.end()) {
+            if (covered.get(seed_pixel.x, seed_pixel.y)) {
                 skip_this_seed = true;
                 break;
             }
         }
         if (skip_this_seed) {
-            covered.insert(seed.cbegin(), seed.cend());
+            for (const auto& seed_pixel : seed) {
+                covered.set(seed_pixel.x, seed_pixel.y);
+            }
             continue;
         }
 
         // all seed pixels compose a segment
-        segment.insert(seed.cbegin(), seed.cend());
-        covered.insert(seed.cbegin(), seed.cend());
-
-        xyset start_seed = seed;
-        xyset new_seed;
-        do {
-            new_seed.clear();
-            for (const auto& pixel : start_seed) {
-                int offsets[][2] = { { -1, 0 },{ 1, 0 },{ 0, -1 },{ 0, 1 } };
-                for (const auto& off : offsets) {
-                    xy32 pixel_pos = { pixel.x + off[0], pixel.y + off[1] };
-                    // out of bounds
-                    if (pixel_pos.x < 0 || pixel_pos.x >= width || pixel_pos.y < 0 || pixel_pos.y >= height) {
-                        continue;
-                    }
-                    // cleared pixel
-                    if (PIXELBITXY(pixel_pos.x, pixel_pos.y) == 0) {
-                        continue;
-                    }
-                    // already covered
-                    if (covered.find(pixel_pos) != covered.end()) {
-                        continue;
-                    }
-                    // another seed boundary
-                    if (cut_boundary_pixels.find(pixel_pos) != cut_boundary_pixels.end()) {
-                        continue;
-                    }
-                    // new pixel found!
-                    covered.insert(pixel_pos);
-                    segment.insert(pixel_pos);
-                    new_seed.insert(pixel_pos);
+        span_seeds.clear();
+        for (const auto& seed_pixel : seed) {
+            covered.set(seed_pixel.x, seed_pixel.y);
+            segments.set(seed_pixel.x, seed_pixel.y);
+            int offsets[][2] = { { -1, 0 },{ 1, 0 },{ 0, -1 },{ 0, 1 } };
+            for (const auto& off : offsets) {
+                xy32 pixel_pos = { seed_pixel.x + off[0], seed_pixel.y + off[1] };
+                // out of bounds
+                if (pixel_pos.x < 0 || pixel_pos.x >= width || pixel_pos.y < 0 || pixel_pos.y >= height) {
+                    continue;
                 }
+                span_seeds.push_back(pixel_pos);
             }
-            start_seed = new_seed;
-        } while (start_seed.size() > 0);
-        if (segment.size() > 0) {
-            segment_list.push_back(segment);
         }
-    }
-    printf("Segment count: %zu\n", segment_list.size());
-    for (const auto& segment : segment_list) {
-        for (const auto& seg_pixel : segment) {
-            PIXELINVERTBITXY(seg_pixel.x, seg_pixel.y);
+
+        // scanline span fill
+        while (!span_seeds.empty()) {
+            xy32 p = span_seeds.back();
+            span_seeds.pop_back();
+            if (!fillable(p.x, p.y)) {
+                continue;
+            }
+            int x0 = p.x;
+            while (x0 > 0 && fillable(x0 - 1, p.y)) {
+                x0--;
+            }
+            int x1 = p.x;
+            while (x1 < width - 1 && fillable(x1 + 1, p.y)) {
+                x1++;
+            }
+            covered.set_span(x0, x1, p.y);
+            segments.set_span(x0, x1, p.y);
+            for (int ny = p.y - 1; ny <= p.y + 1; ny += 2) {
+                if (ny < 0 || ny >= height) {
+                    continue;
+                }
+                bool in_run = false;
+                for (int nx = x0; nx <= x1; nx++) {
+                    bool f = fillable(nx, ny);
+                    if (f && !in_run) {
+                        span_seeds.push_back(xy32{ nx, ny });
+                    }
+                    in_run = f;
+                }
+            }
         }
+        segment_count++;
     }
-    /*
-    for (y = 0; y < height; y++) {
+    printf("Segment count: %zu\n", segment_count);
+    const size_t row_bytes = (static_cast<size_t>(width) + 7) / 8;
+    for (int y = 0; y < height; y++) {
         png_byte* row = row_pointers[y];
-        int prev_b = 0;
-        int invert_count = 0;
-        for (x = 0; x < width; x++) {
-            int b = PIXELBIT(row, x);
+        png_byte* mask = segments.row(y);
+        for (size_t i = 0; i < row_bytes; i++) {
+            row[i] ^= mask[i];
         }
-    }*/
+    }
 }
 
 void first_pass() {
@@ -789,6 +831,27 @@ void first_pass() {
     propagate_seed_pixels();
 }
 
+// Records the width of the raster an R-tree file is built from, for rtree_raster_width().
+void record_raster_width(bi::managed_mapped_file& file, int raster_width) {
+    *file.find_or_construct<int>("raster_width")(0) = raster_width;
+}
+
+// Width of the raster behind the R-tree in 'file': 'given_width' when set (--rasterwidth), else the width recorded
+// when the file was built, else the right edge of the cells, which is only right when some cell reaches the right
+// raster edge.
+int rtree_raster_width(bi::managed_mapped_file& file, rtree_t* rtree_ptr, int given_width) {
+    if (given_width > 0) {
+        return given_width;
+    }
+    const int* recorded = file.find<int>("raster_width").first;
+    if (recorded) {
+        return *recorded;
+    }
+    const int bounds_width = rtree_ptr->size() ? rtree_ptr->bounds().max_corner().get<0>() : 0;
+    printf("No raster width recorded in the R-tree; using the right edge of its cells (%d), see --rasterwidth\n", bounds_width);
+    return bounds_width;
+}
+
 void second_pass(const char* output, size_t output_max_size) {
     int old_land_pixel_count = 0;
     for (int y = 0; y < height; y++) {
@@ -910,6 +973,7 @@ void second_pass(const char* output, size_t output_max_size) {
         }
         printf("Reconstructed pixel count: %d\n", reconstructed_pixel_count);
         printf("R Tree size: %zu\n", rtree_ptr->size());
+        record_raster_width(file, width);
     }
 }
 
@@ -950,27 +1014,252 @@ void create_worldmap_rtrees() {
     create_worldmap_rtree(DATA_ROOT "water_16384x8192.png", DATA_ROOT WORLDMAP_WATER_RTREE_FILENAME, WORLDMAP_WATER_RTREE_MMAP_MAX_SIZE, 255);
 }
 
+// TEST POS (WATER: SHORT ROUTE, VERY LONG, VERY LONG II)
+const xy32 water_benchmark_routes[][2] = {
+    { { 14065, 2496 },{ 14043, 2512 } },
+    { { 14065, 2496 },{ 2693, 2501 } },
+    { { 9553, 2240 },{ 14348, 1604 } },
+};
+
 void test_astar_rtree_water() {
-    {
-        // TEST POS (WATER: SHORT ROUTE)
-        xy32 pathFrom = { 14065, 2496 };
-        xy32 pathTo = { 14043, 2512 };
-        astarrtree::astar_rtree(DATA_ROOT WORLDMAP_WATER_MAX_RECT_RTREE_RTREE_FILENAME, WORLDMAP_WATER_RTREE_MMAP_MAX_SIZE, pathFrom, pathTo);
+    for (const auto& route : water_benchmark_routes) {
+        astarrtree::astar_rtree(DATA_ROOT WORLDMAP_WATER_MAX_RECT_RTREE_RTREE_FILENAME, WORLDMAP_WATER_RTREE_MMAP_MAX_SIZE, route[0], route[1]);
     }
-    {
-        // TEST POS (WATER: VERY LONG)
-        xy32 pathFrom = { 14065, 2496 };
-        xy32 pathTo = { 2693, 2501 };
-        astarrtree::astar_rtree(DATA_ROOT WORLDMAP_WATER_MAX_RECT_RTREE_RTREE_FILENAME, WORLDMAP_WATER_RTREE_MMAP_MAX_SIZE, pathFrom, pathTo);
+}
+
+// Runs the water benchmark routes (quietly) and returns the elapsed wall time in seconds.
+double benchmark_water_routes(rtree_t* rtree_ptr) {
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& route : water_benchmark_routes) {
+        astarrtree::search_options options;
+        options.verbose = false;
+        astarrtree::astar_rtree_memory(rtree_ptr, route[0], route[1], options);
     }
-    {
-        // TEST POS (WATER: VERY LONG II)
-        xy32 pathFrom = { 9553, 2240 };
-        xy32 pathTo = { 14348, 1604 };
-        astarrtree::astar_rtree(DATA_ROOT WORLDMAP_WATER_MAX_RECT_RTREE_RTREE_FILENAME, WORLDMAP_WATER_RTREE_MMAP_MAX_SIZE, pathFrom, pathTo);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Repetitive traffic: each water benchmark route 'repeats' times in turn, with its endpoints moved in turn to
+// one of three pixels spread across their cells (the given pixel and the centers of the cell's left and right
+// halves), as for different ports in the same open-water cell. Runs without, then with a route cache of
+// 'cache_bytes', and checks that every cached route is as long as the uncached one.
+void benchmark_route_cache(rtree_t* rtree_ptr, astarrtree::search_options options, size_t cache_bytes, int repeats) {
+    auto spread = [rtree_ptr](xy32 p, int k) {
+        xy32 pixel;
+        astarrtree::value_t cell;
+        if (k == 0 || !astarrtree::nearest_cell_pixel(rtree_ptr, p, pixel, &cell)) {
+            return p;
+        }
+        const int x0 = cell.first.min_corner().get<0>(), x1 = cell.first.max_corner().get<0>();
+        const int y0 = cell.first.min_corner().get<1>(), y1 = cell.first.max_corner().get<1>();
+        return xy32{ x0 + (x1 - x0) * (2 * k - 1) / 4, (y0 + y1 - 1) / 2 };
+    };
+    std::vector<std::pair<xy32, xy32> > queries;
+    for (int r = 0; r < repeats; r++) {
+        for (const auto& route : water_benchmark_routes) {
+            queries.push_back(std::make_pair(spread(route[0], r % 3), spread(route[1], r % 3)));
+        }
+    }
+    auto length = [](const std::vector<xy32>& waypoints) {
+        double l = 0;
+        for (size_t i = 1; i < waypoints.size(); i++) {
+            l += hypot(static_cast<double>(waypoints[i].x - waypoints[i - 1].x), static_cast<double>(waypoints[i].y - waypoints[i - 1].y));
+        }
+        return l;
+    };
+    options.verbose = false;
+    astarrtree::route_cache cache(cache_bytes);
+    std::vector<double> lengths(queries.size());
+    double max_difference = 0;
+    for (int cached = 0; cached < 2; cached++) {
+        options.cache = cached ? &cache : nullptr;
+        size_t waypoint_count = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < queries.size(); i++) {
+            const auto waypoints = astarrtree::astar_rtree_memory(rtree_ptr, queries[i].first, queries[i].second, options);
+            waypoint_count += waypoints.size();
+            if (cached) {
+                max_difference = std::max(max_difference, fabs(length(waypoints) - lengths[i]));
+            } else {
+                lengths[i] = length(waypoints);
+            }
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s: %zu queries, %zu waypoints, %.3f s (%.2f ms/query)\n", cached ? "Cached" : "Uncached",
+               queries.size(), waypoint_count, seconds, seconds * 1000 / queries.size());
+    }
+    cache.print_stats();
+    printf("Largest route length difference, cached against uncached: %.3f px\n", max_difference);
+}
+
+// Length of a waypoint polyline; with 'wrap_width' set, steps across the wrap seam take the short way.
+double polyline_length(const std::vector<xy32>& points, int wrap_width) {
+    double length = 0;
+    for (size_t i = 1; i < points.size(); i++) {
+        double dx = abs(points[i].x - points[i - 1].x);
+        if (wrap_width > 0) {
+            dx = std::min(dx, wrap_width - dx);
+        }
+        const double dy = points[i].y - points[i - 1].y;
+        length += sqrt(dx * dx + dy * dy);
+    }
+    return length;
+}
+
+// Runs the water benchmark routes with unit cell costs, Euclidean and geodesic entry-point costs
+// (and with the landmark table's cost model plus ALT bounds when 'landmarks' is set),
+// and prints the cells expanded, the time taken and the any-angle route length of each.
+void benchmark_cost_models(rtree_t* rtree_ptr, bool wrap, int raster_width, const astarrtree::landmark_table* landmarks) {
+    astarrtree::cost_model models[] = { astarrtree::CM_UNIT, astarrtree::CM_EUCLIDEAN, astarrtree::CM_GEODESIC, astarrtree::CM_EUCLIDEAN };
+    const char* model_names[] = { "Unit", "Euclidean", "Geodesic", "ALT" };
+    const int model_count = landmarks ? 4 : 3;
+    if (landmarks) {
+        models[3] = landmarks->get_cost_model();
+    }
+    const astarrtree::geodesic_metric metric(raster_width);
+    for (int m = 0; m < model_count; m++) {
+        size_t total_expanded = 0;
+        double total_length = 0;
+        double total_length_nm = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& route : water_benchmark_routes) {
+            size_t expanded = 0;
+            astarrtree::search_options options;
+            options.verbose = false;
+            options.waypoints = astarrtree::WM_ANY_ANGLE;
+            options.costs = models[m];
+            options.wrap = wrap;
+            options.raster_width = raster_width;
+            options.landmarks = m == 3 ? landmarks : nullptr;
+            options.expanded = &expanded;
+            auto waypoints = astarrtree::astar_rtree_memory(rtree_ptr, route[0], route[1], options);
+            const double length = polyline_length(waypoints, options.wrap ? raster_width : 0);
+            const double length_nm = metric.route_length_nm(waypoints);
+            printf("%s: route (%d,%d) -> (%d,%d): %zu cells expanded, length %.1f px, %.1f nm\n",
+                   model_names[m], route[0].x, route[0].y, route[1].x, route[1].y, expanded, length, length_nm);
+            total_expanded += expanded;
+            total_length += length;
+            total_length_nm += length_nm;
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s costs: %zu cells expanded, total length %.1f px, %.1f nm, %.3f s\n", model_names[m], total_expanded, total_length, total_length_nm, seconds);
     }
 }
 
+// Rasterizes the cells entered within 'max_cost' (black, whole cells) and writes them with write_png_file.
+// The image covers the R-tree bounds, or the whole 2:1 world raster when the graph wraps.
+void write_isochrone_png(const astarrtree::rect_graph& graph, const std::vector<float>& distances, float max_cost, const char* filename) {
+    int max_y = 0;
+    for (uint32_t id = 0; id < graph.size(); id++) {
+        max_y = std::max(max_y, graph.cell(id).xy1.y);
+    }
+    width = graph.get_width();
+    height = graph.get_wrap() ? std::max(max_y, width / 2) : max_y;
+    row_pointers = (png_bytep*)calloc(height, sizeof(png_bytep));
+    for (int y = 0; y < height; y++) {
+        row_pointers[y] = (png_byte*)calloc(1, (width + 7) / 8);
+    }
+    for (uint32_t id = 0; id < graph.size(); id++) {
+        if (distances[id] > max_cost) {
+            continue;
+        }
+        const xy32xy32& c = graph.cell(id);
+        for (int y = c.xy0.y; y < c.xy1.y; y++) {
+            for (int x = c.xy0.x; x < c.xy1.x; x++) {
+                PIXELSETBITXY(x, y);
+            }
+        }
+    }
+    write_png_file(filename);
+    for (int y = 0; y < height; y++) {
+        free(row_pointers[y]);
+    }
+    free(row_pointers);
+    row_pointers = nullptr;
+}
+
+// The rect_graph of the R-tree file 'rtree_filename', kept next to it as '<rtree>.graph' so later runs skip the
+// build; built and saved again when that file is missing or stale.
+void load_rect_graph(rtree_t* rtree_ptr, const char* rtree_filename, bool wrap, int raster_width, astarrtree::rect_graph& graph) {
+    const std::string graph_filename = std::string(rtree_filename) + ".graph";
+    if (!graph.load(rtree_ptr, wrap, raster_width, graph_filename.c_str())) {
+        graph.build(rtree_ptr, wrap, raster_width);
+        graph.save(graph_filename.c_str());
+    }
+}
+
+// Every cell reachable from 'source' within 'max_cost' (pixels, or nautical miles under the geodesic model).
+void isochrone(rtree_t* rtree_ptr, const char* rtree_filename, xy32 source, float max_cost, const astarrtree::search_options& options, const char* png_filename) {
+    astarrtree::rect_graph graph;
+    load_rect_graph(rtree_ptr, rtree_filename, options.wrap, options.raster_width, graph);
+    std::vector<float> distances;
+    auto start = std::chrono::steady_clock::now();
+    graph.one_to_all(source, options.costs, distances, nullptr, max_cost);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t reached = 0;
+    int64_t area = 0;
+    for (uint32_t id = 0; id < graph.size(); id++) {
+        if (distances[id] <= max_cost) {
+            const xy32xy32& c = graph.cell(id);
+            reached++;
+            area += static_cast<int64_t>(c.xy1.x - c.xy0.x) * (c.xy1.y - c.xy0.y);
+        }
+    }
+    printf("Isochrone from (%d, %d) within %.1f: %zu of %zu cells, %lld pixels, %.3f s\n",
+           source.x, source.y, max_cost, reached, graph.size(), static_cast<long long>(area), seconds);
+    if (png_filename) {
+        write_isochrone_png(graph, distances, max_cost, png_filename);
+        printf("Isochrone written to %s\n", png_filename);
+    }
+}
+
+// Resolves each ';'-separated query ("lat,lng", LOCODE, port or city name) to its nearest port and the
+// water pixel nearest to that port, as route endpoints.
+void snap_places(rtree_t* rtree_ptr, int raster_width, const char* ports_filename, const char* cities_filename, const std::string& queries) {
+    auto start = std::chrono::steady_clock::now();
+    const std::vector<placeindex::place> ports = placeindex::load_seaports(ports_filename);
+    const std::vector<placeindex::place> cities = cities_filename ? placeindex::load_cities(cities_filename) : std::vector<placeindex::place>();
+    if (ports.empty()) {
+        abort_("No ports loaded from %s.", ports_filename);
+    }
+    placeindex::snapper snapper(ports, cities, rtree_ptr, raster_width);
+    printf("Place index: %zu ports, %zu cities, %.3f ms\n", ports.size(), cities.size(),
+           std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+    std::vector<std::string> names;
+    boost::algorithm::split(names, queries, boost::is_any_of(";"));
+    std::vector<std::pair<float, float> > points;
+    std::vector<std::string> resolved_names;
+    for (const auto& name : names) {
+        float lat, lng;
+        start = std::chrono::steady_clock::now();
+        const bool resolved = snapper.resolve(name, lat, lng);
+        const placeindex::snap_result result = resolved ? snapper.snap(lat, lng) : placeindex::snap_result{ -1, 0, { 0, 0 } };
+        const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        if (!resolved) {
+            printf("'%s': unknown place\n", name.c_str());
+        } else if (result.port < 0) {
+            printf("'%s' (%.4f, %.4f): no port or water cell\n", name.c_str(), lat, lng);
+        } else {
+            const placeindex::place& port = snapper.port(result.port);
+            printf("'%s' (%.4f, %.4f) -> %s %s (%.1f nm) -> water (%d, %d), %.1f us\n", name.c_str(), lat, lng,
+                   port.code.c_str(), port.name.c_str(), result.port_distance_nm, result.water.x, result.water.y, us);
+            points.push_back(std::make_pair(lat, lng));
+        }
+    }
+    if (points.empty()) {
+        return;
+    }
+    // batch throughput: the resolved points repeated up to 100k queries
+    std::vector<std::pair<float, float> > batch;
+    while (batch.size() < 100000) {
+        batch.insert(batch.end(), points.begin(), points.end());
+    }
+    start = std::chrono::steady_clock::now();
+    const auto results = snapper.snap_batch(batch);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Batch snap: %zu points, %.3f s (%.2f us/point)\n", results.size(), seconds, seconds * 1e6 / results.size());
+}
+
 void test_astar_rtree_land() {
     {
         // TEST POS (LAND: VERY SHORT ROUTE - debugging)
@@ -1212,20 +1501,16 @@ void invert_area(int x, int y, int w, int h) {
 void load_from_dump_if_empty(rtree_t* rtree_ptr, const char* dump_filename) {
     if (rtree_ptr->size() == 0) {
         int rect_count = 0;
-        FILE* fin = fopen(dump_filename, "rb");
-        if (fin) {
-            size_t read_max_count = 100000; // elements
-            void* read_buf = malloc(sizeof(xy32xy32) * read_max_count);
-            fseek(fin, 0, SEEK_SET);
-            while (size_t read_count = fread(read_buf, sizeof(xy32xy32), read_max_count, fin)) {
-                for (size_t i = 0; i < read_count; i++) {
+        dumpfile::dump_view view;
+        if (view.open(dump_filename)) {
+            std::vector<xy32xy32> buffer;
+            for (size_t c = 0; c < view.chunk_count(); c++) {
+                for (const auto& r : view.chunk(c, buffer)) {
                     rect_count++;
-                    xy32xy32* r = reinterpret_cast<xy32xy32*>(read_buf) + i;
-                    box_t box(point_t(r->xy0.x, r->xy0.y), point_t(r->xy1.x, r->xy1.y));
+                    box_t box(point_t(r.xy0.x, r.xy0.y), point_t(r.xy1.x, r.xy1.y));
                     rtree_ptr->insert(std::make_pair(box, rect_count));
                 }
             }
-            fclose(fin);
             printf("Max rect R Tree size (after loaded from %s): %zu\n", dump_filename, rtree_ptr->size());
         } else {
             printf("Dump file %s not exist.\n", dump_filename);
@@ -1233,119 +1518,145 @@ void load_from_dump_if_empty(rtree_t* rtree_ptr, const char* dump_filename) {
     }
 }
 
+// Messages from one range of a parallel dump transform, reported in order after the join.
+struct transform_log {
+    std::vector<std::string> notes;
+    std::string error;
+};
+
+// Streams every rectangle of 'view' through f into 'writer', one chunk at a time.
+// f(rect, log) edits a copy of the rectangle in place and returns false to reject it; it runs on
+// worker threads, so it only fills 'log'. Notes are printed and the first error aborts after each chunk.
+template<typename F>
+void transform_dump(const dumpfile::dump_view& view, dumpfile::dump_writer& writer, F f) {
+    const size_t range_size = 65536;
+    std::vector<xy32xy32> buffer;
+    std::vector<xy32xy32> rects;
+    std::vector<transform_log> logs;
+    for (size_t c = 0; c < view.chunk_count(); c++) {
+        const auto span = view.chunk(c, buffer);
+        // decoded chunks are edited in their own buffer; raw ones are copied out of the read-only mapping
+        if (span.ptr == buffer.data()) {
+            rects.swap(buffer);
+        } else {
+            rects.assign(span.begin(), span.end());
+        }
+        const size_t range_count = (rects.size() + range_size - 1) / range_size;
+        logs.assign(range_count, transform_log());
+        parallel::parallel_for(range_count, [&](size_t r) {
+            const size_t end = std::min(rects.size(), (r + 1) * range_size);
+            for (size_t i = r * range_size; i < end; i++) {
+                if (!f(rects[i], logs[r])) {
+                    break;
+                }
+            }
+        });
+        for (const auto& log : logs) {
+            for (const auto& note : log.notes) {
+                printf("%s\n", note.c_str());
+            }
+            if (!log.error.empty()) {
+                abort_("%s", log.error.c_str());
+            }
+        }
+        writer.write(rects.data(), rects.size());
+    }
+}
+
+// Copies every rectangle of 'view' to 'writer' unchanged; raw xy32 input is written straight from the mapping.
+void copy_dump(const dumpfile::dump_view& view, dumpfile::dump_writer& writer) {
+    std::vector<xy32xy32> buffer;
+    for (size_t c = 0; c < view.chunk_count(); c++) {
+        writer.write(view.chunk(c, buffer));
+    }
+}
+
+void open_dump_writer_or_abort(dumpfile::dump_writer& writer, const char* output_filename) {
+    if (!writer.open(output_filename, dump_output_format)) {
+        abort_("fout invalid");
+    }
+}
+
+std::string format_rect_note(const char* prefix, const xy32xy32& r) {
+    return str(boost::format("%s(%d,%d)~(%d,%d) size = (%d,%d)")
+               % prefix
+               % r.xy0.x
+               % r.xy0.y
+               % r.xy1.x
+               % r.xy1.y
+               % (r.xy1.x - r.xy0.x)
+               % (r.xy1.y - r.xy0.y));
+}
+
 int dumpfix_offset_y = -2251;
 
 // move all rectangles to +Y direction by 2251 pixel
 void dumpfix_land(const char* dump_filename) {
-    size_t rect_count = 0;
-    FILE* fin = fopen(dump_filename, "rb");
+    dumpfile::dump_view view;
     char output_filename[1024];
     strcpy(output_filename, dump_filename);
     strcat(output_filename, "fix.dump");
-    FILE* fout = fopen(output_filename, "wb");
-    int min_x = INT_MAX;
-    int max_x = INT_MIN;
-    int min_y = INT_MAX;
-    int max_y = INT_MIN;
-    if (fin) {
-        size_t read_max_count = 100000; // elements
-        void* read_buf = malloc(sizeof(xy32xy32) * read_max_count);
-        fseek(fin, 0, SEEK_SET);
-        while (size_t read_count = fread(read_buf, sizeof(xy32xy32), read_max_count, fin)) {
-            for (size_t i = 0; i < read_count; i++) {
-                rect_count++;
-                xy32xy32* r = reinterpret_cast<xy32xy32*>(read_buf) + i;
-                if (min_x > r->xy0.x) {
-                    min_x = r->xy0.x;
-                }
-                if (max_x < r->xy1.x) {
-                    max_x = r->xy1.x;
-                }
-                if (min_y > r->xy0.y) {
-                    min_y = r->xy0.y;
-                }
-                if (max_y < r->xy1.y) {
-                    max_y = r->xy1.y;
-                }
-                if (r->xy0.y + dumpfix_offset_y < 0) {
-                    abort_("error duing offset fix");
-                }
-                if (r->xy1.y + dumpfix_offset_y < 0) {
-                    abort_("error duing offset fix");
-                }
-                // fix offset
-                r->xy0.y += dumpfix_offset_y;
-                r->xy1.y += dumpfix_offset_y;
+    if (view.open(dump_filename)) {
+        dumpfile::dump_writer writer;
+        open_dump_writer_or_abort(writer, output_filename);
+        transform_dump(view, writer, [](xy32xy32& r, transform_log& log) {
+            if (r.xy0.y + dumpfix_offset_y < 0) {
+                log.error = "error duing offset fix";
+                return false;
             }
-            fwrite(read_buf, read_count, sizeof(xy32xy32), fout);
-        }
-        fclose(fin);
-        fclose(fout);
+            if (r.xy1.y + dumpfix_offset_y < 0) {
+                log.error = "error duing offset fix";
+                return false;
+            }
+            // fix offset
+            r.xy0.y += dumpfix_offset_y;
+            r.xy1.y += dumpfix_offset_y;
+            return true;
+        });
+        writer.close();
     } else {
         printf("Dump file %s not exist.\n", dump_filename);
     }
 }
 
 void dumpfix_water(const char* dump_filename) {
-    size_t rect_count = 0;
-    FILE* fin = fopen(dump_filename, "rb");
+    dumpfile::dump_view view;
     char output_filename[1024];
     strcpy(output_filename, dump_filename);
     strcat(output_filename, "fix.dump");
-    FILE* fout = fopen(output_filename, "wb");
-    int min_x = INT_MAX;
-    int max_x = INT_MIN;
-    int min_y = INT_MAX;
-    int max_y = INT_MIN;
-    if (fin) {
-        size_t read_max_count = 100000; // elements
-        void* read_buf = malloc(sizeof(xy32xy32) * read_max_count);
-        fseek(fin, 0, SEEK_SET);
-        while (size_t read_count = fread(read_buf, sizeof(xy32xy32), read_max_count, fin)) {
-            for (size_t i = 0; i < read_count; i++) {
-                rect_count++;
-                xy32xy32* r = reinterpret_cast<xy32xy32*>(read_buf) + i;
-                if (r->xy0.y == 0) {
-                    printf("(?,0)~ point: (%d,%d)~(%d,%d) size = (%d,%d)\n",
-                           r->xy0.x,
-                           r->xy0.y,
-                           r->xy1.x,
-                           r->xy1.y,
-                           r->xy1.x - r->xy0.x,
-                           r->xy1.y - r->xy0.y);
-                    if (r->xy1.y + dumpfix_offset_y < 0) {
-                        abort_("Dumpfix input data cannot be processed.");
-                    }
-                }
-                if (r->xy1.y == 86412) {
-                    printf("~(?,86412): (%d,%d)~(%d,%d) size = (%d,%d)\n",
-                           r->xy0.x,
-                           r->xy0.y,
-                           r->xy1.x,
-                           r->xy1.y,
-                           r->xy1.x - r->xy0.x,
-                           r->xy1.y - r->xy0.y);
+    if (view.open(dump_filename)) {
+        dumpfile::dump_writer writer;
+        open_dump_writer_or_abort(writer, output_filename);
+        transform_dump(view, writer, [](xy32xy32& rect, transform_log& log) {
+            xy32xy32* r = &rect;
+            if (r->xy0.y == 0) {
+                log.notes.push_back(format_rect_note("(?,0)~ point: ", *r));
+                if (r->xy1.y + dumpfix_offset_y < 0) {
+                    log.error = "Dumpfix input data cannot be processed.";
+                    return false;
                 }
+            }
+            if (r->xy1.y == 86412) {
+                log.notes.push_back(format_rect_note("~(?,86412): ", *r));
+            }
 
-                if (r->xy0.y == 0) {
-                    // top rectangles...
-                    // only change max point y
-                    r->xy1.y += dumpfix_offset_y;
-                } else if (r->xy1.y == 86412) {
-                    // bottom rectangles...
-                    // only change min point y
-                    r->xy0.y += dumpfix_offset_y;
-                } else {
-                    // other rectangles...
-                    // move in its entirety
-                    r->xy0.y += dumpfix_offset_y;
-                    r->xy1.y += dumpfix_offset_y;
-                }
+            if (r->xy0.y == 0) {
+                // top rectangles...
+                // only change max point y
+                r->xy1.y += dumpfix_offset_y;
+            } else if (r->xy1.y == 86412) {
+                // bottom rectangles...
+                // only change min point y
+                r->xy0.y += dumpfix_offset_y;
+            } else {
+                // other rectangles...
+                // move in its entirety
+                r->xy0.y += dumpfix_offset_y;
+                r->xy1.y += dumpfix_offset_y;
             }
-            fwrite(read_buf, read_count, sizeof(xy32xy32), fout);
-        }
-        fclose(fin);
-        fclose(fout);
+            return true;
+        });
+        writer.close();
     } else {
         printf("Dump file %s not exist.\n", dump_filename);
     }
@@ -1356,52 +1667,27 @@ void dumpmerge(const char* dump1_filename, const char* dump2_filename, const cha
     printf("Merge Source 2: %s\n", dump2_filename);
     printf("Merge Target: %s\n", output_filename);
 
-    size_t rect_count = 0;
-    FILE* fin1 = fopen(dump1_filename, "rb");
-    FILE* fin2 = fopen(dump2_filename, "rb");
-    FILE* fout = fopen(output_filename, "wb");
-    if (fin1 && fout) {
-        size_t read_max_count = 100000; // elements
-        void* read_buf = malloc(sizeof(xy32xy32) * read_max_count);
-        fseek(fin1, 0, SEEK_SET);
-        while (size_t read_count = fread(read_buf, sizeof(xy32xy32), read_max_count, fin1)) {
-            rect_count += read_count;
-            fwrite(read_buf, read_count, sizeof(xy32xy32), fout);
-        }
-        fclose(fin1);
-        free(read_buf);
-    } else {
+    dumpfile::dump_view view1;
+    dumpfile::dump_view view2;
+    if (!view1.open(dump1_filename)) {
         abort_("fin1 invalid");
     }
-    printf("%zu rectangles written so far...\n", rect_count);
-
-    const int slice_width = 86412;
-
-    if (fin2 && fout) {
-        size_t read_max_count = 100000; // elements
-        void* read_buf = malloc(sizeof(xy32xy32) * read_max_count);
-        fseek(fin2, 0, SEEK_SET);
-        while (size_t read_count = fread(read_buf, sizeof(xy32xy32), read_max_count, fin2)) {
-            for (size_t i = 0; i < read_count; i++) {
-                rect_count++;
-                xy32xy32* r = reinterpret_cast<xy32xy32*>(read_buf) + i;
-                r->xy0.x += slice_width;
-                r->xy1.x += slice_width;
-            }
-            fwrite(read_buf, read_count, sizeof(xy32xy32), fout);
-        }
-        fclose(fin2);
-        free(read_buf);
-    } else {
+    if (!view2.open(dump2_filename)) {
         abort_("fin2 invalid");
     }
-    printf("%zu rectangles written so far...\n", rect_count);
+    dumpfile::dump_writer writer;
+    open_dump_writer_or_abort(writer, output_filename);
+    copy_dump(view1, writer);
+    printf("%zu rectangles written so far...\n", view1.size());
 
-    if (fout) {
-        fclose(fout);
-    } else {
-        abort_("fout invalid");
-    }
+    const int slice_width = 86412;
+
+    transform_dump(view2, writer, [slice_width](xy32xy32& r, transform_log&) {
+        r.xy0.x += slice_width;
+        r.xy1.x += slice_width;
+        return true;
+    });
+    printf("%zu rectangles written so far...\n", writer.close());
     printf("Finished.\n");
 }
 
@@ -1409,50 +1695,100 @@ void dumprescale(const char* dump_filename, const char* output_filename) {
     printf("Rescale Source : %s\n", dump_filename);
     printf("Rescale Target : %s\n", output_filename);
 
-    size_t rect_count = 0;
-    FILE* fin = fopen(dump_filename, "rb");
-    FILE* fout = fopen(output_filename, "wb");
-    
+    dumpfile::dump_view view;
+
     const float scale = 172824.0f / 16384;
 
-    if (fin && fout) {
-        size_t read_max_count = 100000; // elements
-        void* read_buf = malloc(sizeof(xy16xy16) * read_max_count);
-        fseek(fin, 0, SEEK_SET);
-        while (size_t read_count = fread(read_buf, sizeof(xy16xy16), read_max_count, fin)) {
-            for (size_t i = 0; i < read_count; i++) {
-                rect_count++;
-                xy16xy16* r16 = reinterpret_cast<xy16xy16*>(read_buf) + i;
-                xy32xy32 r32;
-                r32.xy0.x = static_cast<int>(roundf(r16->xy0.x * scale));
-                r32.xy0.y = static_cast<int>(roundf(r16->xy0.y * scale));
-                r32.xy1.x = static_cast<int>(roundf(r16->xy1.x * scale));
-                r32.xy1.y = static_cast<int>(roundf(r16->xy1.y * scale));
-                fwrite(&r32, 1, sizeof(xy32xy32), fout);
-            }
-        }
-        fclose(fin);
-        free(read_buf);
-    } else {
+    if (!view.open(dump_filename, true)) {
         abort_("fin2 invalid");
     }
-    printf("%zu rectangles written so far...\n", rect_count);
+    dumpfile::dump_writer writer;
+    open_dump_writer_or_abort(writer, output_filename);
+    transform_dump(view, writer, [scale](xy32xy32& r, transform_log&) {
+        r.xy0.x = static_cast<int>(roundf(r.xy0.x * scale));
+        r.xy0.y = static_cast<int>(roundf(r.xy0.y * scale));
+        r.xy1.x = static_cast<int>(roundf(r.xy1.x * scale));
+        r.xy1.y = static_cast<int>(roundf(r.xy1.y * scale));
+        return true;
+    });
+    printf("%zu rectangles written so far...\n", writer.close());
+    printf("Finished.\n");
+}
 
-    if (fout) {
-        fclose(fout);
-    } else {
-        abort_("fout invalid");
+void read_dump_rects(const char* dump_filename, std::vector<xy32xy32>& rects) {
+    dumpfile::dump_view view;
+    if (!view.open(dump_filename)) {
+        abort_("Dump file %s not exist.", dump_filename);
+    }
+    view.read_all(rects);
+}
+
+void write_dump_rects(const char* dump_filename, std::vector<xy32xy32>& rects) {
+    if (!dumpfile::write_dump(dump_filename, dump_output_format, rects)) {
+        abort_("Dump file %s could not be opened for writing.", dump_filename);
+    }
+}
+
+double benchmark_water_routes_from_dump(const char* dump_filename, size_t rtree_memory_size) {
+    auto rtree_filename = std::string(dump_filename) + ".bench.rtree";
+    boost::filesystem::remove(rtree_filename);
+    double elapsed;
+    {
+        bi::managed_mapped_file file(bi::create_only, rtree_filename.c_str(), rtree_memory_size);
+        allocator_t alloc(file.get_segment_manager());
+        rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+        load_from_dump_if_empty(rtree_ptr, dump_filename);
+        elapsed = benchmark_water_routes(rtree_ptr);
+    }
+    boost::filesystem::remove(rtree_filename);
+    return elapsed;
+}
+
+// Post-pass over a max-rect dump: merge rectangles sharing a full edge (and optionally split/re-merge)
+// to cut the rectangle count, which shrinks the R-tree and the cell graph the A* search has to expand.
+void dumpmergerects(const char* dump_filename, const char* output_filename, bool split, bool bench, size_t rtree_memory_size) {
+    printf("Rectangle merge source : %s\n", dump_filename);
+    printf("Rectangle merge target : %s\n", output_filename);
+
+    std::vector<xy32xy32> rects;
+    read_dump_rects(dump_filename, rects);
+    const size_t before = rects.size();
+    size_t merged = rectmerge::merge_full_edges(rects);
+    printf("Full-edge merge: %zu -> %zu rectangles\n", before, rects.size());
+    if (split) {
+        size_t remerged = rectmerge::split_and_remerge(rects);
+        printf("Split and re-merge: %zu more rectangles removed\n", remerged);
+        merged += remerged;
+    }
+    write_dump_rects(output_filename, rects);
+    printf("Rectangle count: %zu -> %zu (%zu removed, %.2f%% reduction)\n",
+           before,
+           rects.size(),
+           merged,
+           before ? 100.0 * merged / before : 0.0);
+
+    if (bench) {
+        double before_seconds = benchmark_water_routes_from_dump(dump_filename, rtree_memory_size);
+        double after_seconds = benchmark_water_routes_from_dump(output_filename, rtree_memory_size);
+        printf("Benchmark routes: %.3f s -> %.3f s (speedup x%.2f)\n",
+               before_seconds,
+               after_seconds,
+               after_seconds > 0 ? before_seconds / after_seconds : 0.0);
     }
     printf("Finished.\n");
 }
 
-void dump_to_rtree(const char* dump_filename, const char* rtree_filename, size_t rtree_memory_size) {
+// Dumps do not record the width of their raster; 'raster_width' (0: unknown) is recorded in the R-tree file.
+void dump_to_rtree(const char* dump_filename, const char* rtree_filename, size_t rtree_memory_size, int raster_width) {
     bi::managed_mapped_file file(bi::create_only, rtree_filename, rtree_memory_size);
     allocator_t alloc(file.get_segment_manager());
     rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
     printf("Max rect R Tree size: %zu\n", rtree_ptr->size());
 
     load_from_dump_if_empty(rtree_ptr, dump_filename);
+    if (raster_width > 0) {
+        record_raster_width(file, raster_width);
+    }
 }
 
 void dump_max_rect(const char* input_png_filename, const char* rtree_filename, size_t rtree_memory_size, const char* dump_filename, int write_dump, png_byte red) {
@@ -1473,6 +1809,7 @@ void dump_max_rect(const char* input_png_filename, const char* rtree_filename, s
     }
 
     load_from_dump_if_empty(rtree_ptr, dump_filename);
+    record_raster_width(file, width);
 
     size_t old_pixel_count = 0;
     for (int y = 0; y < height; y++) {
@@ -1581,9 +1918,11 @@ void dump_max_rect(const char* input_png_filename, const char* rtree_filename, s
 }
 
 void write_dump_file_32(rtree_t * rtree_ptr, rtree_t::bounds_type &rtree_bounds, const char * dump_filename) {
-    // dump final result to portable format
-    std::vector<xy32xy32> write_buffer;
-    write_buffer.reserve(rtree_ptr->size());
+    // dump final result to portable format, streamed straight from the tree
+    dumpfile::dump_writer writer;
+    if (!writer.open(dump_filename, dump_output_format)) {
+        abort_("Dump file %s could not be opened for writing.", dump_filename);
+    }
     rtree_bounds = rtree_ptr->bounds();
     for (auto it = rtree_ptr->qbegin(bgi::intersects(rtree_bounds)); it != rtree_ptr->qend(); it++) {
         xy32xy32 v;
@@ -1591,18 +1930,18 @@ void write_dump_file_32(rtree_t * rtree_ptr, rtree_t::bounds_type &rtree_bounds,
         v.xy0.y = it->first.min_corner().get<1>();
         v.xy1.x = it->first.max_corner().get<0>();
         v.xy1.y = it->first.max_corner().get<1>();
-        write_buffer.push_back(v);
+        writer.write(v);
     }
-    FILE* fout = fopen(dump_filename, "wb");
-    fwrite(&write_buffer[0], sizeof(xy32xy32), write_buffer.size(), fout);
-    fclose(fout);
-    printf("Dumped. (32-bit) (element size: %zu, element count: %zu)\n", sizeof(xy32xy32), write_buffer.size());
+    const size_t element_count = writer.close();
+    printf("Dumped. (32-bit) (element size: %zu, element count: %zu)\n", sizeof(xy32xy32), element_count);
 }
 
 void write_dump_file(rtree_t * rtree_ptr, rtree_t::bounds_type &rtree_bounds, const char * dump_filename) {
-    // dump final result to portable format
-    std::vector<xy32xy32> write_buffer;
-    write_buffer.reserve(rtree_ptr->size());
+    // dump final result to portable format, streamed straight from the tree
+    dumpfile::dump_writer writer;
+    if (!writer.open(dump_filename, dump_output_format)) {
+        abort_("Dump file %s could not be opened for writing.", dump_filename);
+    }
     rtree_bounds = rtree_ptr->bounds();
     for (auto it = rtree_ptr->qbegin(bgi::intersects(rtree_bounds)); it != rtree_ptr->qend(); it++) {
         xy32xy32 v;
@@ -1610,12 +1949,10 @@ void write_dump_file(rtree_t * rtree_ptr, rtree_t::bounds_type &rtree_bounds, co
         v.xy0.y = it->first.min_corner().get<1>();
         v.xy1.x = it->first.max_corner().get<0>();
         v.xy1.y = it->first.max_corner().get<1>();
-        write_buffer.push_back(v);
+        writer.write(v);
     }
-    FILE* fout = fopen(dump_filename, "wb");
-    fwrite(&write_buffer[0], sizeof(xy32xy32), write_buffer.size(), fout);
-    fclose(fout);
-    printf("Dumped. (element size: %zu, element count: %zu)\n", sizeof(xy32xy32), write_buffer.size());
+    const size_t element_count = writer.close();
+    printf("Dumped. (element size: %zu, element count: %zu)\n", sizeof(xy32xy32), element_count);
 }
 
 void change_working_directory() {
@@ -1635,18 +1972,316 @@ void change_working_directory() {
     }
 }
 
-void load_and_query(const char* rtree_filename, int from_x, int from_y, int to_x, int to_y) {
+std::vector<xy32> parse_points(const std::string& s) {
+    std::vector<xy32> points;
+    std::vector<std::string> items;
+    boost::split(items, s, boost::is_any_of(";"));
+    for (const auto& item : items) {
+        xy32 p;
+        if (sscanf(item.c_str(), "%d,%d", &p.x, &p.y) != 2) {
+            abort_("Invalid point '%s' in corridor.", item.c_str());
+        }
+        points.push_back(p);
+    }
+    return points;
+}
+
+// Corridor from the command line:
+//   boxes:x0,y0,x1,y1;x0,y0,x1,y1;...
+//   polygon:x,y;x,y;x,y;...
+//   path:buffer:x,y;x,y;...
+astarrtree::corridor parse_corridor(const std::string& spec) {
+    auto colon = spec.find(':');
+    if (colon == std::string::npos) {
+        abort_("Invalid corridor '%s'.", spec.c_str());
+    }
+    auto kind = spec.substr(0, colon);
+    auto args = spec.substr(colon + 1);
+    if (kind == "boxes") {
+        std::vector<std::string> items;
+        boost::split(items, args, boost::is_any_of(";"));
+        std::vector<xy32xy32> boxes;
+        for (const auto& item : items) {
+            xy32xy32 b;
+            if (sscanf(item.c_str(), "%d,%d,%d,%d", &b.xy0.x, &b.xy0.y, &b.xy1.x, &b.xy1.y) != 4) {
+                abort_("Invalid box '%s' in corridor.", item.c_str());
+            }
+            boxes.push_back(b);
+        }
+        return astarrtree::corridor::from_boxes(boxes);
+    } else if (kind == "polygon") {
+        return astarrtree::corridor::from_polygon(parse_points(args));
+    } else if (kind == "path") {
+        auto buffer_colon = args.find(':');
+        if (buffer_colon == std::string::npos) {
+            abort_("Corridor path needs a buffer: path:buffer:x,y;x,y;...");
+        }
+        return astarrtree::corridor::from_path(parse_points(args.substr(buffer_colon + 1)), atoi(args.substr(0, buffer_colon).c_str()));
+    }
+    abort_("Unknown corridor kind '%s' (boxes, polygon or path).", kind.c_str());
+    return astarrtree::corridor();
+}
+
+// Prints the sea areas a route crosses, in order.
+void print_route_sea_areas(const seaarea::sea_area_index& areas, const std::vector<xy32>& waypoints, int width) {
+    auto start = std::chrono::steady_clock::now();
+    const auto crossed = areas.along_route(waypoints, width);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("Sea areas (%zu, %.3f ms):", crossed.size(), ms);
+    for (size_t i = 0; i < crossed.size(); i++) {
+        printf("%s%s", i ? " -> " : " ", areas.area(crossed[i]).name.c_str());
+    }
+    printf("\n");
+}
+
+// Classifies 'count' uniformly random (latitude, longitude) points, as a batch throughput check.
+void benchmark_sea_areas(const seaarea::sea_area_index& areas, size_t count) {
+    std::vector<std::pair<float, float> > points(count);
+    uint32_t seed = 12345;
+    auto next_unit = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / 16777216.0f;
+    };
+    for (auto& p : points) {
+        p.first = next_unit() * 180.0f - 90.0f;
+        p.second = next_unit() * 360.0f - 180.0f;
+    }
+    auto start = std::chrono::steady_clock::now();
+    const auto ids = areas.classify(points);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const size_t inside = count - std::count(ids.begin(), ids.end(), -1);
+    printf("Sea area batch: %zu points, %zu inside an area, %.3f s (%.1f M points/s)\n",
+           count, inside, seconds, count / seconds / 1e6);
+}
+
+void load_and_query(const char* rtree_filename, int from_x, int from_y, int to_x, int to_y, astarrtree::search_options options,
+                    const seaarea::sea_area_index* areas = nullptr) {
     bi::managed_mapped_file file(bi::open_only, rtree_filename, 0);
     allocator_t alloc(file.get_segment_manager());
     rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+    options.raster_width = rtree_raster_width(file, rtree_ptr, options.raster_width);
     printf("Max rect R Tree size: %zu\n", rtree_ptr->size());
 
     printf("From: (%d, %d)\n", from_x, from_y);
     printf("  To: (%d, %d)\n", to_x, to_y);
-    astarrtree::astar_rtree_memory(rtree_ptr, xy32{ from_x, from_y }, xy32{ to_x, to_y });
+    auto waypoints = astarrtree::astar_rtree_memory(rtree_ptr, xy32{ from_x, from_y }, xy32{ to_x, to_y }, options);
+    if (areas) {
+        print_route_sea_areas(*areas, waypoints, options.raster_width);
+    }
     printf("Finished.\n");
 }
 
+// --fromto for one vessel: the route, its length and the ETA at the vessel's maximum speed.
+void load_and_query_vessel(const char* rtree_filename, xy32 from, xy32 to, const vessel::vessel_table& vessels, int imo_number,
+                           float beam_clearance, astarrtree::search_options options) {
+    const int row = vessels.find(imo_number);
+    if (row < 0) {
+        abort_("IMO %d is not in the vessel table.", imo_number);
+    }
+    printf("Vessel: IMO %d %s, max speed %.1f kn, length %.1f m, beam %.1f m, draught %.1f m\n", imo_number,
+           vessels.name(row).c_str(), vessels.max_speed_kn(row), vessels.length_m(row), vessels.beam_m(row), vessels.draught_m(row));
+    bi::managed_mapped_file file(bi::open_only, rtree_filename, 0);
+    allocator_t alloc(file.get_segment_manager());
+    rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+    options.raster_width = rtree_raster_width(file, rtree_ptr, options.raster_width);
+    auto route = vessel::route_for_vessel(rtree_ptr, from, to, vessels, row, beam_clearance, options);
+    if (route.waypoints.empty()) {
+        printf("No route for IMO %d.\n", imo_number);
+    } else if (route.eta_hours > 0) {
+        printf("Vessel route: %.1f nm, ETA %.1f h (%.1f days) at %.1f kn\n", route.length_nm, route.eta_hours, route.eta_hours / 24, vessels.max_speed_kn(row));
+    } else {
+        printf("Vessel route: %.1f nm, ETA unknown (no speed on record)\n", route.length_nm);
+    }
+}
+
+// Plans 'from' -> 'to' with D* Lite, advances the ship a quarter of the way, closes 'closures' and repairs the
+// route from there; a plan from scratch with the same closures is run for comparison. The cells crossing a
+// closure edge are split first, so 'rtree_ptr' should be a private (copy-on-write) mapping.
+void replan_route(rtree_t* rtree_ptr, xy32 from, xy32 to, const std::vector<xy32xy32>& closures, const astarrtree::search_options& options) {
+    size_t split_count = 0;
+    for (const auto& box : closures) {
+        split_count += astarrtree::split_rtree(rtree_ptr, box).removed.size();
+    }
+    printf("%zu cells split at closure edges\n", split_count);
+    astarrtree::rect_graph graph;
+    graph.build(rtree_ptr, options.wrap, options.raster_width);
+    astarrtree::dstar_lite planner(graph, options.costs);
+    auto start = std::chrono::steady_clock::now();
+    bool found = planner.plan(from, to);
+    auto elapsed_ms = [&start]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    printf("Initial plan: %zu cells expanded, cost %.1f, %zu cells on the route, %.3f ms\n",
+           planner.get_expanded(), planner.path_cost(), planner.path().size(), elapsed_ms());
+    if (!found) {
+        return;
+    }
+    const auto initial = planner.path();
+    const xy32 ship = astarrtree::cell_center(initial[initial.size() / 4]);
+    planner.move_to(ship);
+    for (const auto& box : closures) {
+        planner.close(box);
+    }
+    start = std::chrono::steady_clock::now();
+    found = planner.replan();
+    printf("Ship at (%d, %d), %zu closures (%zu cells): repaired with %zu cells expanded, cost %.1f, %.3f ms\n",
+           ship.x, ship.y, closures.size(), planner.get_closed_cell_count(), planner.get_expanded(), planner.path_cost(), elapsed_ms());
+
+    astarrtree::dstar_lite scratch(graph, options.costs);
+    for (const auto& box : closures) {
+        scratch.close(box);
+    }
+    start = std::chrono::steady_clock::now();
+    scratch.plan(ship, to);
+    printf("From scratch: %zu cells expanded, cost %.1f, %.3f ms\n", scratch.get_expanded(), scratch.path_cost(), elapsed_ms());
+    if (!found) {
+        printf("The goal is cut off by the closures.\n");
+        return;
+    }
+    auto waypoints = astarrtree::cell_path_waypoints(rtree_ptr, ship, to, planner.path(), options);
+    printf("Repaired route: %zu cells, %zu waypoints\n", planner.path().size(), waypoints.size());
+}
+
+// Up to 'alternatives.count' materially different routes from 'from' to 'to'.
+void alternative_routes(rtree_t* rtree_ptr, const char* rtree_filename, xy32 from, xy32 to, astarrtree::search_options options,
+                        const astarrtree::alternative_options& alternatives) {
+    astarrtree::rect_graph graph;
+    load_rect_graph(rtree_ptr, rtree_filename, options.wrap, options.raster_width, graph);
+    options.verbose = false;
+    astarrtree::alternative_router router(graph, rtree_ptr, options);
+    auto start = std::chrono::steady_clock::now();
+    auto routes = router.find(from, to, alternatives);
+    printf("%zu routes in %.3f ms (%zu searches, %zu cells expanded)\n", routes.size(),
+           std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(),
+           router.get_searches(), router.get_expanded());
+    for (size_t i = 0; i < routes.size(); i++) {
+        const auto& r = routes[i];
+        printf("Route %zu: cost %.1f (%.2fx), %.0f%% shared, %zu cells, %zu waypoints\n", i, r.cost, r.cost / routes[0].cost,
+               r.overlap * 100, r.cells.size(), r.waypoints.size());
+        for (const auto& p : r.waypoints) {
+            printf("  (%d, %d)\n", p.x, p.y);
+        }
+    }
+}
+
+// Applies the edited raster region 'window' of 'png_filename' (window-sized, or the whole raster) to the R-tree
+// file in place, then updates the adjacency (saved as '<rtree>.graph') and, when given, the landmark table
+// without rebuilding them.
+// A given cell width table is rebuilt (its cells are looked up by corner and would silently go stale).
+void patch_map(const char* rtree_filename, const xy32xy32& window, const char* png_filename, png_byte red,
+               const char* landmarks_filename, const char* widths_filename, astarrtree::search_options options, bool write_dump) {
+    read_png_file(png_filename, red);
+    const int w = window.xy1.x - window.xy0.x;
+    const int h = window.xy1.y - window.xy0.y;
+    xy32 origin = { 0, 0 };
+    if (width == w && height == h) {
+        origin = window.xy0;
+    } else if (width < window.xy1.x || height < window.xy1.y) {
+        abort_("%s (%dx%d) is neither the size of the patch window nor does it contain it.", png_filename, width, height);
+    }
+    std::vector<uint8_t> mask(static_cast<size_t>(w) * h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            mask[static_cast<size_t>(y) * w + x] = PIXELBITXY(window.xy0.x + x - origin.x, window.xy0.y + y - origin.y);
+        }
+    }
+
+    bi::managed_mapped_file file(bi::open_only, rtree_filename, 0);
+    allocator_t alloc(file.get_segment_manager());
+    rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+    options.raster_width = rtree_raster_width(file, rtree_ptr, options.raster_width);
+    astarrtree::rect_graph graph;
+    load_rect_graph(rtree_ptr, rtree_filename, options.wrap, options.raster_width, graph);
+
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed_ms = [&start]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    auto patch = astarrtree::patch_rtree(rtree_ptr, window, mask);
+    printf("R-tree patched: %zu cells removed, %zu inserted, %zu cells, %.3f ms\n",
+           patch.removed.size(), patch.inserted.size(), rtree_ptr->size(), elapsed_ms());
+    start = std::chrono::steady_clock::now();
+    graph.apply_patch(patch);
+    printf("Rect graph updated in %.3f ms\n", elapsed_ms());
+    graph.save((std::string(rtree_filename) + ".graph").c_str());
+
+    if (landmarks_filename) {
+        astarrtree::landmark_table landmarks;
+        if (!landmarks.open(landmarks_filename)) {
+            abort_("Landmark table %s could not be loaded.", landmarks_filename);
+        }
+        if (!landmarks.refresh(graph, landmarks_filename)) {
+            abort_("Landmark table %s could not be refreshed.", landmarks_filename);
+        }
+    }
+    if (widths_filename) {
+        start = std::chrono::steady_clock::now();
+        if (!astarrtree::cell_width_table::build(rtree_ptr, options.wrap, options.raster_width, widths_filename)) {
+            abort_("Cell width table %s could not be rebuilt.", widths_filename);
+        }
+        printf("Cell width table rebuilt in %.3f ms\n", elapsed_ms());
+    } else {
+        printf("Cell width tables of this R-tree are stale now; rebuild them with --buildwidths.\n");
+    }
+    if (write_dump) {
+        auto rtree_bounds = rtree_ptr->bounds();
+        write_dump_file_32(rtree_ptr, rtree_bounds, (std::string(rtree_filename) + ".dump").c_str());
+    }
+}
+
+// Max-rect R-trees of one raster at several resolutions, each cached next to its dump as '<dump>.rtree'.
+// Level 0 is the full-resolution raster; the scale of every other level is derived from its raster width, as
+// recorded by --dump2rtree --rasterwidth or else the width of its bounds.
+class raster_pyramid {
+public:
+    void open(const std::vector<std::string>& dump_filenames, size_t rtree_memory_size) {
+        for (const auto& dump_filename : dump_filenames) {
+            auto rtree_filename = dump_filename + ".rtree";
+            files.push_back(std::unique_ptr<bi::managed_mapped_file>(new bi::managed_mapped_file(bi::open_or_create, rtree_filename.c_str(), rtree_memory_size)));
+            allocator_t alloc(files.back()->get_segment_manager());
+            rtree_t * rtree_ptr = files.back()->find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+            load_from_dump_if_empty(rtree_ptr, dump_filename.c_str());
+            if (rtree_ptr->size() == 0) {
+                abort_("Pyramid level %s is empty.", dump_filename.c_str());
+            }
+            const int level_width = rtree_raster_width(*files.back(), rtree_ptr, 0);
+            const int full_width = levels.empty() ? level_width : levels[0].raster_width;
+            levels.push_back(astarrtree::pyramid_level{ rtree_ptr, static_cast<float>(full_width) / level_width, level_width });
+            printf("Pyramid level %zu: %s, %zu rects, scale %.3f\n", levels.size() - 1, dump_filename.c_str(), rtree_ptr->size(), levels.back().scale);
+        }
+    }
+    const std::vector<astarrtree::pyramid_level>& get_levels() const { return levels; }
+private:
+    std::vector<std::unique_ptr<bi::managed_mapped_file> > files;
+    std::vector<astarrtree::pyramid_level> levels;
+};
+
+// Runs the water benchmark routes on the full-resolution level alone and then coarse-to-fine,
+// and prints the cells expanded and the time taken by each.
+void benchmark_pyramid_routes(const raster_pyramid& pyramid, int corridor_buffer) {
+    const std::vector<astarrtree::pyramid_level> full_only(1, pyramid.get_levels()[0]);
+    size_t full_expanded = 0, pyramid_expanded = 0;
+    double full_seconds = 0, pyramid_seconds = 0;
+    for (const auto& route : water_benchmark_routes) {
+        size_t expanded = 0;
+        auto start = std::chrono::steady_clock::now();
+        astarrtree::search_options options;
+        options.verbose = false;
+        options.expanded = &expanded;
+        auto full_waypoints = astarrtree::astar_rtree_pyramid(full_only, route[0], route[1], corridor_buffer, options);
+        full_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        full_expanded += expanded;
+        start = std::chrono::steady_clock::now();
+        auto pyramid_waypoints = astarrtree::astar_rtree_pyramid(pyramid.get_levels(), route[0], route[1], corridor_buffer, options);
+        pyramid_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        pyramid_expanded += expanded;
+        printf("Route (%d,%d) -> (%d,%d): %zu -> %zu waypoints\n",
+               route[0].x, route[0].y, route[1].x, route[1].y, full_waypoints.size(), pyramid_waypoints.size());
+    }
+    printf("Full resolution only: %zu cells expanded, %.3f s\n", full_expanded, full_seconds);
+    printf("Coarse-to-fine: %zu cells expanded, %.3f s\n", pyramid_expanded, pyramid_seconds);
+}
+
 int main(int argc, char* argv[]) {
     std::cout << "sea-route v0.1" << std::endl;
     change_working_directory();
@@ -1667,10 +2302,52 @@ int main(int argc, char* argv[]) {
             ("dumpmergeout", boost::program_options::value<std::string>(), "Dump merge target")
             ("loadrtree", boost::program_options::value<std::string>(), "R-tree file to load")
             ("fromto", boost::program_options::value<std::string>(), "from_x,from_y,to_x,to_y")
-            ("dumprescale", boost::program_options::value<std::string>(), "Dump file (xy16) to be rescaled")
-            ("dumprescaleout", boost::program_options::value<std::string>(), "Dump file (xy32) rescaled output")
+            ("anyangle", boost::program_options::bool_switch(), "Output any-angle waypoints (straight segments through the cell path) instead of pixel steps")
+            ("unitcost", boost::program_options::bool_switch(), "Cost every cell step 1 instead of the distance between cell entry points")
+            ("geodesic", boost::program_options::bool_switch(), "Cost cell steps by great-circle distance (nautical miles) on the whole-globe raster")
+            ("buildlandmarks", boost::program_options::value<std::string>(), "Build an ALT landmark table for --loadrtree (with the selected cost model and wrap) into this file")
+            ("landmarkcount", boost::program_options::value<int>()->default_value(16), "Number of landmarks for --buildlandmarks")
+            ("landmarks", boost::program_options::value<std::string>(), "Use this landmark table (ALT) as an extra, approximate bound in --loadrtree and --pyramid searches (faster; routes may differ by a few percent)")
+            ("isochrone", boost::program_options::value<std::string>(), "Cells of --loadrtree reachable from x,y within --maxcost")
+            ("maxcost", boost::program_options::value<float>(), "Cost bound for --isochrone (pixels, or nautical miles with --geodesic)")
+            ("isochronepng", boost::program_options::value<std::string>(), "Also rasterize the --isochrone cells into this 1-bit PNG")
+            ("ports", boost::program_options::value<std::string>(), "seaports.dat (crawler/locode/parse.py) for --snap")
+            ("cities", boost::program_options::value<std::string>(), "cities10k.dat (crawler/cities/city10k.py) for --snap")
+            ("snap", boost::program_options::value<std::string>(), "Snap ';'-separated places (lat,lng / LOCODE / port or city name) to the nearest port and water pixel of --loadrtree")
+            ("seaareas", boost::program_options::value<std::string>(), "seaareas.dat (crawler/seaarea/seaarea.py): annotate --fromto routes with the sea areas crossed")
+            ("seaareabench", boost::program_options::value<int>(), "Classify this many random points with --seaareas")
+            ("buildwidths", boost::program_options::value<std::string>(), "Build the passage width table of --loadrtree into this file")
+            ("widths", boost::program_options::value<std::string>(), "Passage width table for --minwidth and --beamclearance")
+            ("minwidth", boost::program_options::value<float>()->default_value(0), "With --widths, do not route through passages narrower than this (nautical miles)")
+            ("vessels", boost::program_options::value<std::string>(), "vessels.txt (crawler/vessels) for --imo")
+            ("imo", boost::program_options::value<int>(), "Route --fromto for this vessel (IMO number of --vessels) and print its ETA")
+            ("beamclearance", boost::program_options::value<float>()->default_value(0), "With --imo and --widths, do not route through passages narrower than this many beams")
+            ("cachebench", boost::program_options::value<int>(), "Run the water benchmark routes this many times each on --loadrtree, without and with a route cache")
+            ("cachemb", boost::program_options::value<int>()->default_value(64), "Route cache size (MB) for --cachebench")
+            ("replan", boost::program_options::value<std::string>(), "Close these boxes (x0,y0,x1,y1;...) a quarter of the way along --fromto on --loadrtree and repair the route with D* Lite")
+            ("alternatives", boost::program_options::value<int>(), "Find up to this many materially different routes for --fromto on --loadrtree")
+            ("altpenalty", boost::program_options::value<float>()->default_value(1.5f), "Cost factor applied to the cells of each route found for --alternatives")
+            ("altoverlap", boost::program_options::value<float>()->default_value(0.6f), "Largest share of an alternative's cost in cells of earlier routes")
+            ("altstretch", boost::program_options::value<float>()->default_value(2.0f), "Longest alternative as a multiple of the shortest route")
+            ("altbudget", boost::program_options::value<double>()->default_value(500), "Time budget (ms) for --alternatives")
+            ("patch", boost::program_options::value<std::string>(), "Re-decompose the window x0,y0,x1,y1 of --loadrtree in place from --patchpng (--land for a land mask), refresh --landmarks, rebuild --widths and, with --dump, rewrite the dump")
+            ("patchpng", boost::program_options::value<std::string>(), "Edited raster for --patch: the window alone, or the whole raster")
+            ("nowrap", boost::program_options::bool_switch(), "Do not treat the left and right raster edges as adjacent (anti-meridian)")
+            ("rasterwidth", boost::program_options::value<int>()->default_value(0), "Width (pixels spanning 360 degrees) of the raster behind --loadrtree, or to record with --dump2rtree; default: as recorded in the R-tree, else the right edge of its cells")
+            ("costbench", boost::program_options::bool_switch(), "Run water benchmark routes on --loadrtree with unit and Euclidean cell costs")
+            ("corridor", boost::program_options::value<std::string>(), "Restrict --loadrtree search: boxes:x0,y0,x1,y1;... | polygon:x,y;x,y;... | path:buffer:x,y;x,y;...")
+            ("dumprescale", boost::program_options::value<std::string>(), "Dump file (raw xy16) to be rescaled")
+            ("dumprescaleout", boost::program_options::value<std::string>(), "Dump file rescaled output")
             ("dump2rtree", boost::program_options::value<std::string>(), "Dump file to be converted to R-tree")
             ("rtreesizemb", boost::program_options::value<int>(), "R-tree maximum size in memory (MB)")
+            ("rectmerge", boost::program_options::value<std::string>(), "Dump file (xy32) to merge adjacent rectangles")
+            ("rectmergeout", boost::program_options::value<std::string>(), "Dump file (xy32) merged output")
+            ("rectsplit", boost::program_options::bool_switch(), "Also split and re-merge partially adjacent rectangles")
+            ("rectmergebench", boost::program_options::bool_switch(), "Run water benchmark routes before/after merging")
+            ("compressdump", boost::program_options::bool_switch(), "Write dump files in the compressed block format instead of raw xy32 arrays (readable by this build only)")
+            ("pyramid", boost::program_options::value<std::string>(), "Dump files of one raster from full to coarse resolution (comma separated) for coarse-to-fine search with --fromto")
+            ("pyramidbench", boost::program_options::bool_switch(), "Run water benchmark routes on the full-resolution level and coarse-to-fine")
+            ("corridorbuffer", boost::program_options::value<int>()->default_value(2), "Corridor buffer around the coarse path in coarse pixels")
             ;
 
         boost::program_options::variables_map vm;
@@ -1713,6 +2390,39 @@ int main(int argc, char* argv[]) {
             return 0;
         }
 
+        astarrtree::search_options options;
+        options.waypoints = vm["anyangle"].as<bool>() ? astarrtree::WM_ANY_ANGLE : astarrtree::WM_PIXEL;
+        options.costs = vm["unitcost"].as<bool>() ? astarrtree::CM_UNIT : astarrtree::CM_EUCLIDEAN;
+        if (vm["geodesic"].as<bool>()) {
+            if (vm["unitcost"].as<bool>()) {
+                abort_("--unitcost and --geodesic are exclusive.");
+            }
+            options.costs = astarrtree::CM_GEODESIC;
+        }
+        options.wrap = !vm["nowrap"].as<bool>();
+        options.raster_width = vm["rasterwidth"].as<int>();
+        options.min_cell_width_nm = vm["minwidth"].as<float>();
+        astarrtree::landmark_table landmarks;
+        if (vm.count("landmarks")) {
+            if (!landmarks.open(vm["landmarks"].as<std::string>().c_str())) {
+                abort_("Landmark table %s could not be loaded.", vm["landmarks"].as<std::string>().c_str());
+            }
+            printf("Landmark table: %zu landmarks x %zu cells (approximate bounds: routes may differ from the plain search)\n",
+                   landmarks.get_landmark_count(), landmarks.get_cell_count());
+            options.landmarks = &landmarks;
+        }
+        astarrtree::cell_width_table widths;
+        if (vm.count("widths")) {
+            if (!widths.open(vm["widths"].as<std::string>().c_str())) {
+                abort_("Cell width table %s could not be loaded.", vm["widths"].as<std::string>().c_str());
+            }
+            options.widths = &widths;
+        }
+
+        if (vm["compressdump"].as<bool>()) {
+            dump_output_format = dumpfile::DF_COMPRESSED;
+        }
+
         // Save R-tree file from PNG
         if (vm.count("png2rtree")) {
             auto input_png_filename = vm["png2rtree"].as<std::string>();
@@ -1748,7 +2458,7 @@ int main(int argc, char* argv[]) {
             auto dump_filename = vm["dump2rtree"].as<std::string>();
             auto rtree_size_in_mb = vm["rtreesizemb"].as<int>();
             auto rtree_filename = dump_filename + ".rtree";
-            dump_to_rtree(dump_filename.c_str(), rtree_filename.c_str(), WORLDMAP_RTREE_MMAP_MAX_SIZE(rtree_size_in_mb));
+            dump_to_rtree(dump_filename.c_str(), rtree_filename.c_str(), WORLDMAP_RTREE_MMAP_MAX_SIZE(rtree_size_in_mb), vm["rasterwidth"].as<int>());
         }
 
         // Save Dump file from R-tree file
@@ -1794,13 +2504,169 @@ int main(int argc, char* argv[]) {
             dumpmerge(dump1_filename.c_str(), dump2_filename.c_str(), output_filename.c_str());
         }
 
+        seaarea::sea_area_index sea_areas;
+        const seaarea::sea_area_index* sea_areas_ptr = nullptr;
+        if (vm.count("seaareas")) {
+            auto start = std::chrono::steady_clock::now();
+            if (!sea_areas.load(vm["seaareas"].as<std::string>().c_str())) {
+                abort_("Sea areas %s could not be loaded.", vm["seaareas"].as<std::string>().c_str());
+            }
+            printf("Sea areas: %zu, %.3f s\n", sea_areas.size(),
+                   std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            sea_areas_ptr = &sea_areas;
+            if (vm.count("seaareabench")) {
+                benchmark_sea_areas(sea_areas, static_cast<size_t>(vm["seaareabench"].as<int>()));
+            }
+        }
+
         if (vm.count("loadrtree") && vm.count("fromto")) {
             auto rtree_filename = vm["loadrtree"].as<std::string>();
             auto fromto = vm["fromto"].as<std::string>();
             int from_x, from_y, to_x, to_y;
-            if (sscanf(fromto.c_str(), "%d,%d,%d,%d", &from_x, &from_y, &to_x, &to_y) == 4) {
-                load_and_query(rtree_filename.c_str(), from_x, from_y, to_x, to_y);
+            if (sscanf(fromto.c_str(), "%d,%d,%d,%d", &from_x, &from_y, &to_x, &to_y) == 4 && vm.count("replan")) {
+                std::vector<std::string> box_strings;
+                boost::algorithm::split(box_strings, vm["replan"].as<std::string>(), boost::is_any_of(";"));
+                std::vector<xy32xy32> closures;
+                for (const auto& b : box_strings) {
+                    xy32xy32 box;
+                    if (sscanf(b.c_str(), "%d,%d,%d,%d", &box.xy0.x, &box.xy0.y, &box.xy1.x, &box.xy1.y) != 4) {
+                        abort_("--replan boxes are x0,y0,x1,y1;...");
+                    }
+                    closures.push_back(box);
+                }
+                // splitting cells at the closures must not change the file
+                bi::managed_mapped_file file(bi::open_copy_on_write, rtree_filename.c_str());
+                allocator_t alloc(file.get_segment_manager());
+                rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+                options.raster_width = rtree_raster_width(file, rtree_ptr, options.raster_width);
+                replan_route(rtree_ptr, xy32{ from_x, from_y }, xy32{ to_x, to_y }, closures, options);
+            } else if (sscanf(fromto.c_str(), "%d,%d,%d,%d", &from_x, &from_y, &to_x, &to_y) == 4 && vm.count("alternatives")) {
+                astarrtree::alternative_options alternatives;
+                alternatives.count = vm["alternatives"].as<int>();
+                alternatives.penalty = vm["altpenalty"].as<float>();
+                alternatives.max_overlap = vm["altoverlap"].as<float>();
+                alternatives.max_stretch = vm["altstretch"].as<float>();
+                alternatives.budget_ms = vm["altbudget"].as<double>();
+                bi::managed_mapped_file file(bi::open_only, rtree_filename.c_str(), 0);
+                allocator_t alloc(file.get_segment_manager());
+                rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+                options.raster_width = rtree_raster_width(file, rtree_ptr, options.raster_width);
+                alternative_routes(rtree_ptr, rtree_filename.c_str(), xy32{ from_x, from_y }, xy32{ to_x, to_y }, options, alternatives);
+            } else if (sscanf(fromto.c_str(), "%d,%d,%d,%d", &from_x, &from_y, &to_x, &to_y) == 4 && vm.count("imo")) {
+                if (!vm.count("vessels")) {
+                    abort_("--imo needs --vessels.");
+                }
+                if (vm["beamclearance"].as<float>() > 0 && !options.widths) {
+                    abort_("--beamclearance needs --widths.");
+                }
+                vessel::vessel_table vessels;
+                if (!vessels.load(vm["vessels"].as<std::string>().c_str())) {
+                    abort_("Vessel table %s could not be loaded.", vm["vessels"].as<std::string>().c_str());
+                }
+                load_and_query_vessel(rtree_filename.c_str(), xy32{ from_x, from_y }, xy32{ to_x, to_y }, vessels, vm["imo"].as<int>(),
+                                      vm["beamclearance"].as<float>(), options);
+            } else if (sscanf(fromto.c_str(), "%d,%d,%d,%d", &from_x, &from_y, &to_x, &to_y) == 4) {
+                if (vm.count("corridor")) {
+                    auto search_corridor = parse_corridor(vm["corridor"].as<std::string>());
+                    options.corridor_ptr = &search_corridor;
+                    load_and_query(rtree_filename.c_str(), from_x, from_y, to_x, to_y, options, sea_areas_ptr);
+                    options.corridor_ptr = nullptr;
+                } else {
+                    load_and_query(rtree_filename.c_str(), from_x, from_y, to_x, to_y, options, sea_areas_ptr);
+                }
+            }
+        }
+
+        if (vm.count("loadrtree") && vm.count("patch")) {
+            xy32xy32 window;
+            if (sscanf(vm["patch"].as<std::string>().c_str(), "%d,%d,%d,%d", &window.xy0.x, &window.xy0.y, &window.xy1.x, &window.xy1.y) != 4
+                || window.xy0.x < 0 || window.xy0.y < 0 || window.xy1.x <= window.xy0.x || window.xy1.y <= window.xy0.y) {
+                abort_("--patch needs x0,y0,x1,y1");
+            }
+            if (!vm.count("patchpng")) {
+                abort_("--patch needs --patchpng.");
+            }
+            auto landmarks_filename = vm.count("landmarks") ? vm["landmarks"].as<std::string>() : std::string();
+            auto widths_filename = vm.count("widths") ? vm["widths"].as<std::string>() : std::string();
+            patch_map(vm["loadrtree"].as<std::string>().c_str(), window, vm["patchpng"].as<std::string>().c_str(),
+                      vm["land"].as<bool>() ? 0 : 1, landmarks_filename.empty() ? nullptr : landmarks_filename.c_str(),
+                      widths_filename.empty() ? nullptr : widths_filename.c_str(), options, vm["dump"].as<bool>());
+        }
+
+        if (vm.count("loadrtree") && vm.count("buildlandmarks")) {
+            if (options.costs == astarrtree::CM_UNIT) {
+                abort_("Landmark tables need --geodesic or the default Euclidean costs.");
+            }
+            auto rtree_filename = vm["loadrtree"].as<std::string>();
+            bi::managed_mapped_file file(bi::open_only, rtree_filename.c_str(), 0);
+            allocator_t alloc(file.get_segment_manager());
+            rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+            options.raster_width = rtree_raster_width(file, rtree_ptr, options.raster_width);
+            astarrtree::rect_graph graph;
+            load_rect_graph(rtree_ptr, rtree_filename.c_str(), options.wrap, options.raster_width, graph);
+            auto table_filename = vm["buildlandmarks"].as<std::string>();
+            if (!astarrtree::landmark_table::build(graph, options.costs, vm["landmarkcount"].as<int>(), table_filename.c_str())) {
+                abort_("Landmark table %s could not be written.", table_filename.c_str());
+            }
+        }
+
+        if (vm.count("loadrtree") && vm.count("buildwidths")) {
+            auto rtree_filename = vm["loadrtree"].as<std::string>();
+            bi::managed_mapped_file file(bi::open_only, rtree_filename.c_str(), 0);
+            allocator_t alloc(file.get_segment_manager());
+            rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+            options.raster_width = rtree_raster_width(file, rtree_ptr, options.raster_width);
+            auto table_filename = vm["buildwidths"].as<std::string>();
+            if (!astarrtree::cell_width_table::build(rtree_ptr, options.wrap, options.raster_width, table_filename.c_str())) {
+                abort_("Cell width table %s could not be written.", table_filename.c_str());
+            }
+        }
+
+        if (vm.count("loadrtree") && vm.count("isochrone")) {
+            int source_x, source_y;
+            if (sscanf(vm["isochrone"].as<std::string>().c_str(), "%d,%d", &source_x, &source_y) != 2) {
+                abort_("--isochrone needs x,y");
+            }
+            auto max_cost = vm.count("maxcost") ? vm["maxcost"].as<float>() : std::numeric_limits<float>::infinity();
+            auto rtree_filename = vm["loadrtree"].as<std::string>();
+            bi::managed_mapped_file file(bi::open_only, rtree_filename.c_str(), 0);
+            allocator_t alloc(file.get_segment_manager());
+            rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+            options.raster_width = rtree_raster_width(file, rtree_ptr, options.raster_width);
+            auto png_filename = vm.count("isochronepng") ? vm["isochronepng"].as<std::string>() : std::string();
+            isochrone(rtree_ptr, rtree_filename.c_str(), xy32{ source_x, source_y }, max_cost, options, png_filename.empty() ? nullptr : png_filename.c_str());
+        }
+
+        if (vm.count("loadrtree") && vm.count("snap")) {
+            if (!vm.count("ports")) {
+                abort_("--snap needs --ports.");
             }
+            auto rtree_filename = vm["loadrtree"].as<std::string>();
+            bi::managed_mapped_file file(bi::open_only, rtree_filename.c_str(), 0);
+            allocator_t alloc(file.get_segment_manager());
+            rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+            options.raster_width = rtree_raster_width(file, rtree_ptr, options.raster_width);
+            auto cities_filename = vm.count("cities") ? vm["cities"].as<std::string>() : std::string();
+            snap_places(rtree_ptr, options.raster_width, vm["ports"].as<std::string>().c_str(), cities_filename.empty() ? nullptr : cities_filename.c_str(),
+                        vm["snap"].as<std::string>());
+        }
+
+        if (vm.count("loadrtree") && vm.count("cachebench")) {
+            auto rtree_filename = vm["loadrtree"].as<std::string>();
+            bi::managed_mapped_file file(bi::open_only, rtree_filename.c_str(), 0);
+            allocator_t alloc(file.get_segment_manager());
+            rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+            options.raster_width = rtree_raster_width(file, rtree_ptr, options.raster_width);
+            benchmark_route_cache(rtree_ptr, options, static_cast<size_t>(vm["cachemb"].as<int>()) * 1024 * 1024, vm["cachebench"].as<int>());
+        }
+
+        if (vm.count("loadrtree") && vm["costbench"].as<bool>()) {
+            auto rtree_filename = vm["loadrtree"].as<std::string>();
+            bi::managed_mapped_file file(bi::open_only, rtree_filename.c_str(), 0);
+            allocator_t alloc(file.get_segment_manager());
+            rtree_t * rtree_ptr = file.find_or_construct<rtree_t>("rtree")(params_t(), indexable_t(), equal_to_t(), alloc);
+            options.raster_width = rtree_raster_width(file, rtree_ptr, options.raster_width);
+            benchmark_cost_models(rtree_ptr, options.wrap, options.raster_width, options.landmarks);
         }
 
         if (vm.count("dumprescale") && vm.count("dumprescaleout")) {
@@ -1808,6 +2674,35 @@ int main(int argc, char* argv[]) {
             auto output_filename = vm["dumprescaleout"].as<std::string>();
             dumprescale(dump_filename.c_str(), output_filename.c_str());
         }
+
+        if (vm.count("rectmerge") && vm.count("rectmergeout")) {
+            auto dump_filename = vm["rectmerge"].as<std::string>();
+            auto output_filename = vm["rectmergeout"].as<std::string>();
+            auto split = vm.count("rectsplit") && vm["rectsplit"].as<bool>();
+            auto bench = vm.count("rectmergebench") && vm["rectmergebench"].as<bool>();
+            auto rtree_size_in_mb = vm.count("rtreesizemb") ? vm["rtreesizemb"].as<int>() : RTREE_SIZE_IN_MB;
+            dumpmergerects(dump_filename.c_str(), output_filename.c_str(), split, bench, WORLDMAP_RTREE_MMAP_MAX_SIZE(rtree_size_in_mb));
+        }
+
+        if (vm.count("pyramid")) {
+            std::vector<std::string> dump_filenames;
+            auto pyramid_arg = vm["pyramid"].as<std::string>();
+            boost::split(dump_filenames, pyramid_arg, boost::is_any_of(","));
+            auto rtree_size_in_mb = vm.count("rtreesizemb") ? vm["rtreesizemb"].as<int>() : RTREE_SIZE_IN_MB;
+            auto corridor_buffer = vm["corridorbuffer"].as<int>();
+            raster_pyramid pyramid;
+            pyramid.open(dump_filenames, WORLDMAP_RTREE_MMAP_MAX_SIZE(rtree_size_in_mb));
+            if (vm.count("fromto")) {
+                auto fromto = vm["fromto"].as<std::string>();
+                int from_x, from_y, to_x, to_y;
+                if (sscanf(fromto.c_str(), "%d,%d,%d,%d", &from_x, &from_y, &to_x, &to_y) == 4) {
+                    astarrtree::astar_rtree_pyramid(pyramid.get_levels(), xy32{ from_x, from_y }, xy32{ to_x, to_y }, corridor_buffer, options);
+                }
+            }
+            if (vm["pyramidbench"].as<bool>()) {
+                benchmark_pyramid_routes(pyramid, corridor_buffer);
+            }
+        }
     } catch (const boost::program_options::error &ex) {
         std::cerr << ex.what() << '\n';
     }
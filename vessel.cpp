@@ -0,0 +1,97 @@
+#include "precompiled.hpp"
+#include "vessel.hpp"
+
+using namespace vessel;
+
+static const double meters_per_nm = 1852.0;
+
+// "25,0", "168.0", "18.,0" (a stray thousands separator); 0 when empty, unparsable or outside (0, max_value)
+static float parse_decimal(std::string s, float max_value) {
+    if (s.find(',') != std::string::npos) {
+        s.erase(std::remove(s.begin(), s.end(), '.'), s.end());
+        std::replace(s.begin(), s.end(), ',', '.');
+    }
+    char* end = nullptr;
+    const float v = strtof(s.c_str(), &end);
+    if (end == s.c_str() || !(v > 0 && v < max_value)) {
+        return 0;
+    }
+    return v;
+}
+
+bool vessel_table::load(const char* filename) {
+    enum { COL_IMO = 0, COL_NAME = 1, COL_MAX_SPEED = 11, COL_LENGTH = 12, COL_BEAM = 13, COL_DRAUGHT = 14 };
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) {
+        std::cerr << "Vessel file " << filename << " could not be opened" << std::endl;
+        return false;
+    }
+    struct row {
+        int imo;
+        std::string name;
+        float max_speed, length, beam, draught;
+    };
+    std::vector<row> rows;
+    std::vector<std::string> fields;
+    char buf[4096];
+    bool header = true;
+    while (fgets(buf, sizeof(buf), fp)) {
+        if (header) {
+            header = false;
+            continue;
+        }
+        std::string line(buf);
+        boost::algorithm::trim_right_if(line, boost::is_any_of("\r\n"));
+        boost::algorithm::split(fields, line, boost::is_any_of("\t"));
+        if (fields.size() <= COL_DRAUGHT) {
+            continue;
+        }
+        const int imo_number = atoi(fields[COL_IMO].c_str());
+        if (imo_number <= 0) {
+            continue;
+        }
+        // sanity bounds drop the few rows whose columns are shifted
+        rows.push_back(row{ imo_number, fields[COL_NAME],
+                            parse_decimal(fields[COL_MAX_SPEED], 60), parse_decimal(fields[COL_LENGTH], 500),
+                            parse_decimal(fields[COL_BEAM], 80), parse_decimal(fields[COL_DRAUGHT], 30) });
+    }
+    fclose(fp);
+    std::stable_sort(rows.begin(), rows.end(), [](const row& a, const row& b) { return a.imo < b.imo; });
+    rows.erase(std::unique(rows.begin(), rows.end(), [](const row& a, const row& b) { return a.imo == b.imo; }), rows.end());
+
+    imo.resize(rows.size());
+    names.resize(rows.size());
+    max_speed.resize(rows.size());
+    length.resize(rows.size());
+    beam.resize(rows.size());
+    draught.resize(rows.size());
+    for (size_t i = 0; i < rows.size(); i++) {
+        imo[i] = rows[i].imo;
+        names[i].swap(rows[i].name);
+        max_speed[i] = rows[i].max_speed;
+        length[i] = rows[i].length;
+        beam[i] = rows[i].beam;
+        draught[i] = rows[i].draught;
+    }
+    return true;
+}
+
+int vessel_table::find(int imo_number) const {
+    auto it = std::lower_bound(imo.begin(), imo.end(), imo_number);
+    if (it == imo.end() || *it != imo_number) {
+        return -1;
+    }
+    return static_cast<int>(it - imo.begin());
+}
+
+vessel_route vessel::route_for_vessel(astarrtree::rtree_t* rtree_ptr, xy32 from, xy32 to, const vessel_table& vessels, int row,
+                                      float beam_clearance, astarrtree::search_options options) {
+    if (beam_clearance > 0 && vessels.beam_m(row) > 0) {
+        options.min_cell_width_nm = std::max(options.min_cell_width_nm, static_cast<float>(beam_clearance * vessels.beam_m(row) / meters_per_nm));
+    }
+    vessel_route route;
+    route.waypoints = astarrtree::astar_rtree_memory(rtree_ptr, from, to, options);
+    route.length_nm = route.waypoints.empty() ? 0 : astarrtree::geodesic_metric(astarrtree::raster_width(rtree_ptr, options)).route_length_nm(route.waypoints);
+    route.eta_hours = vessels.max_speed_kn(row) > 0 ? route.length_nm / vessels.max_speed_kn(row) : 0;
+    return route;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "astarrtree.hpp"
+
+namespace vessel {
+    // Vessel particulars (crawler/vessels/vessels.txt) as one column per field, sorted by IMO number.
+    // Unknown values are 0.
+    class vessel_table {
+    public:
+        // Tab-separated export with a header row; decimals use ',' (a '.' next to a ',' is a thousands
+        // separator). The first row of a repeated IMO number wins.
+        bool load(const char* filename);
+
+        size_t size() const { return imo.size(); }
+        // Row of the vessel, or -1.
+        int find(int imo_number) const;
+
+        const std::string& name(int row) const { return names[row]; }
+        float max_speed_kn(int row) const { return max_speed[row]; }
+        float length_m(int row) const { return length[row]; }
+        float beam_m(int row) const { return beam[row]; }
+        float draught_m(int row) const { return draught[row]; }
+    private:
+        std::vector<int> imo;
+        std::vector<std::string> names;
+        std::vector<float> max_speed;
+        std::vector<float> length;
+        std::vector<float> beam;
+        std::vector<float> draught;
+    };
+
+    struct vessel_route {
+        std::vector<xy32> waypoints;
+        double length_nm;
+        // at the vessel's maximum speed; 0 when the speed is unknown
+        double eta_hours;
+    };
+
+    // Route for the vessel in 'row'. With 'beam_clearance' > 0 and options.widths set, cells narrower than that
+    // many beams are not entered (search_options::min_cell_width_nm). Draught is not used: the water raster
+    // has no depths.
+    vessel_route route_for_vessel(astarrtree::rtree_t* rtree_ptr, xy32 from, xy32 to, const vessel_table& vessels, int row,
+                                  float beam_clearance, astarrtree::search_options options);
+}
@@ -27,6 +27,17 @@ struct xy32xy32 {
     xy32 xy1;
 };
 
+// Row-major order of pixels, (y, x).
+inline bool yx_less(const xy32& a, const xy32& b) {
+    return a.y != b.y ? a.y < b.y : a.x < b.x;
+}
+
+// Rectangles by top-left corner in row-major order, (y0, x0): the cell order of rect_graph and of the
+// landmark and cell width tables (max-rect cells never share a corner).
+inline bool xy0_less(const xy32xy32& a, const xy32xy32& b) {
+    return yx_less(a.xy0, b.xy0);
+}
+
 struct xy32i {
     xy32 p;
     size_t i;